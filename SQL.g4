@@ -12,6 +12,8 @@ Average: 'AVG';
 Max: 'MAX';
 Min: 'MIN';
 Sum: 'SUM';
+Distinct: 'DISTINCT';
+ApproxCountDistinct: 'APPROX_COUNT_DISTINCT';
 
 Not: 'NOT';
 Null: 'NULL';
@@ -53,6 +55,7 @@ table_statement
     : 'CREATE' 'TABLE' Identifier '(' field_list ')'                                                # create_table
     | 'DROP' 'TABLE' Identifier                                                                     # drop_table
     | 'DESC' Identifier                                                                             # describe_table
+    | 'ANALYZE' 'TABLE' Identifier                                                                  # analyze_table
     | 'LOAD' 'DATA' 'INFILE' String 'INTO' 'TABLE' Identifier 'FIELDS' 'TERMINATED' 'BY' String     # load_table
     | 'INSERT' 'INTO' Identifier 'VALUES' value_lists                                               # insert_into_table
     | 'DELETE' 'FROM' Identifier ('WHERE' where_and_clause)?                                        # delete_from_table
@@ -61,23 +64,29 @@ table_statement
     ;
 
 select_table
-    : 'SELECT' selectors 'FROM' identifiers ('WHERE' where_and_clause)? (group_by)? (order_by)? (select_limit (select_offset)?)?
+    : 'SELECT' (Distinct)? selectors 'FROM' identifiers (table_sample)? ('WHERE' where_and_clause)? (group_by)? (order_by)? (select_limit (select_offset)?)?
     ;
 
 group_by
-    : 'GROUP' 'BY' column
+    : 'GROUP' 'BY' column (',' column)*
     ;
 
 order_by
-    : 'ORDER' 'BY' column (order)?
+    : 'ORDER' 'BY' order_item (',' order_item)*
     ;
 
+order_item
+    : column (order)?
+    ;
+
+table_sample: 'TABLESAMPLE' '(' Integer 'PERCENT' ')';
+
 select_limit: 'LIMIT' Integer;
 
 select_offset: 'OFFSET' Integer;
 
 alter_statement
-    : 'ALTER' 'TABLE' Identifier 'ADD' 'INDEX' (Identifier)? '(' identifiers ')'   			                # alter_add_index
+    : 'ALTER' 'TABLE' Identifier 'ADD' 'INDEX' (Identifier)? '(' identifiers ')' ('USING' index_type)?     # alter_add_index
     | 'ALTER' 'TABLE' Identifier 'DROP' 'INDEX' Identifier                                                  # alter_drop_index
     | 'ALTER' 'TABLE' Identifier 'DROP' 'PRIMARY' 'KEY' (Identifier)?                                       # alter_table_drop_pk
     | 'ALTER' 'TABLE' Identifier 'DROP' 'FOREIGN' 'KEY' Identifier                                          # alter_table_drop_foreign_key
@@ -86,6 +95,11 @@ alter_statement
     | 'ALTER' 'TABLE' Identifier 'ADD' 'UNIQUE' (Identifier)? '(' identifiers ')'              # alter_table_add_unique
     ;
 
+index_type
+    : 'BTREE'
+    | 'HASH'
+    ;
+
 field_list
     : field (',' field)*
     ;
@@ -158,6 +172,7 @@ selector
     : column
     | aggregator '(' column ')'
     | Count '(' '*' ')'
+    | Count '(' Distinct column ')'
     ;
 
 identifiers
@@ -180,4 +195,5 @@ aggregator
     | Max
     | Min
     | Sum
+    | ApproxCountDistinct
     ;
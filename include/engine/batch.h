@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <engine/defs.h>
+#include <storage/defs.h>
+
+/// up to BATCH_SIZE rows of one table, stored column by column.
+/// kernels narrow the selection vector instead of moving values around
+struct ColumnBatch {
+  static int const BATCH_SIZE = 1024;
+
+  struct Column {
+    DataType type;
+    /// bytes per value, and where the value sits in a table record
+    int width, index, offset;
+    std::vector<uint8_t> data;
+    /// 1 for NULL
+    uint8_t nulls[BATCH_SIZE];
+
+    template <typename T> const T *values() const {
+      return (const T *)data.data();
+    }
+    const char *str(int row) const {
+      return (const char *)data.data() + row * width;
+    }
+  };
+
+  std::vector<Column> columns;
+  int n_rows{0};
+  /// the rows still selected, ascending
+  int n_sel{0};
+  uint16_t sel[BATCH_SIZE];
+  PageLocator locators[BATCH_SIZE];
+
+  /// a column for each of fields, in that order
+  void init(const std::vector<std::shared_ptr<Field>> &fields);
+  /// append n records found at base + slot * record_len, all selected
+  void decode(const uint8_t *base, int record_len, int pagenum,
+              const int *slots, int n);
+  void clear() { n_rows = n_sel = 0; }
+};
+
+/// a WHERE constraint on a single column, evaluated over a batch in a loop
+/// specialized for the column type and the operator
+struct BatchPredicate {
+  enum Kind : uint8_t {
+    COMPARE = 1,
+    IS_NULL,
+    NOT_NULL,
+    IN_LIST,
+  };
+  Kind kind;
+  /// the column in the batch
+  int column;
+  Operator op;
+  int value_int;
+  double value_float;
+  /// sorted
+  std::vector<int> vals;
+
+  /// drop the selected rows that fail
+  void filter(ColumnBatch &batch) const;
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <string>
 
@@ -17,6 +18,10 @@ struct IndexMeta;
 struct KeyCollection;
 class IndexManager;
 
+/// stats.h
+struct ColumnStats;
+struct TableStats;
+
 /// field.h
 struct DataTypeBase;
 struct IntType;
@@ -39,6 +44,7 @@ struct ColumnNullConstraint;
 struct ColumnLikeStringConstraint;
 struct ColumnOpSubqueryConstraint;
 struct ColumnInSubqueryConstraint;
+struct ColumnInListConstraint;
 
 struct SetVariable;
 class QueryPlanner;
@@ -48,10 +54,15 @@ class Iterator;
 class BlockIterator;
 class GatherIterator;
 class RecordIterator;
+class VectorScanIterator;
 class IndexIterator;
 class JoinIterator;
+class HashJoinIterator;
+class IndexJoinIterator;
+class MergeJoinIterator;
 class PermuteIterator;
 class AggregateIterator;
+class MetaAggregateIterator;
 
 typedef uint32_t unified_id_t;
 typedef uint16_t bitmap_t;
@@ -59,7 +70,10 @@ typedef uint64_t key_hash_t;
 
 unified_id_t get_unified_id();
 
-extern bool has_err;
+/// atomic, parallel aggregation workers may raise it
+extern std::atomic<bool> has_err;
+/// bytes the running statement wrote to temp files for lack of memory
+extern uint64_t spilled_bytes;
 
 enum DataType : uint8_t {
   INT = 1,
@@ -88,6 +102,8 @@ enum Aggregator : uint8_t {
   MAX,
   MIN,
   SUM,
+  COUNT_DISTINCT,
+  APPROX_COUNT_DISTINCT,
 };
 
 Aggregator str2aggr(const std::string &str);
@@ -99,6 +115,8 @@ enum IteratorType : uint8_t {
   AGGERGATE,
   SORT,
   PERMUTE,
+  META_AGGREGATE,
+  DISTINCT,
 };
 
 enum ConstraintType : uint8_t {
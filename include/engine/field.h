@@ -179,6 +179,9 @@ struct ForeignKey : public KeyBase {
 };
 
 struct ExplicitIndexKey : public KeyBase {
+  /// also maintain a hash file for equality lookups
+  bool use_hash{false};
+
   ExplicitIndexKey() { type = KeyType::EXPLICIT_INDEX; }
   void serialize(SequentialAccessor &s) const override;
   void deserialize(SequentialAccessor &s) override;
@@ -1,13 +1,17 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <engine/defs.h>
 #include <storage/defs.h>
 
+class BloomFilter;
+
 key_hash_t keysHash(const std::vector<std::shared_ptr<Field>> &fields);
 
 struct KeyCollection {
@@ -21,6 +25,12 @@ struct IndexMeta {
   bool store_full_data;
   int refcount;
   std::shared_ptr<BPlusTree> tree;
+  /// optional equality-only access path over the same entries
+  std::shared_ptr<HashIndex> hash;
+  /// in-memory filter over the column prefix of unique indexes, lets
+  /// contains() skip the descent for absent keys. never persisted, and
+  /// rebuilt in place so that remapped copies keep sharing it
+  std::shared_ptr<BloomFilter> bloom;
 
   IndexMeta(SequentialAccessor &s);
   IndexMeta(const std::vector<std::shared_ptr<Field>> &keys,
@@ -43,7 +53,34 @@ struct IndexMeta {
   }
 
   std::vector<int> extractKeys(const KeyCollection &data);
+  /// locators of entries whose first key lies in [lbound, rbound),
+  /// sorted by (pagenum, slotnum) so that heap pages are visited in order
+  std::vector<PageLocator> collect_rids(int lbound, int rbound) const;
   void insert_record(KeyCollection data);
+  bool erase_record(KeyCollection data);
+  /// insert_record() for several records, in key order
+  void insert_records(const std::vector<KeyCollection> &data);
+  /// whether a record with the same key values as ptr exists
+  bool contains(uint8_t *ptr);
+  /// contains() for n records stored record_len apart in buf
+  std::vector<bool> contains_batch(uint8_t *buf, int n, int record_len);
+  /// locators of entries whose first key equals val, through the hash file
+  /// when it can answer the lookup
+  std::vector<PageLocator> point_rids(int val) const;
+  void build_hash(const std::string &filename);
+  void drop_hash();
+  void build_bloom();
+  /// visit every entry (columns..., pagenum, slotnum) in key order
+  void for_each_entry(const std::function<void(int *)> &fn) const;
+  /// visit the entries whose first key lies in [lbound, rbound) together
+  /// with the records stored beside them, in key order or backwards when
+  /// reverse is set, until fn returns false
+  void scan_range(
+      int lbound, int rbound, bool reverse,
+      const std::function<bool(int *, const uint8_t *)> &fn) const;
   BPlusQueryResult le_match(KeyCollection data);
   uint32_t *get_refcount(uint8_t *ptr);
+  /// increment the refcount matched by each of n records in buf, one
+  /// lookup per distinct key
+  void add_refcounts(uint8_t *buf, int n, int record_len);
 };
\ No newline at end of file
@@ -1,17 +1,34 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <vector>
 
+#include <engine/batch.h>
 #include <engine/defs.h>
 #include <engine/field.h>
+#include <engine/predicate.h>
 #include <storage/defs.h>
 #include <utils/config.h>
+#include <utils/group_table.h>
+#include <utils/hyperloglog.h>
+#include <utils/loser_tree.h>
 
 const int QUERY_MAX_BLOCK = 8 << 20; /// 8MB
 const int QUERY_MAX_PAGES = QUERY_MAX_BLOCK / Config::PAGE_SIZE;
+/// an index lookup costs about this many scanned rows of the inner table
+const int INDEX_JOIN_RATIO = 4;
+/// runs merged at once, each holds one page of the buffer pool while read
+const int SORT_MAX_FAN_IN = 64;
+/// tables of fewer pages are scanned on the calling thread alone
+const int PARALLEL_SCAN_MIN_PAGES = 256;
 
 struct field_caster {
   DataType type;
@@ -75,13 +92,27 @@ public:
 };
 
 class RecordIterator : public BlockIterator {
-private:
+protected:
   int fd_src, pagenum_src, slotnum_src;
   std::shared_ptr<RecordManager> record_manager;
   std::vector<std::shared_ptr<Field>> fields_src;
   std::vector<std::shared_ptr<WhereConstraint>> constraints;
+  Conjunction filter;
   std::vector<int> valid_records;
   std::vector<int>::iterator it;
+  /// when set, only visit the listed (sorted) locators instead of all pages
+  bool rid_mode{false};
+  std::vector<PageLocator> rids;
+  size_t rid_iter{0};
+  /// TABLESAMPLE: the share of pages read, in percent, and the seed of the
+  /// hash that picks them
+  int sample_percent{100};
+  uint64_t sample_seed{0};
+
+  /// whether the page is in the sample, the same on every rescan
+  bool page_sampled(int pagenum) const;
+  /// copy the fields_dst of a stored record into a record of record_len
+  void project(const uint8_t *ptr_src, uint8_t *ptr_dst) const;
 
 public:
   /// @param cons will be filtered
@@ -92,6 +123,12 @@ public:
                  const std::vector<std::shared_ptr<WhereConstraint>> &cons,
                  const std::vector<std::shared_ptr<Field>> &fields_src,
                  const std::vector<std::shared_ptr<Field>> &fields_dst);
+  /// @param rids locators gathered from indexes, sorted in page order
+  RecordIterator(std::shared_ptr<RecordManager> rec,
+                 const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                 const std::vector<std::shared_ptr<Field>> &fields_src,
+                 const std::vector<std::shared_ptr<Field>> &fields_dst,
+                 std::vector<PageLocator> &&rids);
   ~RecordIterator();
   bool get_next_valid_no_check();
   bool get_next_valid() override;
@@ -99,6 +136,72 @@ public:
   int fill_next_block() override;
   /// for delete/set operatione
   std::pair<int, int> get_locator();
+  /// read about percent% of the pages, whole, skipping the others unread.
+  /// the same seed picks the same pages
+  void set_sample(int percent, uint64_t seed);
+};
+
+/// a full scan that decodes the table a batch of columns at a time.
+/// constraints on a single INT, DATE or FLOAT column run as batch kernels,
+/// the others are checked on the records still selected after them
+class VectorScanIterator : public RecordIterator {
+private:
+  /// the page being decoded and its valid slots
+  int scan_page{-1};
+  std::vector<int> slots;
+  size_t slot_pos{0};
+  ColumnBatch batch;
+  /// the selected rows of batch already handed out
+  int batch_pos{0};
+  std::vector<BatchPredicate> predicates;
+  /// the constraints left to check on the stored records
+  Conjunction residual;
+
+public:
+  VectorScanIterator(std::shared_ptr<RecordManager> rec,
+                     const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                     const std::vector<std::shared_ptr<Field>> &fields_src,
+                     const std::vector<std::shared_ptr<Field>> &fields_dst);
+  /// the next batch with at least one selected row, its first columns
+  /// follow get_fields_dst(). nullptr once the table is exhausted
+  /// the caller may narrow its selection
+  ColumnBatch *next_batch();
+  bool get_next_valid() override;
+  void reset_all() override;
+  int fill_next_block() override;
+};
+
+/// a full scan filtered by the ThreadPool. the pages are cut into morsels
+/// of MORSEL_PAGES; in each round the workers claim morsels one at a time
+/// and filter each into a buffer of projected records, which the blocks
+/// then gather in page order, so rows come out as a serial scan yields
+/// them. get_next_valid() still reads serially, for callers of locators
+class ParallelScanIterator : public RecordIterator {
+public:
+  static int const MORSEL_PAGES = 32;
+
+private:
+  /// morsels per round and per thread of the pool
+  static int const ROUND_MORSELS = 4;
+  /// the first morsel of the next round, and the records of this round
+  int next_morsel{0};
+  std::vector<std::vector<uint8_t>> round;
+  size_t round_iter{0}, round_pos{0};
+
+  void run_round();
+
+public:
+  ParallelScanIterator(
+      std::shared_ptr<RecordManager> rec,
+      const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+      const std::vector<std::shared_ptr<Field>> &fields_src,
+      const std::vector<std::shared_ptr<Field>> &fields_dst);
+  int n_morsels() const;
+  /// append the records of morsel m that pass the constraints to out,
+  /// projected to get_fields_dst(). safe to call from several threads
+  void scan_morsel(int m, std::vector<uint8_t> &out) const;
+  void reset_all() override;
+  int fill_next_block() override;
 };
 
 class IndexIterator : public BlockIterator {
@@ -109,30 +212,50 @@ private:
   int leaf_data_len, leaf_max, key_num;
   bool store_full_data;
   int lbound, rbound;
+  /// walk the leaves from rbound down to lbound through left_sibling
+  bool reverse;
+  /// at most this many records per block, see set_block_cap()
+  int block_cap{INT_MAX};
   std::vector<std::shared_ptr<Field>> fields_src;
   std::vector<std::shared_ptr<WhereConstraint>> constraints;
+  Conjunction filter;
+
+  void seek();
 
 public:
-  /// [lbound, rbound)
+  /// [lbound, rbound), in ascending key order unless reverse is set
   IndexIterator(std::shared_ptr<IndexMeta> index, int lbound, int rbound,
                 const std::vector<std::shared_ptr<WhereConstraint>> &cons,
                 const std::vector<std::shared_ptr<Field>> &fields_src,
-                const std::vector<std::shared_ptr<Field>> &fields_dst);
+                const std::vector<std::shared_ptr<Field>> &fields_dst,
+                bool reverse = false);
   ~IndexIterator();
   bool get_next_valid() override;
   void reset_all() override;
   int fill_next_block() override;
+  /// when only the first n rows will be consumed (ORDER BY ... LIMIT n),
+  /// stop each block after n records instead of filling QUERY_MAX_BLOCK
+  void set_block_cap(int n) { block_cap = std::max(n, 1); }
+  /// restart on [lbound, rbound), for lookups of index joins
+  void rebind(int lbound, int rbound);
   int get_key_num() const { return key_num; }
   int *get_keys() const;
 };
 
 class JoinIterator : public BlockIterator {
-private:
+protected:
   std::shared_ptr<BlockIterator> lhs, rhs;
+  /// field_id -> [index, offset] in the records of lhs or rhs
+  std::map<unified_id_t, std::pair<int, int>> pos_src;
   std::vector<std::pair<int, int>> pos_dst_lhs, pos_dst_rhs;
   std::vector<std::shared_ptr<Field>> fields_dst_lhs, fields_dst_rhs;
+  /// constraints between lhs and rhs, built for check(lhs_row, rhs_row)
   std::vector<std::shared_ptr<ColumnOpColumnConstraint>> constraints;
 
+  /// the pair of input records matched by the last get_next_valid()
+  virtual const uint8_t *get_lhs() const { return lhs->get(); }
+  virtual const uint8_t *get_rhs() const { return rhs->get(); }
+
 public:
   JoinIterator(std::shared_ptr<BlockIterator> lhs,
                std::shared_ptr<BlockIterator> rhs,
@@ -145,6 +268,130 @@ public:
   int fill_next_block() override;
 };
 
+/// equi-join: the build input is hashed on the columns of its `=`
+/// constraints with the probe input, which then streams through the table.
+/// a build input over QUERY_MAX_BLOCK bytes is split together with the probe
+/// input into partitions in temporary files, joined one pair at a time
+class HashJoinIterator : public JoinIterator {
+private:
+  struct key_column {
+    DataType type;
+    int build_idx, build_off, probe_idx, probe_off;
+  };
+  static const int N_PARTITIONS = 16;
+  std::shared_ptr<BlockIterator> build_side, probe_side;
+  bool build_left, built{false};
+  int build_len, probe_len;
+  std::vector<key_column> keys;
+  std::vector<std::shared_ptr<ColumnOpColumnConstraint>> residual;
+  /// the in-memory table: build records, their hashes and bucket chains
+  std::vector<uint8_t> rows;
+  std::vector<uint64_t> hashes;
+  std::vector<int> heads, next;
+  /// spilled partitions: [temp file, number of records] per input
+  bool partitioned{false};
+  std::vector<std::pair<int, int>> build_parts, probe_parts;
+  int part{-1}, probe_iter{0};
+  /// the current probe record, its hash and the rest of its bucket chain
+  std::vector<uint8_t> probe_row;
+  uint64_t probe_hash;
+  int chain{-1}, match{-1};
+
+  /// nullopt when a key column is NULL, such records never match
+  std::optional<uint64_t> hash_keys(const uint8_t *record, bool build) const;
+  bool keys_equal(const uint8_t *build_row, const uint8_t *probe_row) const;
+  void build();
+  void index_rows();
+  void append(std::pair<int, int> &part, const uint8_t *record, int len);
+  const uint8_t *read(std::pair<int, int> part, int i, int len) const;
+  bool next_probe_row();
+
+protected:
+  const uint8_t *get_lhs() const override;
+  const uint8_t *get_rhs() const override;
+
+public:
+  /// @param build_left hash lhs and probe with rhs, the other way otherwise
+  HashJoinIterator(std::shared_ptr<BlockIterator> lhs,
+                   std::shared_ptr<BlockIterator> rhs,
+                   const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                   const std::vector<std::shared_ptr<Field>> &fields_dst,
+                   bool build_left);
+  ~HashJoinIterator();
+  /// whether an `=` constraint links a table of lhs to one of rhs
+  static bool applicable(
+      std::shared_ptr<BlockIterator> lhs, std::shared_ptr<BlockIterator> rhs,
+      const std::vector<std::shared_ptr<WhereConstraint>> &cons);
+
+  bool get_next_valid() override;
+  void reset_all() override;
+};
+
+/// index nested-loop join: every lhs record rebinds an IndexIterator over the
+/// rhs table to the entries equal to its join column, so that the rhs table
+/// is never scanned. the leaves keep whole records, the heap is not read
+class IndexJoinIterator : public JoinIterator {
+private:
+  std::shared_ptr<IndexIterator> inner;
+  /// [index, offset] of the lhs column of the `=` constraint being looked up
+  int key_idx, key_off;
+  bool outer_valid{false};
+
+public:
+  /// @param inner index scan over the rhs table led by the rhs column of key
+  IndexJoinIterator(std::shared_ptr<BlockIterator> lhs,
+                    std::shared_ptr<IndexIterator> inner,
+                    std::shared_ptr<ColumnOpColumnConstraint> key,
+                    const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                    const std::vector<std::shared_ptr<Field>> &fields_dst);
+
+  bool get_next_valid() override;
+  void reset_all() override;
+};
+
+/// sort-merge equi-join on an INT or DATE column: both inputs are read in
+/// ascending key order, an input not already in that order goes through a
+/// SortIterator first. the rhs rows of the current key are kept in memory and
+/// replayed for each lhs row with that key
+class MergeJoinIterator : public JoinIterator {
+private:
+  bool lhs_sorted, rhs_sorted;
+  std::shared_ptr<Field> key_lhs, key_rhs;
+  std::shared_ptr<Iterator> lhs_stream, rhs_stream;
+  int lhs_len, rhs_len;
+  /// [index, offset] of the key in records of lhs and rhs
+  int lhs_idx, lhs_off, rhs_idx, rhs_off;
+  bool started{false}, rhs_valid{false}, in_run{false};
+  std::vector<uint8_t> lhs_row, run;
+  int run_key, run_iter;
+
+  std::shared_ptr<Iterator> open_stream(std::shared_ptr<BlockIterator> side,
+                                        std::shared_ptr<Field> key,
+                                        bool sorted);
+  /// next lhs row with a non-NULL key into lhs_row
+  bool next_lhs();
+
+protected:
+  const uint8_t *get_lhs() const override { return lhs_row.data(); }
+  const uint8_t *get_rhs() const override {
+    return run.data() + (size_t)run_iter * rhs_len;
+  }
+
+public:
+  /// @param key `=` constraint between lhs and rhs on the merge columns
+  /// @param lhs_sorted, rhs_sorted whether the input is already in ascending
+  /// key order (e.g. IndexIterator from TableManager::make_keyed_iterator)
+  MergeJoinIterator(std::shared_ptr<BlockIterator> lhs,
+                    std::shared_ptr<BlockIterator> rhs,
+                    std::shared_ptr<ColumnOpColumnConstraint> key,
+                    const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                    const std::vector<std::shared_ptr<Field>> &fields_dst,
+                    bool lhs_sorted, bool rhs_sorted);
+
+  bool get_next_valid() override;
+  void reset_all() override;
+};
+
 class PermuteIterator : public Iterator {
 private:
   std::shared_ptr<BlockIterator> iter;
@@ -171,46 +418,268 @@ protected:
   virtual void build() = 0;
 };
 
+/// records of len bytes set aside by hash to FAN_OUT temp files, for the
+/// hash operators to go through what Config::hash_memory cannot hold a
+/// partition at a time. level is the partitioning depth: each one picks
+/// four more bits of the hash, from the top
+class SpillPartitions {
+public:
+  static int const FAN_OUT = 16;
+  /// hash bits left for partitioning below the tag bits GroupTable uses
+  static int const MAX_LEVEL = 6;
+
+private:
+  int len, level;
+  /// [temp file, number of records] per partition, fd -1 while empty
+  std::vector<std::pair<int, int>> parts;
+
+public:
+  SpillPartitions(int len, int level);
+  SpillPartitions(const SpillPartitions &) = delete;
+  ~SpillPartitions();
+  /// whether records of len bytes can be partitioned at level
+  static bool allowed(int len, int level);
+  void append(const uint8_t *record, uint64_t h);
+  int count(int part) const { return parts[part].second; }
+  /// hand each record of the partition to visit, then close it. records
+  /// are copied out first, so visit may spill further
+  void drain(int part, const std::function<void(const uint8_t *)> &visit);
+};
+
+/// first occurrences of fixed-width keys. keys are kept in a hash table of
+/// up to Config::hash_memory bytes; once it is full, the keys it does not
+/// hold are partitioned by hash to temp files, and each partition is
+/// deduplicated on its own afterwards, spilling again if need be
+class HashDedup {
+private:
+  int key_len, level;
+  GroupTable table;
+  /// the keys set aside, nullptr while the table has room
+  std::unique_ptr<SpillPartitions> partitions;
+
+public:
+  /// @param key_len a multiple of 8
+  HashDedup(int key_len, int level = 0);
+  /// whether key is new, keys set aside are not new until drain()
+  bool insert(const uint8_t *key);
+  /// hand every new key set aside to visit, once each
+  void drain(const std::function<void(const uint8_t *)> &visit);
+};
+
+/// hash aggregation. once the group table outgrows Config::hash_memory,
+/// rows of the groups it holds are still folded in place while rows of new
+/// groups are partitioned by hash to temp files; the states of the table
+/// are then written out and each partition is aggregated on its own,
+/// spilling again if need be.
+/// over a ParallelScanIterator, and unless a COUNT(DISTINCT) or a sketch
+/// keeps state outside the group table, each worker folds its morsels into
+/// a table of its own; the partial states are then merged a hash partition
+/// per task
 class AggregateIterator : public GatherIterator {
 private:
   typedef int count_t;
   static_assert(std::is_same<count_t, IntType::DType>::value,
                 "count_t must equal IntType::DType");
   std::shared_ptr<BlockIterator> iter;
-  std::shared_ptr<Field> group_by_field;
+  int src_len;
+  /// the partitioning depth of the rows being aggregated
+  int level{0};
+  /// the input rows set aside, nullptr while the table has room
+  std::unique_ptr<SpillPartitions> partitions;
+  /// the states of the groups done, written out once any row was set
+  /// aside, fd is -1 before
+  std::pair<int, int> finished{-1, 0};
+  /// GROUP BY columns of the input, len is their width
+  std::vector<field_caster> group_columns;
   std::vector<field_caster> caster;
-  int group_by_field_offset;
   int export_len;
   std::vector<Aggregator> aggrs;
   std::vector<uint8_t> buffer;
+  /// the groups, keyed by a NULL byte and the value of each GROUP BY
+  /// column padded to whole words, with their states (a count and a value
+  /// per aggregate) inline. without GROUP BY there is a single group of an
+  /// empty key
+  std::unique_ptr<GroupTable> groups;
+  int group_key_len;
+  std::vector<uint8_t> group_keys;
+  /// a dedup of (group, value) per COUNT(DISTINCT), nullptr for the others
+  std::vector<std::unique_ptr<HashDedup>> distinct;
+  std::vector<uint8_t> distinct_key;
+  /// a sketch per group of each APPROX_COUNT_DISTINCT, indexed by group.
+  /// their estimates replace the counts when a pass finishes
+  std::vector<std::vector<HyperLogLog>> sketches;
+  size_t sketch_memory{0};
+  /// COUNT and SUM are multiplied by it, the inverse of a TABLESAMPLE share
+  double scale{1};
+  /// the states merged from the workers' tables, one after another
+  std::vector<uint8_t> merged;
+  /// set while update() and merge_state() run on the workers, which then
+  /// only flag a NONE mismatch for build_parallel() to report once
+  bool in_workers{false};
+  std::atomic<bool> none_mismatch{false};
 
   void build() override;
-  void update(uint8_t *p, const uint8_t *o);
-  int assign_page();
+  /// fold record o into state, the state of the group
+  void update(uint8_t *state, int group, const uint8_t *o);
+  /// fold the partial state src into dst, both of COUNT, SUM, MIN, MAX,
+  /// AVG or NONE only
+  void merge_state(uint8_t *dst, const uint8_t *src);
+  /// values that differ under NONE, optionally the two INT ones
+  void none_differs();
+  void none_differs(int a, int b);
+  /// the group of key, -1 when its row is to be set aside by set_aside()
+  int find_group(const uint8_t *key, uint64_t h);
+  void set_aside(const uint8_t *record, uint64_t h);
+  /// count what the dedups set aside, then write the states out and clear
+  /// the table if rows were set aside
+  void finish_pass();
+  /// aggregate the rows set aside, a partition after another
+  void aggregate_partitions();
+  /// the group key of an input record
+  void pack_key(const uint8_t *record, uint8_t *key) const;
+  /// whether val is new to the group under the i-th aggregate, a
+  /// COUNT(DISTINCT). values set aside by its dedup are counted at the end
+  bool first_distinct(int i, int group, const uint8_t *val);
+  /// add val to the sketch of the group under the i-th aggregate, an
+  /// APPROX_COUNT_DISTINCT
+  void sketch_insert(int i, int group, const uint8_t *val);
+  /// the vectorized build: the aggregates fold whole columns of each batch
+  /// into the group states
+  void build_batched(std::shared_ptr<VectorScanIterator> scan);
+  /// the parallel build into merged. false, with the scan to be reset, when
+  /// the workers' tables outgrow Config::hash_memory
+  bool build_parallel(std::shared_ptr<ParallelScanIterator> scan);
 
 public:
   AggregateIterator(std::shared_ptr<BlockIterator> iterator,
-                    std::shared_ptr<Field> group_by_field,
+                    const std::vector<std::shared_ptr<Field>> &group_by,
                     const std::vector<std::shared_ptr<Field>> fields_dst_,
                     const std::vector<Aggregator> &aggrs);
   ~AggregateIterator();
+  /// extrapolate COUNT and SUM from a sample holding 1/scale of the rows
+  void set_scale(double scale_) { scale = scale_; }
   bool get_next_valid() override;
   const uint8_t *get() const override;
 };
 
-class SortIterator : public GatherIterator {
+/// SELECT DISTINCT: the first occurrence of each row, through a HashDedup
+/// on the rows with NULL fields and string tails zeroed
+class DistinctIterator : public GatherIterator {
+private:
+  std::shared_ptr<Iterator> iter;
+  int key_len;
+
+  void build() override;
+  void append(const uint8_t *row);
+
+public:
+  DistinctIterator(std::shared_ptr<Iterator> iterator);
+  ~DistinctIterator();
+  bool get_next_valid() override;
+  const uint8_t *get() const override;
+};
+
+/// answers COUNT(*), MIN and MAX of a single table without reading its
+/// records: the row count is kept by the RecordManager, the extremes are the
+/// first non-NULL entries at either end of an index
+class MetaAggregateIterator : public GatherIterator {
+public:
+  /// COUNT(*) of the whole table when index is nullptr, otherwise COUNT(*),
+  /// MIN or MAX over the entries of index in [lbound, rbound) whose column
+  /// null_index is not NULL. the index leads with the aggregated column
+  struct Source {
+    Aggregator aggr;
+    std::shared_ptr<IndexMeta> index;
+    int null_index;
+  };
+
 private:
-  using sort_t = std::pair<int, uint8_t *>;
-  DataType sort_by_field_type;
-  bool desc;
-  int sort_by_field_index, sort_by_field_offset;
+  std::shared_ptr<RecordManager> record_manager;
+  std::vector<Source> sources;
+  int lbound, rbound;
+  std::vector<uint8_t> buffer;
+
+  void build() override;
+
+public:
+  MetaAggregateIterator(std::shared_ptr<RecordManager> record_manager,
+                        std::vector<Source> &&sources, int lbound, int rbound,
+                        const std::vector<std::shared_ptr<Field>> &fields_dst);
+  bool get_next_valid() override;
+  const uint8_t *get() const override;
+};
+
+/// external merge sort on normalized keys. the ORDER BY columns of a row are
+/// encoded so that memcmp orders them: a NULL byte, then the value in big
+/// endian with the sign flipped, every byte inverted for DESC. the input
+/// position follows as one more column, in the direction of the last one.
+/// runs of up to QUERY_MAX_BLOCK bytes are radix sorted in memory and
+/// spilled to temp files, then merged SORT_MAX_FAN_IN at a time through a
+/// loser tree, the last merge streaming into get_next_valid()
+class SortIterator : public GatherIterator {
+protected:
+  /// compares the heads of two runs being merged
+  struct HeadLess {
+    const SortIterator *sort;
+    bool operator()(int a, int b) const {
+      return memcmp(sort->heads.data() + a * sort->run_len,
+                    sort->heads.data() + b * sort->run_len, sort->key_len) < 0;
+    }
+  };
+  struct sort_column {
+    DataType type;
+    bool desc;
+    int index, offset, width;
+  };
+
+  std::vector<sort_column> columns;
   std::shared_ptr<Iterator> iter;
-  std::vector<sort_t> sorted;
+  /// rows are gathered as the key followed by the record
+  int key_len, run_len;
+  /// the run being gathered, and its order once sorted
+  std::vector<uint8_t> rows;
+  std::vector<int> order;
+  /// spilled sorted runs: [temp file, number of records]
+  std::vector<std::pair<int, int>> runs;
+  /// the runs being merged: the next record to read from each, and a copy
+  /// of the current one
+  std::vector<int> run_pos;
+  std::vector<uint8_t> heads;
+  std::unique_ptr<LoserTree<HeadLess>> tree;
+
+  /// the normalized key of the pos-th input record
+  void encode(const uint8_t *record, int pos, uint8_t *key) const;
+  void sort_rows();
+  void spill_rows();
+  /// copy the next record of runs[first + i] into heads, false at its end
+  bool load_head(int first, int i);
+  void start_merge(int first, int count);
 
 public:
-  SortIterator(std::shared_ptr<Iterator> iterator,
-               std::shared_ptr<Field> sort_by_field, bool desc);
+  /// @param order_by columns of the input, each with whether it is DESC
+  SortIterator(
+      std::shared_ptr<Iterator> iterator,
+      const std::vector<std::pair<std::shared_ptr<Field>, bool>> &order_by);
+  ~SortIterator();
+  /// bytes gathered per row, the key and the record
+  static int row_size(
+      const std::vector<std::shared_ptr<Field>> &fields,
+      const std::vector<std::pair<std::shared_ptr<Field>, bool>> &order_by);
   void build() override;
   bool get_next_valid() override;
   const uint8_t *get() const override;
+};
+
+/// ORDER BY ... LIMIT: a single pass keeps the first k rows of the order in
+/// a bounded heap, the others are dropped as they are read
+class TopKIterator : public SortIterator {
+private:
+  int k;
+
+public:
+  TopKIterator(
+      std::shared_ptr<Iterator> iterator,
+      const std::vector<std::pair<std::shared_ptr<Field>, bool>> &order_by,
+      int k);
+  void build() override;
 };
\ No newline at end of file
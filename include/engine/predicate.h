@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <engine/defs.h>
+#include <engine/query.h>
+
+/// the three-way comparison of the row checks, with the operator folded at
+/// compile time. NaN compares equal to everything, as it does there
+template <Operator op, typename T> inline bool compare_op(T x, T v) {
+  bool lt = x < v, gt = x > v;
+  return ((op & Operator::LT) && lt) || ((op & Operator::GT) && gt) ||
+         ((op & Operator::EQ) && !lt && !gt);
+}
+
+/// the constraints on the records of one table, compiled into kernels
+/// specialized for the column type and the operator:
+/// - the NULL checks of all terms are two bitmap masks, tested once
+/// - the INT and DATE comparisons on a column are one range test
+/// - LIKE and the IN sets on FLOAT or VARCHAR stay virtual check() calls
+class Conjunction {
+public:
+  struct Term;
+  typedef bool (*Kernel)(const Term &, const uint8_t *);
+  struct Term {
+    Kernel test;
+    int offset, offset_o;
+    /// the INT range [lo, hi], lo alone for `<>`
+    int lo, hi;
+    double value_float;
+    std::string value_str;
+    /// sorted
+    std::vector<int> vals;
+  };
+
+  Conjunction() = default;
+  /// @param cons all live in the table of fields
+  /// @param fields all fields of the table
+  Conjunction(const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+              const std::vector<std::shared_ptr<Field>> &fields);
+
+  bool check(const uint8_t *record) const {
+    bitmap_t bitmap = *(const bitmap_t *)record;
+    if ((bitmap & present) != present || (bitmap & absent) != 0) {
+      return false;
+    }
+    for (const auto &term : terms) {
+      if (!term.test(term, record)) {
+        return false;
+      }
+    }
+    for (const auto &con : residual) {
+      if (!con->check(record, record)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  /// true when every record passes
+  bool trivial() const {
+    return present == 0 && absent == 0 && terms.empty() && residual.empty();
+  }
+
+private:
+  /// the columns that must be non-NULL, and those that must be NULL
+  bitmap_t present{0}, absent{0};
+  std::vector<Term> terms;
+  std::vector<std::shared_ptr<WhereConstraint>> residual;
+};
@@ -4,6 +4,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
 
@@ -39,10 +40,22 @@ struct WhereConstraint {
   virtual bool live_in(unified_id_t table_id_) { return table_id == table_id_; }
 };
 
-struct ColumnOpValueConstraint : public WhereConstraint {
+/// a column compared with a constant, as written. value holds INT and DATE
+/// constants, value_float FLOAT ones and value_str VARCHAR ones
+struct ValueComparison {
+  DataType dtype;
+  Operator cmp_op;
+  int column_index, column_offset;
+  int value{0};
+  double value_float{0};
+  std::string value_str;
+};
+
+struct ColumnOpValueConstraint : public WhereConstraint,
+                                 public ValueComparison {
   std::function<bool(const char *)> cmp;
-  /// reserved for BPlusTree, which supports only integer
-  int column_offset, value;
+  /// reserved for BPlusTree, which supports only integer: NE unless the
+  /// column is INT or DATE
   Operator op;
 
   ColumnOpValueConstraint(std::shared_ptr<Field> field, Operator op,
@@ -75,6 +88,8 @@ struct ColumnOpColumnConstraint : public WhereConstraint {
 
 struct ColumnNullConstraint : public WhereConstraint {
   std::function<bool(const char *)> chk;
+  int column_index, column_offset;
+  bool not_null;
 
   ColumnNullConstraint(std::shared_ptr<Field> field, bool field_not_null);
   bool check(const uint8_t *record, const uint8_t *other) const override;
@@ -90,7 +105,9 @@ struct ColumnLikeStringConstraint : public WhereConstraint {
   }
 };
 
-struct ColumnOpSubqueryConstraint : public WhereConstraint {
+/// the subquery is run once, when constructed
+struct ColumnOpSubqueryConstraint : public WhereConstraint,
+                                    public ValueComparison {
   std::shared_ptr<QueryPlanner> subquery;
   std::function<bool(const char *)> cmp;
 
@@ -106,6 +123,8 @@ struct ColumnInSubqueryConstraint : public WhereConstraint {
   std::set<int> vals_int;
   std::set<double> vals_float;
   std::set<std::string> vals_str;
+  /// -1 unless the column is INT or DATE
+  int column_index, column_offset{-1};
 
   std::function<bool(const char *)> cmp;
 
@@ -116,6 +135,22 @@ struct ColumnInSubqueryConstraint : public WhereConstraint {
   }
 };
 
+struct ColumnInListConstraint : public WhereConstraint {
+  std::set<int> vals_int;
+  std::set<double> vals_float;
+  std::set<std::string> vals_str;
+  /// reserved for BPlusTree, -1 unless the column is INT or DATE
+  int column_index, column_offset{-1};
+
+  std::function<bool(const char *)> cmp;
+
+  ColumnInListConstraint(std::shared_ptr<Field> field,
+                         std::vector<std::any> &&vals);
+  bool check(const uint8_t *record, const uint8_t *other) const override {
+    return cmp((char *)record);
+  }
+};
+
 struct SetVariable {
   std::function<void(char *)> set;
   SetVariable(std::shared_ptr<Field> field, std::any &&value);
@@ -125,14 +160,39 @@ class QueryPlanner {
 private:
   std::vector<std::shared_ptr<BlockIterator>> direct_iterators;
   std::shared_ptr<Iterator> iter{nullptr};
+  /// estimated rows of tables[i] after its filters, and of tables[0..i] joined
+  std::vector<double> table_rows, joined_rows;
+
+  /// reorder tables into the cheapest left-deep join order found, exhaustive
+  /// over subsets for a few tables and greedy beyond, and fill the estimates
+  void order_tables();
+
+  /// an `=` constraint between outer and a column of table leading one of its
+  /// indexes, with a lookup iterator on that index; nullptrs if there is none
+  std::pair<std::shared_ptr<ColumnOpColumnConstraint>,
+            std::shared_ptr<IndexIterator>>
+  make_lookup(std::shared_ptr<BlockIterator> outer,
+              std::shared_ptr<TableManager> table,
+              const std::vector<std::shared_ptr<Field>> &fullset);
+  /// an `=` constraint between two tables whose columns both lead an index,
+  /// with ascending scans of these indexes; nullptrs if there is none
+  std::tuple<std::shared_ptr<ColumnOpColumnConstraint>,
+             std::shared_ptr<IndexIterator>, std::shared_ptr<IndexIterator>>
+  make_merge(std::shared_ptr<TableManager> lhs,
+             std::shared_ptr<TableManager> rhs,
+             const std::vector<std::shared_ptr<Field>> &fullset);
 
 public:
   std::vector<std::shared_ptr<TableManager>> tables;
   std::shared_ptr<Selector> selector;
   std::vector<std::shared_ptr<WhereConstraint>> constraints;
-  std::shared_ptr<Field> group_by_field, order_by_field;
+  std::vector<std::shared_ptr<Field>> group_by;
+  bool distinct{false};
+  /// TABLESAMPLE of the single table, 100 for all of it
+  int sample_percent{100};
+  /// ORDER BY columns, each with whether it is DESC
+  std::vector<std::pair<std::shared_ptr<Field>, bool>> order_by;
   int req_offset{0}, req_limit{INT_MAX};
-  bool order_by_desc;
 
   void generate_plan();
   const uint8_t *get() const;
@@ -54,6 +54,8 @@ class RecordManager {
 private:
   friend class TableManager;
   friend class RecordIterator;
+  friend class VectorScanIterator;
+  friend class ParallelScanIterator;
 
   std::string filename;
   int fd;
@@ -77,6 +79,10 @@ public:
   RecordManager(SequentialAccessor &accessor);
 
   int get_fd() const noexcept { return fd; }
+  int get_record_num() const noexcept { return n_records; }
+  /// count the rows again from the page bitmaps, for tables whose metadata
+  /// predates an exact n_records
+  void recount();
   uint8_t *get_record_ref(int pageid, int slotid);
   std::pair<int, int> insert_record(const uint8_t *ptr);
   void erase_record(int pagenum, int slotnum);
@@ -15,6 +15,7 @@ void create_table(const std::string &s,
                   std::vector<std::shared_ptr<Field>> &&fields);
 void drop_table(const std::string &s);
 void describe_table(const std::string &s);
+void analyze_table(const std::string &s);
 void update_set_table(
     std::shared_ptr<TableManager> table,
     std::vector<SetVariable> &&set_variables,
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <engine/defs.h>
+#include <storage/defs.h>
+
+/// statistics of a column, gathered by ANALYZE TABLE
+struct ColumnStats {
+  DataType type;
+  /// distinct non-NULL values
+  double ndv{0};
+  double null_frac{0};
+  /// min, max and the histogram are kept for INT, FLOAT and DATE only
+  double min_val{0}, max_val{0};
+  /// equi-depth histogram: each pair of adjacent bounds encloses the same
+  /// share of the non-NULL values. the ends are the exact min and max, empty
+  /// when the column holds no value
+  std::vector<double> bounds;
+
+  bool numeric() const { return type != DataType::VARCHAR; }
+  /// share of the non-NULL values v with (v op value)
+  double fraction(Operator op, double value) const;
+  void serialize(SequentialAccessor &s) const;
+  void deserialize(SequentialAccessor &s);
+
+private:
+  /// share of the non-NULL values below value
+  double below(double value) const;
+};
+
+struct TableStats {
+  /// rows sampled for the histograms, NDV and the rest read every row
+  static int const SAMPLE_ROWS = 30000;
+  static int const HISTOGRAM_BUCKETS = 64;
+
+  /// rows when analyzed, and rows inserted or erased since
+  int n_rows{0};
+  int n_modified{0};
+  std::vector<ColumnStats> columns;
+
+  TableStats() = default;
+  /// scans the whole table
+  TableStats(const std::vector<std::shared_ptr<Field>> &fields,
+             std::shared_ptr<RecordManager> record_manager);
+  void serialize(SequentialAccessor &s) const;
+  void deserialize(SequentialAccessor &s);
+};
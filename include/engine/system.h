@@ -99,9 +99,20 @@ private:
   int record_len;
   std::shared_ptr<RecordManager> record_manager;
   std::unordered_map<key_hash_t, std::shared_ptr<IndexMeta>> index_manager;
+  /// from ANALYZE TABLE, nullptr until the table is first analyzed
+  std::shared_ptr<TableStats> stats;
 
   bool purged{false};
 
+  /// the narrowest index led by the INT or DATE field, nullptr if none
+  std::shared_ptr<IndexMeta> keyed_index(std::shared_ptr<Field> key_field,
+                                         int &offset) const;
+  /// serialize values into a record_len buffer, false on a type error
+  bool build_record(const std::vector<std::any> &values, uint8_t *ptr);
+  /// statistics of the column at offset, nullptr unless analyzed
+  const ColumnStats *column_stats(int offset);
+  void count_modified(int n);
+
 public:
   TableManager(const std::string &db_dir, const std::string &name,
                unified_id_t id);
@@ -141,21 +152,57 @@ public:
   }
   int get_record_len() const noexcept { return record_len; }
   int get_record_num() const;
+  unified_id_t get_table_id() const noexcept { return table_id; }
+
+  /// ANALYZE TABLE: gather the statistics of every column
+  void analyze();
+  /// nullptr unless analyzed
+  std::shared_ptr<const TableStats> get_stats() const { return stats; }
+  /// gather the statistics again once the share of rows changed since
+  /// passes Config::stats_refresh_fraction. called when a statement that
+  /// modifies the table is done, never while planning a query
+  void refresh_stats();
+
+  /// estimates for the planner, from the statistics when analyzed
+  /// distinct non-NULL values of the column at offset
+  double estimate_distinct(int offset);
+  /// fraction of the records passing the constraints that live in this table
+  double estimate_selectivity(
+      const std::vector<std::shared_ptr<WhereConstraint>> &cons);
+  /// whether make_keyed_iterator() can serve key_field
+  bool has_keyed_index(std::shared_ptr<Field> key_field) const;
 
   /// setters - records
   bool check_insert_validity(uint8_t *ptr);
   bool check_insert_validity_primary(uint8_t *ptr);
   bool check_insert_validity_unique(uint8_t *ptr);
   bool check_insert_validity_foreign(uint8_t *ptr);
+  /// index of the first of n records (record_len apart) that would fail
+  /// the checks when inserted one by one, n if none.
+  /// keys repeated within the batch count as duplicates, while a foreign
+  /// key into this very table may refer to an earlier record of the batch
+  int check_insert_validity(uint8_t *buf, int n);
   bool check_erase_validity(uint8_t *ptr);
   void insert_record(const std::vector<std::any> &values);
   void insert_record(uint8_t *ptr, bool enable_checking);
+  /// insert records up to the first invalid one, returns how many were
+  /// inserted. as with one INSERT per row, the records before the failing
+  /// one stay written. checks and index updates run in key order over the
+  /// batch
+  int insert_records(const std::vector<std::vector<std::any>> &values);
+  /// the same over n built records, record_len apart
+  int insert_records(uint8_t *buf, int n, bool enable_checking);
   void erase_record(int pn, int sn, bool enable_checking);
 
   /// setters - indexes
   void add_index(const std::vector<std::shared_ptr<Field>> &fields,
                  bool store_full_data, bool enable_unique_check);
+  /// a primary or unique key on the index must be detached beforehand,
+  /// so that the separators are widened once uniqueness is gone
   void drop_index(key_hash_t hash);
+  /// attach or detach the hash file of an index according to the explicit
+  /// indexes declared USING HASH on the same columns
+  void sync_hash(key_hash_t hash);
   void add_pk(std::shared_ptr<PrimaryKey> pk);
   void drop_pk();
   void add_fk(std::shared_ptr<ForeignKey> fk);
@@ -165,7 +212,38 @@ public:
   void add_unique(std::shared_ptr<UniqueKey> uk);
   void drop_unique(const std::string &uk_name);
 
+  /// a full scan is a VectorScanIterator when vectorized is set, and with
+  /// parallel set a ParallelScanIterator once the table has
+  /// PARALLEL_SCAN_MIN_PAGES. below 100, sample_percent makes it a full scan
+  /// of that share of the pages
   std::shared_ptr<BlockIterator>
   make_iterator(const std::vector<std::shared_ptr<WhereConstraint>> &cons,
-                const std::vector<std::shared_ptr<Field>> &fields_dst);
+                const std::vector<std::shared_ptr<Field>> &fields_dst,
+                bool vectorized = false, int sample_percent = 100,
+                bool parallel = false);
+  /// an index scan that yields the rows already ordered by order_field,
+  /// nullptr when no index can provide that order. ties come out as from
+  /// a SortIterator over a heap scan: in (pagenum, slotnum) order, reversed
+  /// when desc. unless limited (the query has a LIMIT), indexed predicates
+  /// on other columns are preferred
+  std::shared_ptr<IndexIterator> make_ordered_iterator(
+      const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+      const std::vector<std::shared_ptr<Field>> &fields_dst,
+      std::shared_ptr<Field> order_field, bool desc, bool limited);
+  /// an ascending index scan led by key_field, over the range that the
+  /// predicates on key_field allow. NULL keys are not skipped. merge joins read
+  /// it in order, and IndexJoinIterator rebinds it to each probed value.
+  /// nullptr when no index starts with key_field, or with defer_to_others
+  /// when an indexed predicate on another column would read fewer rows
+  std::shared_ptr<IndexIterator> make_keyed_iterator(
+      const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+      const std::vector<std::shared_ptr<Field>> &fields_dst,
+      std::shared_ptr<Field> key_field, bool defer_to_others = false);
+  /// COUNT(*), MIN and MAX answered from the row count and index endpoints,
+  /// nullptr unless every selector is one of them and the WHERE clause is a
+  /// range over the column that the index scans
+  std::shared_ptr<MetaAggregateIterator>
+  make_meta_aggregate(const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                      const std::vector<std::shared_ptr<Field>> &columns,
+                      const std::vector<Aggregator> &aggrs);
 };
\ No newline at end of file
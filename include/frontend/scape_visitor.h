@@ -13,6 +13,7 @@ class ScapeVisitor : public SQLBaseVisitor {
 private:
   std::shared_ptr<TableManager> insert_into_table;
   int n_entries_inserted;
+  std::vector<std::vector<std::any>> insert_rows;
   /// for UPDATE, DELETE, SELECT, help parse where clause
   /// used by set_clause, where_and_clause, selector
   std::vector<std::vector<std::shared_ptr<TableManager>>> tables_stack;
@@ -32,12 +33,16 @@ public:
 
   std::any visitShow_tables(SQLParser::Show_tablesContext *ctx) override;
 
+  std::any visitShow_indexes(SQLParser::Show_indexesContext *ctx) override;
+
   std::any visitCreate_table(SQLParser::Create_tableContext *ctx) override;
 
   std::any visitDrop_table(SQLParser::Drop_tableContext *ctx) override;
 
   std::any visitDescribe_table(SQLParser::Describe_tableContext *ctx) override;
 
+  std::any visitAnalyze_table(SQLParser::Analyze_tableContext *ctx) override;
+
   std::any visitLoad_table(SQLParser::Load_tableContext *ctx) override;
 
   std::any
@@ -56,6 +61,7 @@ public:
   std::any visitGroup_by(SQLParser::Group_byContext *ctx) override;
 
   std::any visitOrder_by(SQLParser::Order_byContext *ctx) override;
+  std::any visitOrder_item(SQLParser::Order_itemContext *ctx) override;
 
   std::any visitField_list(SQLParser::Field_listContext *ctx) override;
 
@@ -97,6 +103,8 @@ public:
   std::any visitWhere_operator_select(
       SQLParser::Where_operator_selectContext *ctx) override;
 
+  std::any visitWhere_in_list(SQLParser::Where_in_listContext *ctx) override;
+
   std::any
   visitWhere_in_select(SQLParser::Where_in_selectContext *ctx) override;
 
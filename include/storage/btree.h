@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <unordered_map>
@@ -49,12 +50,18 @@ struct BPlusNodeMeta {
 /// - corresponding record
 /// an internal node matches like [ key[i], key[i+1] ), data num = key num + 1
 /// a leaf node performs exact match, data num = key num
+/// for unique indexes the column prefix already identifies a record, so
+/// internal nodes keep only the first key_num - 2 INTs of each separator.
+/// a truncated separator compares as if padded with -inf, which may route
+/// a probe with a small (pagenum, slotnum) suffix one leaf too far right;
+/// le_match then steps back to the left sibling.
 class BPlusTree {
 private:
   std::string filename;
   int fd, pagenum_root;
   int n_pages{0}, ptr_available{-1};
   int key_num;      /// a composite key consists of key_num INTs
+  int ikey_num;     /// separator INTs kept in internal nodes
   int internal_max; /// key size + pagenum
   int leaf_max;     /// key size + record size + record(pagenum, slotnum)
   int const internal_data_len = sizeof(int);
@@ -64,15 +71,23 @@ private:
                           uint8_t *&data) const {
     meta = (BPlusNodeMeta *)slice;
     keys = (int *)(slice + sizeof(BPlusNodeMeta));
-    data = (uint8_t *)(keys + key_num * get_cap(meta->type));
+    data = (uint8_t *)(keys + key_width(meta->type) * get_cap(meta->type));
+  }
+  int compare_prefix(const int *a, const int *b, int width) const;
+  inline int compare_key(const int *a, const int *b) const {
+    return compare_prefix(a, b, key_num);
   }
-  int compare_key(const int *a, const int *b) const;
   /// find largest index i such that a[i] </<= key.
   /// find smallest index i such that a[i] >/>= key.
   /// return i if a[i] == key && op == EQ.
   /// use <= when querying internal nodes.
-  int bin_search(int *a, int len, const std::vector<int> &key,
-                 Operator op) const;
+  /// entries of an internal node are compared on their ikey_num INTs only.
+  int bin_search(const int *a, int len, const std::vector<int> &key,
+                 Operator op, NodeType type) const;
+  /// branchless variant of bin_search for the common narrow key widths
+  template <int K>
+  int bin_search_fixed(const int *a, int len, const int *key,
+                       Operator op) const;
   void leaf_insert(uint8_t *slice, const std::vector<int> &key,
                    const uint8_t *record);
   void leaf_split(int pagenum, uint8_t *slice, std::vector<int> &key_pushup,
@@ -82,35 +97,57 @@ private:
   void page_array_remove(NodeType type, int *keys, uint8_t *data, int size,
                          int pos);
   void internal_insert(uint8_t *slice, const std::vector<int> key, int val);
+  /// a rightmost node receiving a new last child keeps internal_max - 1
+  /// children instead of splitting evenly
   void internal_split(int pagenum, uint8_t *slice, std::vector<int> &key_pushup,
-                      int &val_pushup);
+                      int &val_pushup, bool rightmost);
   int alloc_page();
   void free_page(int page);
+  void set_left_sibling(int pagenum, int left);
 
 public:
-  BPlusTree(const std::string &filename, int key_num, int record_len);
+  BPlusTree(const std::string &filename, int key_num, int record_len,
+            bool truncate_separators = false);
   BPlusTree(SequentialAccessor &accessor);
 
   void prepare_from_slice(uint8_t *slice, BPlusNodeMeta *&meta, int *&keys,
                           uint8_t *&data, NodeType type) const {
     meta = (BPlusNodeMeta *)slice;
     keys = (int *)(slice + sizeof(BPlusNodeMeta));
-    data = (uint8_t *)(keys + key_num * get_cap(type));
+    data = (uint8_t *)(keys + key_width(type) * get_cap(type));
   }
 
   inline int get_fd() const { return fd; }
+  inline int key_width(NodeType type) const {
+    return type == INTERNAL ? ikey_num : key_num;
+  }
   inline int get_cap(NodeType type) const {
     return type == INTERNAL ? internal_max : leaf_max;
   }
   inline int get_record_len() { return leaf_data_len - 4; }
+  inline int get_page_num() const { return n_pages; }
 
   std::optional<BPlusQueryResult> eq_match(const std::vector<int> &key) const;
   BPlusQueryResult le_match(const std::vector<int> &key) const;
+  /// le_match for ascending keys, fn(i, result) is called in order.
+  /// the leaf of the previous answer is searched first, so runs of nearby
+  /// keys share one descent
+  void le_match_sorted(
+      const std::vector<std::vector<int>> &keys,
+      const std::function<void(size_t, const BPlusQueryResult &)> &fn) const;
   bool leaf_unique_check();
 
   void insert(const std::vector<int> &key, const uint8_t *record);
+  /// insert ascending keys, filling each leaf reached before descending again
+  void insert_sorted(const std::vector<std::vector<int>> &keys,
+                     const std::vector<const uint8_t *> &records);
   bool erase(const std::vector<int> &key);
 
+  inline bool separators_truncated() const { return ikey_num < key_num; }
+  /// rebuild the internal levels with full separators, required once the
+  /// column prefix may repeat
+  void widen_separators();
+
   void serialize(SequentialAccessor &accessor) const;
   void purge();
   void print() const;
@@ -16,4 +16,7 @@ struct BPlusNodeMeta;
 class BPlusTree;
 class BPlusForest;
 
+struct HashBucketMeta;
+class HashIndex;
+
 typedef std::pair<int, int> PageLocator;
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <storage/defs.h>
+#include <utils/config.h>
+
+struct HashBucketMeta {
+  int local_depth;
+  int size;
+  /// pagenum of the next page in this bucket's chain, -1 if none.
+  /// chains grow only when a split cannot separate the entries
+  int overflow;
+  int next_empty;
+
+  void reset(int depth) {
+    local_depth = depth;
+    size = 0;
+    overflow = next_empty = -1;
+  }
+};
+
+/// extendible hash file for equality lookups on composite INT keys.
+/// an entry is key_num INTs, the last two being the record location
+/// (pagenum, slotnum); only the leading key_num - 2 INTs are hashed, so
+/// entries sharing a key always live in the same bucket.
+/// the directory is small and kept in memory, it is persisted together
+/// with the rest of the table metadata.
+class HashIndex {
+private:
+  static int const MAX_DEPTH = 20;
+  std::string filename;
+  int fd;
+  int n_pages{0}, ptr_available{-1};
+  int key_num;    /// a composite key consists of key_num INTs
+  int bucket_max; /// entries per page
+  int global_depth{0};
+  std::vector<int> directory;
+
+  void prepare_from_slice(uint8_t *slice, HashBucketMeta *&meta,
+                          int *&entries) const {
+    meta = (HashBucketMeta *)slice;
+    entries = (int *)(slice + sizeof(HashBucketMeta));
+  }
+  uint64_t hash_key(const int *key) const;
+  inline int bucket_of(const int *key) const {
+    return directory[hash_key(key) & ((1ull << global_depth) - 1)];
+  }
+  inline bool key_eq(const int *a, const int *b) const {
+    for (int i = 0; i < key_num - 2; ++i) {
+      if (a[i] != b[i])
+        return false;
+    }
+    return true;
+  }
+  /// append to the first page with a free slot, growing the chain if needed
+  void chain_append(int head, const int *entry);
+  bool chain_full(int head) const;
+  bool splittable(int head) const;
+  void split(int head);
+  int alloc_page(int depth);
+  void free_page(int page);
+
+public:
+  HashIndex(const std::string &filename, int key_num);
+  HashIndex(SequentialAccessor &accessor);
+
+  inline int get_fd() const { return fd; }
+  inline int get_depth() const { return global_depth; }
+
+  /// whether any entry matches the leading key_num - 2 INTs of key
+  bool contains(const std::vector<int> &key) const;
+  std::vector<PageLocator> lookup(const std::vector<int> &key) const;
+
+  void insert(const std::vector<int> &key);
+  bool erase(const std::vector<int> &key);
+
+  void serialize(SequentialAccessor &accessor) const;
+  void purge();
+};
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -20,6 +22,10 @@ struct PageMeta {
   uint8_t *slice;
   PageLocator pos;
   bool dirty;
+  /// readers holding the page through pin(), it is not evicted meanwhile
+  int pins{0};
+  /// being read from its file outside the latch
+  bool loading{false};
   PageMeta() = default;
   PageMeta(int p, int n, uint8_t *s, PageLocator pos, bool d)
       : prev(p), next(n), slice(s), pos(pos), dirty(d) {}
@@ -35,6 +41,12 @@ private:
   std::vector<PageMeta> pages;
   int list_head, list_tail;
   std::unordered_map<PageLocator, int> pos2page;
+  /// guards the pages and their list, so that scan workers may read pages
+  /// while other threads do. pages are read from their files outside of
+  /// it, the write-back of a dirty page being replaced is done under it
+  std::mutex latch;
+  /// signalled when a page finishes loading
+  std::condition_variable loaded;
 
   PagedBuffer(const PagedBuffer &) = delete;
   PagedBuffer(int, int);
@@ -43,6 +55,9 @@ private:
   void list_append(int id);
   void access(int id);
   int get_replace();
+  /// the slot holding pos, loaded when absent. lock holds latch, released
+  /// while the page is read
+  int locate(PageLocator pos, bool dirty, std::unique_lock<std::mutex> &lock);
 
 public:
   ~PagedBuffer();
@@ -59,6 +74,11 @@ public:
   // mark as dirty from beginning
   uint8_t *read_file_rdwr(PageLocator pos);
   bool mark_dirty(uint8_t *ptr);
+  /// read a page and keep it in the pool until unpin(). the pointers from
+  /// read_file_rd() may be evicted by any later read, from any thread, so
+  /// code running beside other readers must pin the pages it works on
+  uint8_t *pin(PageLocator pos);
+  void unpin(uint8_t *ptr);
 };
 
 class SequentialAccessor {
@@ -2,4 +2,5 @@
 
 #include <storage/btree.h>
 #include <storage/file_mapping.h>
+#include <storage/hash_index.h>
 #include <storage/paged_buffer.h>
\ No newline at end of file
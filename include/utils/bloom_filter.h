@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// blocked bloom filter over composite INT keys.
+/// a key sets one bit in each word of a single 64-byte block, so a probe
+/// touches one cache line. there is no deletion, stale bits only raise the
+/// false positive rate until the owner rebuilds the filter.
+class BloomFilter {
+private:
+  static int const BLOCK_WORDS = 8;
+  static int const BITS_PER_KEY = 16;
+  std::vector<uint64_t> blocks;
+  size_t n_blocks, capacity, n_keys{0};
+
+  static uint64_t hash_key(const int *key, int len);
+
+public:
+  /// counters for SHOW INDEXES, maintained by the owner
+  uint64_t probes{0}, negatives{0}, false_positives{0};
+
+  BloomFilter(size_t capacity) { reset(capacity); }
+
+  /// clear all bits and resize for capacity keys, counters are kept
+  void reset(size_t capacity);
+  void insert(const int *key, int len);
+  bool may_contain(const int *key, int len) const;
+  /// more keys inserted than the filter was sized for
+  inline bool saturated() const { return n_keys > capacity; }
+  inline size_t get_capacity() const { return capacity; }
+  /// fraction of absent keys the filter failed to reject
+  inline double false_positive_rate() const {
+    uint64_t absent = negatives + false_positives;
+    return absent == 0 ? 0.0 : (double)false_positives / absent;
+  }
+};
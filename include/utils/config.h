@@ -1,7 +1,9 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include <argparse/argparse.hpp>
 
@@ -18,6 +20,9 @@ public:
   static int const PAGE_SIZE = 1 << 13;
   static int const POOLED_PAGES = PAGED_MEMORY / PAGE_SIZE;
   static uint32_t const SCAPE_SIGNATURE = 0x007a6a78;
+  /// leads the table metadata written since the row count is kept exact,
+  /// tables with SCAPE_SIGNATURE count their rows again when opened
+  static uint32_t const SCAPE_TABLE_SIGNATURE = 0x017a6a78;
 
   bool batch_mode{false};
   bool stdin_is_file{false};
@@ -29,6 +34,19 @@ public:
   std::string dbs_dir{""};
   std::string temp_file_dir{""};
   std::string temp_file_template{""};
+  /// share of a table's rows that may change before its statistics are
+  /// gathered again, 0 keeps them until the next ANALYZE TABLE
+  double stats_refresh_fraction{0.2};
+  /// full table scans hand column batches to filters and aggregates
+  bool vectorized_execution{true};
+  /// bytes a DISTINCT or GROUP BY hash table may hold before it spills to
+  /// temp files
+  size_t hash_memory{256 << 20};
+  /// threads that scan large tables in parallel, the caller included,
+  /// 1 scans on the calling thread alone
+  int scan_threads{(int)std::max(1u, std::thread::hardware_concurrency())};
+  /// seed of the TABLESAMPLE page choice, 0 draws a new one for each scan
+  uint64_t sample_seed{0};
 
   static std::shared_ptr<const Config> get() {
     if (instance == nullptr) {
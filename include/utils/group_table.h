@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// open-addressing hash table from fixed-width byte keys to fixed-width
+/// states. groups are numbered in insertion order and stored inline, each as
+/// its key followed by its state, in one array. the slots hold a tag of the
+/// hash and the group number and are probed linearly at most half full, so
+/// a lookup touches a slot or two and compares a key only on a tag match.
+/// keys are whole 64-bit words, hashed and compared a word at a time. the
+/// entries are padded to whole words too, so every state is 8-byte aligned
+class GroupTable {
+private:
+  struct Slot {
+    uint32_t tag;
+    int group;
+  };
+  int key_len, entry_len;
+  std::vector<uint8_t> entries;
+  std::vector<Slot> slots;
+  size_t mask;
+  int n_groups{0};
+
+  void grow();
+
+public:
+  static inline uint64_t word(const uint8_t *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+  }
+
+  static inline bool equal(const uint8_t *a, const uint8_t *b, int len) {
+    for (int i = 0; i < len; i += 8) {
+      if (word(a + i) != word(b + i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// a well mixed hash of a key of len bytes, without allocation
+  static inline uint64_t hash(const uint8_t *key, int len) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < len; i += 8) {
+      h = (h ^ word(key + i)) * 0xff51afd7ed558ccdull;
+      h ^= h >> 32;
+    }
+    return h;
+  }
+
+  /// @param key_len a multiple of 8, zero for a table of one group
+  /// @param state_len any length, the entries are rounded up to 8 bytes
+  GroupTable(int key_len, int state_len);
+
+  /// the group of key, appended with a zeroed state when new
+  inline int find_or_insert(const uint8_t *key, uint64_t h) {
+    uint32_t tag = h >> 32;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      Slot &slot = slots[i];
+      if (slot.group == -1) {
+        if ((size_t)(n_groups + 1) * 2 > slots.size()) {
+          grow();
+          return find_or_insert(key, h);
+        }
+        slot = {tag, n_groups};
+        entries.resize(entries.size() + entry_len, 0);
+        memcpy(entries.data() + (size_t)n_groups * entry_len, key, key_len);
+        return n_groups++;
+      }
+      if (slot.tag == tag &&
+          equal(entries.data() + (size_t)slot.group * entry_len, key,
+                key_len)) {
+        return slot.group;
+      }
+    }
+  }
+  inline int find_or_insert(const uint8_t *key) {
+    return find_or_insert(key, hash(key, key_len));
+  }
+  /// the group of key, -1 when absent
+  inline int find(const uint8_t *key, uint64_t h) const {
+    uint32_t tag = h >> 32;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      const Slot &slot = slots[i];
+      if (slot.group == -1) {
+        return -1;
+      }
+      if (slot.tag == tag &&
+          equal(entries.data() + (size_t)slot.group * entry_len, key,
+                key_len)) {
+        return slot.group;
+      }
+    }
+  }
+
+  inline int size() const { return n_groups; }
+  inline int get_entry_len() const { return entry_len; }
+  inline const uint8_t *key(int group) const {
+    return entries.data() + (size_t)group * entry_len;
+  }
+  /// valid until the next insertion
+  inline uint8_t *state(int group) {
+    return entries.data() + (size_t)group * entry_len + key_len;
+  }
+  inline const uint8_t *state(int group) const {
+    return entries.data() + (size_t)group * entry_len + key_len;
+  }
+  /// bytes held by the entries and the slots
+  inline size_t memory() const {
+    return entries.capacity() + slots.size() * sizeof(Slot);
+  }
+  /// drop every group and release their memory
+  void clear();
+};
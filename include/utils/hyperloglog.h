@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// HyperLogLog distinct counter over 64-bit hashes.
+/// 2^PRECISION one-byte registers keep the largest leading-zero run seen in
+/// their share of the hashes, the standard error is 1.04 / 2^(PRECISION/2),
+/// about 1.6%. sketches of the same column merge by register-wise maximum
+class HyperLogLog {
+public:
+  static int const PRECISION = 12;
+  static int const N_REGISTERS = 1 << PRECISION;
+
+private:
+  std::vector<uint8_t> registers;
+
+public:
+  HyperLogLog() : registers(N_REGISTERS, 0) {}
+
+  /// a well mixed hash of len bytes, for callers without one of their own
+  static uint64_t hash_bytes(const void *data, size_t len);
+
+  void insert(uint64_t hash);
+  void merge(const HyperLogLog &other);
+  double estimate() const;
+  void clear() { registers.assign(N_REGISTERS, 0); }
+
+  const std::vector<uint8_t> &get_registers() const { return registers; }
+  std::vector<uint8_t> &get_registers() { return registers; }
+};
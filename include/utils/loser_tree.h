@@ -0,0 +1,58 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+/// tournament tree for a k-way merge. each internal node keeps the loser of
+/// the match played there, so replacing the winner replays a single path
+/// from its leaf: log2(k) comparisons, against one k-1 for a linear scan.
+/// sources are numbered 0..k-1, less(a, b) compares their current heads
+template <typename Less> class LoserTree {
+private:
+  int k;
+  /// tree[0] is the winner, tree[1..k-1] the losers, leaves sit at k + i
+  std::vector<int> tree;
+  std::vector<bool> done;
+  Less less;
+
+  /// whether a wins against b, sources that ran out lose every match
+  bool beats(int a, int b) const {
+    if (done[a] || done[b]) {
+      return done[b] && !done[a];
+    }
+    return less(a, b);
+  }
+
+public:
+  /// every source must have a head
+  LoserTree(int k, Less less) : k(k), tree(k), done(k, false), less(less) {
+    std::vector<int> winner(2 * k);
+    for (int i = 0; i < k; ++i) {
+      winner[k + i] = i;
+    }
+    for (int node = k - 1; node >= 1; --node) {
+      int a = winner[2 * node], b = winner[2 * node + 1];
+      if (!beats(a, b)) {
+        std::swap(a, b);
+      }
+      winner[node] = a;
+      tree[node] = b;
+    }
+    tree[0] = winner[1];
+  }
+
+  /// the source with the least head, -1 once all ran out
+  int top() const { return done[tree[0]] ? -1 : tree[0]; }
+
+  /// the head of top() moved on, or that source ran out
+  void replay(bool exhausted) {
+    int s = tree[0];
+    done[s] = exhausted;
+    for (int node = (s + k) / 2; node >= 1; node /= 2) {
+      if (beats(tree[node], s)) {
+        std::swap(tree[node], s);
+      }
+    }
+    tree[0] = s;
+  }
+};
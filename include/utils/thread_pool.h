@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// a fixed set of worker threads for parallel loops. run() hands the tasks
+/// out one at a time to the workers and to the calling thread, which counts
+/// as worker 0, and returns once all of them are done. a run is not
+/// reentrant: tasks must not call run() themselves
+class ThreadPool {
+private:
+  static std::shared_ptr<ThreadPool> instance;
+  std::vector<std::thread> threads;
+  std::mutex latch;
+  std::condition_variable wake, done;
+  /// the loop being run, bumped generation tells the workers a new one
+  const std::function<void(int, int)> *task{nullptr};
+  int n_tasks{0}, next_task{0}, running{0};
+  uint64_t generation{0};
+  bool stopping{false};
+
+  ThreadPool(int n_workers);
+  ThreadPool(const ThreadPool &) = delete;
+  void work(int worker);
+  /// claim and run tasks of the current loop until none is left
+  void drain(int worker, std::unique_lock<std::mutex> &lock);
+
+public:
+  ~ThreadPool();
+  /// Config::scan_threads workers, the caller included
+  static std::shared_ptr<ThreadPool> get();
+
+  int size() const { return threads.size() + 1; }
+  /// fn(worker, task) for every task in [0, n), worker in [0, size())
+  void run(int n, const std::function<void(int, int)> &fn);
+};
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstring>
+
+#include <engine/batch.h>
+#include <engine/field.h>
+#include <engine/predicate.h>
+
+void ColumnBatch::init(const std::vector<std::shared_ptr<Field>> &fields) {
+  columns.resize(fields.size());
+  for (size_t i = 0; i < fields.size(); ++i) {
+    auto &col = columns[i];
+    col.type = fields[i]->datatype->type;
+    col.width = fields[i]->get_size();
+    col.index = fields[i]->pers_index;
+    col.offset = fields[i]->pers_offset;
+    col.data.assign((size_t)col.width * BATCH_SIZE, 0);
+  }
+  clear();
+}
+
+/// copy a column out of n records, the width known at compile time for
+/// the fixed-size types
+template <int W>
+static void gather(uint8_t *dst, const uint8_t *src, int record_len,
+                   const int *slots, int n, int width) {
+  for (int j = 0; j < n; ++j) {
+    memcpy(dst + j * (W ? W : width), src + slots[j] * record_len,
+           W ? W : width);
+  }
+}
+
+void ColumnBatch::decode(const uint8_t *base, int record_len, int pagenum,
+                         const int *slots, int n) {
+  bitmap_t bitmaps[BATCH_SIZE];
+  for (int j = 0; j < n; ++j) {
+    bitmaps[j] = *(const bitmap_t *)(base + slots[j] * record_len);
+    locators[n_rows + j] = PageLocator(pagenum, slots[j]);
+    sel[n_rows + j] = n_rows + j;
+  }
+  for (auto &col : columns) {
+    for (int j = 0; j < n; ++j) {
+      col.nulls[n_rows + j] = !((bitmaps[j] >> col.index) & 1);
+    }
+    uint8_t *dst = col.data.data() + n_rows * col.width;
+    const uint8_t *src = base + col.offset;
+    switch (col.width) {
+    case 4:
+      gather<4>(dst, src, record_len, slots, n, 4);
+      break;
+    case 8:
+      gather<8>(dst, src, record_len, slots, n, 8);
+      break;
+    default:
+      gather<0>(dst, src, record_len, slots, n, col.width);
+    }
+  }
+  n_rows += n;
+  n_sel = n_rows;
+}
+
+template <Operator op, typename T>
+static int filter_compare(const ColumnBatch::Column &col, uint16_t *sel,
+                          int n_sel, T value) {
+  const T *vals = col.values<T>();
+  int n = 0;
+  for (int k = 0; k < n_sel; ++k) {
+    int r = sel[k];
+    sel[n] = r;
+    n += !col.nulls[r] & compare_op<op>(vals[r], value);
+  }
+  return n;
+}
+
+template <typename T>
+static int filter_compare(const ColumnBatch::Column &col, uint16_t *sel,
+                          int n_sel, Operator op, T value) {
+  switch (op) {
+  case Operator::EQ:
+    return filter_compare<Operator::EQ>(col, sel, n_sel, value);
+  case Operator::LT:
+    return filter_compare<Operator::LT>(col, sel, n_sel, value);
+  case Operator::LE:
+    return filter_compare<Operator::LE>(col, sel, n_sel, value);
+  case Operator::GT:
+    return filter_compare<Operator::GT>(col, sel, n_sel, value);
+  case Operator::GE:
+    return filter_compare<Operator::GE>(col, sel, n_sel, value);
+  case Operator::NE:
+    return filter_compare<Operator::NE>(col, sel, n_sel, value);
+  }
+  return n_sel;
+}
+
+void BatchPredicate::filter(ColumnBatch &batch) const {
+  const auto &col = batch.columns[column];
+  uint16_t *sel = batch.sel;
+  int n_sel = batch.n_sel, n = 0;
+  switch (kind) {
+  case Kind::COMPARE:
+    n = col.type == DataType::FLOAT
+            ? filter_compare<double>(col, sel, n_sel, op, value_float)
+            : filter_compare<int>(col, sel, n_sel, op, value_int);
+    break;
+  case Kind::IS_NULL:
+  case Kind::NOT_NULL: {
+    uint8_t want = kind == Kind::IS_NULL;
+    for (int k = 0; k < n_sel; ++k) {
+      int r = sel[k];
+      sel[n] = r;
+      n += col.nulls[r] == want;
+    }
+    break;
+  }
+  case Kind::IN_LIST: {
+    const int *ints = col.values<int>();
+    for (int k = 0; k < n_sel; ++k) {
+      int r = sel[k];
+      sel[n] = r;
+      n += !col.nulls[r] &&
+           std::binary_search(vals.begin(), vals.end(), ints[r]);
+    }
+    break;
+  }
+  }
+  batch.n_sel = n;
+}
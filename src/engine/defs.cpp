@@ -2,7 +2,8 @@
 
 #include <engine/defs.h>
 
-bool has_err = false;
+std::atomic<bool> has_err = false;
+uint64_t spilled_bytes = 0;
 
 unified_id_t get_unified_id() {
   static unified_id_t id = 0;
@@ -56,6 +57,8 @@ Aggregator str2aggr(const std::string &str) {
     return MIN;
   } else if (str == "SUM") {
     return SUM;
+  } else if (str == "APPROX_COUNT_DISTINCT") {
+    return APPROX_COUNT_DISTINCT;
   } else {
     throw std::runtime_error("unknown aggregator");
   }
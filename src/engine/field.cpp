@@ -377,6 +377,7 @@ void ExplicitIndexKey::serialize(SequentialAccessor &s) const {
   for (auto &str : field_names) {
     s.write_str(str);
   }
+  s.write_byte(use_hash);
 }
 
 void ExplicitIndexKey::deserialize(SequentialAccessor &s) {
@@ -386,6 +387,7 @@ void ExplicitIndexKey::deserialize(SequentialAccessor &s) {
   for (uint32_t i = 0; i < sz; ++i) {
     field_names.push_back(s.read_str());
   }
+  use_hash = s.read_byte();
 }
 
 void ExplicitIndexKey::build(const TableManager *table) {
@@ -1,6 +1,9 @@
+#include <algorithm>
+
 #include <engine/field.h>
 #include <engine/index.h>
 #include <storage/storage.h>
+#include <utils/bloom_filter.h>
 
 key_hash_t keysHash(const std::vector<std::shared_ptr<Field>> &fields) {
   key_hash_t ret = 0;
@@ -19,6 +22,9 @@ IndexMeta::IndexMeta(SequentialAccessor &s) {
   store_full_data = s.read_byte();
   refcount = s.read<uint32_t>();
   tree = std::make_shared<BPlusTree>(s);
+  if (s.read_byte()) {
+    hash = std::make_shared<HashIndex>(s);
+  }
 }
 
 IndexMeta::IndexMeta(const std::vector<std::shared_ptr<Field>> &keys,
@@ -31,8 +37,11 @@ IndexMeta::IndexMeta(const std::vector<std::shared_ptr<Field>> &keys,
 
 std::shared_ptr<IndexMeta>
 IndexMeta::remap(const std::vector<std::shared_ptr<Field>> &keys_) const {
-  return std::shared_ptr<IndexMeta>(
+  auto ret = std::shared_ptr<IndexMeta>(
       new IndexMeta(keys_, store_full_data, tree));
+  ret->hash = hash;
+  ret->bloom = bloom;
+  return ret;
 }
 
 void IndexMeta::serialize(SequentialAccessor &s) const {
@@ -43,6 +52,10 @@ void IndexMeta::serialize(SequentialAccessor &s) const {
   s.write_byte(store_full_data);
   s.write<uint32_t>(refcount);
   tree->serialize(s);
+  s.write_byte(hash != nullptr);
+  if (hash != nullptr) {
+    hash->serialize(s);
+  }
 }
 
 BPlusQueryResult IndexMeta::le_match(KeyCollection data) {
@@ -59,8 +72,292 @@ std::vector<int> IndexMeta::extractKeys(const KeyCollection &data) {
   return key;
 }
 
+std::vector<PageLocator> IndexMeta::collect_rids(int lbound,
+                                                 int rbound) const {
+  int num_keys = key_offset.size();
+  int key_num = num_keys + 2;
+  std::vector<int> key(key_num, INT_MIN);
+  key[0] = lbound;
+  auto pos = tree->le_match(key);
+  int pagenum = pos.pagenum, slotnum = pos.slotnum;
+  std::vector<PageLocator> ret;
+  BPlusNodeMeta *meta;
+  int *keys;
+  uint8_t *data;
+  int fd = tree->get_fd();
+  while (pagenum != -1) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    tree->prepare_from_slice(slice, meta, keys, data, NodeType::LEAF);
+    for (++slotnum; slotnum < meta->size; ++slotnum) {
+      int *entry = keys + slotnum * key_num;
+      /// the trailing INT_MAX sentinel always terminates the scan
+      if (entry[0] >= rbound) {
+        std::sort(ret.begin(), ret.end());
+        return ret;
+      }
+      ret.emplace_back(entry[num_keys], entry[num_keys + 1]);
+    }
+    pagenum = meta->right_sibling;
+    slotnum = -1;
+  }
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+std::vector<PageLocator> IndexMeta::point_rids(int val) const {
+  if (hash == nullptr || key_offset.size() != 1) {
+    return collect_rids(val, val + 1);
+  }
+  auto ret = hash->lookup({val, 0, 0});
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+void IndexMeta::for_each_entry(const std::function<void(int *)> &fn) const {
+  int key_num = key_offset.size() + 2;
+  std::vector<int> key(key_num, INT_MIN);
+  auto pos = tree->le_match(key);
+  int pagenum = pos.pagenum, slotnum = pos.slotnum;
+  BPlusNodeMeta *meta;
+  int *keys;
+  uint8_t *data;
+  int fd = tree->get_fd();
+  while (pagenum != -1) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    tree->prepare_from_slice(slice, meta, keys, data, NodeType::LEAF);
+    for (++slotnum; slotnum < meta->size; ++slotnum) {
+      int *entry = keys + slotnum * key_num;
+      if (entry[key_num - 1] == INT_MAX) {
+        return;
+      }
+      fn(entry);
+    }
+    pagenum = meta->right_sibling;
+    slotnum = -1;
+  }
+}
+
+void IndexMeta::scan_range(
+    int lbound, int rbound, bool reverse,
+    const std::function<bool(int *, const uint8_t *)> &fn) const {
+  int key_num = key_offset.size() + 2;
+  int leaf_data_len = tree->get_record_len() + 4;
+  std::vector<int> key(key_num, INT_MIN);
+  key[0] = reverse ? rbound : lbound;
+  auto pos = tree->le_match(key);
+  int pagenum = pos.pagenum, slotnum = pos.slotnum;
+  BPlusNodeMeta *meta;
+  int *keys;
+  uint8_t *data;
+  int fd = tree->get_fd();
+  /// the INT_MIN and INT_MAX sentinels always terminate the scan
+  while (pagenum != -1) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    tree->prepare_from_slice(slice, meta, keys, data, NodeType::LEAF);
+    if (reverse) {
+      if (slotnum == INT_MAX) {
+        slotnum = meta->size - 1;
+      }
+      for (; slotnum >= 0; --slotnum) {
+        int *entry = keys + slotnum * key_num;
+        if (entry[0] < lbound ||
+            !fn(entry, data + slotnum * leaf_data_len)) {
+          return;
+        }
+      }
+      pagenum = meta->left_sibling;
+      slotnum = INT_MAX;
+    } else {
+      for (++slotnum; slotnum < meta->size; ++slotnum) {
+        int *entry = keys + slotnum * key_num;
+        if (entry[0] >= rbound ||
+            !fn(entry, data + slotnum * leaf_data_len)) {
+          return;
+        }
+      }
+      pagenum = meta->right_sibling;
+      slotnum = -1;
+    }
+  }
+}
+
+void IndexMeta::build_hash(const std::string &filename) {
+  int key_num = key_offset.size() + 2;
+  hash = std::make_shared<HashIndex>(filename, key_num);
+  std::vector<int> key(key_num);
+  for_each_entry([&](int *entry) {
+    key.assign(entry, entry + key_num);
+    hash->insert(key);
+  });
+}
+
+void IndexMeta::build_bloom() {
+  int num_keys = key_offset.size();
+  std::vector<int> prefixes;
+  for_each_entry([&](int *entry) {
+    prefixes.insert(prefixes.end(), entry, entry + num_keys);
+  });
+  size_t n = prefixes.size() / num_keys;
+  /// leave room to grow before the next rebuild
+  if (bloom == nullptr) {
+    bloom = std::make_shared<BloomFilter>(n * 2);
+  } else {
+    bloom->reset(n * 2);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    bloom->insert(prefixes.data() + i * num_keys, num_keys);
+  }
+}
+
+void IndexMeta::drop_hash() {
+  if (hash != nullptr) {
+    hash->purge();
+    hash = nullptr;
+  }
+}
+
 void IndexMeta::insert_record(KeyCollection data) {
-  tree->insert(extractKeys(data), data.ptr);
+  auto key = extractKeys(data);
+  tree->insert(key, data.ptr);
+  if (hash != nullptr) {
+    hash->insert(key);
+  }
+  if (bloom != nullptr) {
+    bloom->insert(key.data(), key_offset.size());
+    if (bloom->saturated()) {
+      build_bloom();
+    }
+  }
+}
+
+void IndexMeta::insert_records(const std::vector<KeyCollection> &data) {
+  std::vector<std::vector<int>> keys;
+  keys.reserve(data.size());
+  for (const auto &it : data) {
+    keys.push_back(extractKeys(it));
+  }
+  std::vector<int> order(data.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&](int a, int b) { return keys[a] < keys[b]; });
+  std::vector<std::vector<int>> sorted_keys;
+  std::vector<const uint8_t *> records;
+  sorted_keys.reserve(order.size());
+  records.reserve(order.size());
+  for (auto i : order) {
+    sorted_keys.push_back(keys[i]);
+    records.push_back(data[i].ptr);
+  }
+  tree->insert_sorted(sorted_keys, records);
+  for (const auto &key : sorted_keys) {
+    if (hash != nullptr) {
+      hash->insert(key);
+    }
+    if (bloom != nullptr) {
+      bloom->insert(key.data(), key_offset.size());
+    }
+  }
+  if (bloom != nullptr && bloom->saturated()) {
+    build_bloom();
+  }
+}
+
+bool IndexMeta::erase_record(KeyCollection data) {
+  auto key = extractKeys(data);
+  if (hash != nullptr) {
+    hash->erase(key);
+  }
+  return tree->erase(key);
+}
+
+bool IndexMeta::contains(uint8_t *ptr) {
+  auto key = extractKeys(KeyCollection(INT_MAX, INT_MAX, ptr));
+  if (bloom != nullptr) {
+    ++bloom->probes;
+    if (!bloom->may_contain(key.data(), key_offset.size())) {
+      ++bloom->negatives;
+      return false;
+    }
+  }
+  bool found;
+  if (hash != nullptr) {
+    found = hash->contains(key);
+  } else {
+    auto ret = tree->le_match(key);
+    found = approx_eq(ret.keyptr, key.data());
+  }
+  if (bloom != nullptr && !found) {
+    ++bloom->false_positives;
+  }
+  return found;
+}
+
+std::vector<bool> IndexMeta::contains_batch(uint8_t *buf, int n,
+                                            int record_len) {
+  std::vector<bool> ret(n, false);
+  /// (key, record) pairs that got past the bloom filter
+  std::vector<std::pair<std::vector<int>, int>> probes;
+  for (int i = 0; i < n; ++i) {
+    auto key =
+        extractKeys(KeyCollection(INT_MAX, INT_MAX, buf + i * record_len));
+    if (bloom != nullptr) {
+      ++bloom->probes;
+      if (!bloom->may_contain(key.data(), key_offset.size())) {
+        ++bloom->negatives;
+        continue;
+      }
+    }
+    probes.emplace_back(std::move(key), i);
+  }
+  if (hash != nullptr) {
+    for (const auto &[key, i] : probes) {
+      ret[i] = hash->contains(key);
+    }
+  } else {
+    std::sort(probes.begin(), probes.end());
+    std::vector<std::vector<int>> keys;
+    keys.reserve(probes.size());
+    for (const auto &it : probes) {
+      keys.push_back(it.first);
+    }
+    tree->le_match_sorted(keys, [&](size_t j, const BPlusQueryResult &res) {
+      ret[probes[j].second] = approx_eq(res.keyptr, keys[j].data());
+    });
+  }
+  if (bloom != nullptr) {
+    for (const auto &it : probes) {
+      bloom->false_positives += !ret[it.second];
+    }
+  }
+  return ret;
+}
+
+void IndexMeta::add_refcounts(uint8_t *buf, int n, int record_len) {
+  std::vector<std::vector<int>> keys;
+  keys.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    keys.push_back(
+        extractKeys(KeyCollection(INT_MAX, INT_MAX, buf + i * record_len)));
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<std::vector<int>> distinct;
+  std::vector<uint32_t> counts;
+  for (auto &key : keys) {
+    if (distinct.empty() || distinct.back() != key) {
+      distinct.push_back(std::move(key));
+      counts.push_back(0);
+    }
+    ++counts.back();
+  }
+  tree->le_match_sorted(distinct, [&](size_t j, const BPlusQueryResult &res) {
+    PagedBuffer::get()->mark_dirty(res.dataptr);
+    *(uint32_t *)(res.dataptr + tree->get_record_len()) += counts[j];
+  });
 }
 
 uint32_t *IndexMeta::get_refcount(uint8_t *ptr) {
@@ -1,4 +1,9 @@
+#include <bit>
+#include <cmath>
+#include <cstring>
 #include <set>
+#include <string_view>
+#include <tuple>
 
 #include <engine/field.h>
 #include <engine/iterator.h>
@@ -6,6 +11,7 @@
 #include <engine/record.h>
 #include <storage/storage.h>
 #include <utils/config.h>
+#include <utils/thread_pool.h>
 
 const uint8_t *BlockIterator::get() const {
   uint8_t *current_dst_page = PagedBuffer::get()->read_file_rd(
@@ -56,6 +62,8 @@ RecordIterator::RecordIterator(
     }
   }
 
+  filter = Conjunction(constraints, fields_src);
+
   record_len = sizeof(bitmap_t);
   for (auto field : fields_src_) {
     if (field_ids_dst.contains(field->field_id)) {
@@ -66,6 +74,18 @@ RecordIterator::RecordIterator(
   record_per_page = Config::PAGE_SIZE / record_len;
 }
 
+RecordIterator::RecordIterator(
+    std::shared_ptr<RecordManager> rec_,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
+    const std::vector<std::shared_ptr<Field>> &fields_src_,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_,
+    std::vector<PageLocator> &&rids_)
+    : RecordIterator(rec_, cons_, fields_src_, fields_dst_) {
+  rid_mode = true;
+  rids = std::move(rids_);
+  rid_iter = 0;
+}
+
 RecordIterator::~RecordIterator() {
   FileMapping::get()->close_temp_file(fd_dst);
 }
@@ -73,9 +93,21 @@ RecordIterator::~RecordIterator() {
 bool RecordIterator::get_next_valid_no_check() {
   if (source_ended)
     return false;
+  if (rid_mode) {
+    if (rid_iter == rids.size()) {
+      source_ended = true;
+      return false;
+    }
+    std::tie(pagenum_src, slotnum_src) = rids[rid_iter++];
+    return true;
+  }
   if (it == valid_records.end()) {
     pagenum_src++;
     while (pagenum_src < record_manager->n_pages) {
+      if (!page_sampled(pagenum_src)) {
+        pagenum_src++;
+        continue;
+      }
       uint8_t *current_src_page =
           PagedBuffer::get()->read_file_rd(std::make_pair(fd_src, pagenum_src));
       FixedBitmap bits(record_manager->headmask_size,
@@ -101,21 +133,12 @@ bool RecordIterator::get_next_valid_no_check() {
 bool RecordIterator::get_next_valid() {
   if (source_ended)
     return false;
-  bool match = false;
   do {
     if (!get_next_valid_no_check()) {
       return false;
     }
-    uint8_t *ptr_src = record_manager->get_record_ref(pagenum_src, slotnum_src);
-    match = true;
-    for (auto constraint : constraints) {
-      /// send two ptr_src for ColumnOpColumnConstraint
-      if (!constraint->check(ptr_src, ptr_src)) {
-        match = false;
-        break;
-      }
-    }
-  } while (!match);
+  } while (!filter.check(
+      record_manager->get_record_ref(pagenum_src, slotnum_src)));
   return true;
 }
 
@@ -131,36 +154,40 @@ int RecordIterator::fill_next_block() {
     }
     const uint8_t *ptr_src =
         record_manager->get_record_ref(pagenum_src, slotnum_src);
-    bitmap_t src_bitmap = *(const bitmap_t *)ptr_src;
 
     int dst_slot = i % record_per_page;
     /// A bug was fixed here, always read before buffering
     uint8_t *current_dst_page = PagedBuffer::get()->read_file_rdwr(
         std::make_pair(fd_dst, i / record_per_page));
-    auto ptr_dst = current_dst_page + dst_slot * record_len;
-    int offset_dst = sizeof(bitmap_t);
-    bitmap_t dst_bitmap = 0;
-    for (size_t j = 0; j < fields_dst.size(); ++j) {
-      int index = fields_dst[j]->pers_index;
-      int length = fields_dst[j]->get_size();
-      if ((src_bitmap >> index) & 1) {
-        dst_bitmap |= 1 << j;
-        memcpy(ptr_dst + offset_dst, ptr_src + fields_dst[j]->pers_offset,
-               length);
-      }
-      offset_dst += length;
-    }
-    *(bitmap_t *)ptr_dst = dst_bitmap;
+    project(ptr_src, current_dst_page + dst_slot * record_len);
     n_records = i + 1;
   }
   return n_records;
 }
 
+void RecordIterator::project(const uint8_t *ptr_src, uint8_t *ptr_dst) const {
+  bitmap_t src_bitmap = *(const bitmap_t *)ptr_src;
+  int offset_dst = sizeof(bitmap_t);
+  bitmap_t dst_bitmap = 0;
+  for (size_t j = 0; j < fields_dst.size(); ++j) {
+    int index = fields_dst[j]->pers_index;
+    int length = fields_dst[j]->get_size();
+    if ((src_bitmap >> index) & 1) {
+      dst_bitmap |= 1 << j;
+      memcpy(ptr_dst + offset_dst, ptr_src + fields_dst[j]->pers_offset,
+             length);
+    }
+    offset_dst += length;
+  }
+  *(bitmap_t *)ptr_dst = dst_bitmap;
+}
+
 void RecordIterator::reset_all() {
   pagenum_src = -1;
   slotnum_src = 0;
   valid_records.clear();
   it = valid_records.begin();
+  rid_iter = 0;
   dst_iter = n_records = 0;
   source_ended = false;
 }
@@ -169,12 +196,300 @@ std::pair<int, int> RecordIterator::get_locator() {
   return std::make_pair(pagenum_src, slotnum_src);
 }
 
+void RecordIterator::set_sample(int percent, uint64_t seed) {
+  sample_percent = percent;
+  sample_seed = seed;
+}
+
+bool RecordIterator::page_sampled(int pagenum) const {
+  if (sample_percent >= 100) {
+    return true;
+  }
+  /// splitmix64 of the page number
+  uint64_t h = sample_seed + (uint64_t)pagenum * 0x9e3779b97f4a7c15ull;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return (int)(h % 100) < sample_percent;
+}
+
+VectorScanIterator::VectorScanIterator(
+    std::shared_ptr<RecordManager> rec_,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
+    const std::vector<std::shared_ptr<Field>> &fields_src_,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_)
+    : RecordIterator(rec_, cons_, fields_src_, fields_dst_) {
+  /// fields_dst are decoded first, then the columns only the kernels read
+  std::vector<std::shared_ptr<Field>> decoded = fields_dst;
+  auto column_of = [&](int offset) {
+    for (size_t i = 0; i < decoded.size(); ++i) {
+      if (decoded[i]->pers_offset == offset) {
+        return (int)i;
+      }
+    }
+    for (auto field : fields_src) {
+      if (field->pers_offset == offset) {
+        decoded.push_back(field);
+      }
+    }
+    return (int)decoded.size() - 1;
+  };
+  std::vector<std::shared_ptr<WhereConstraint>> unbatched;
+  for (auto con : constraints) {
+    BatchPredicate pred;
+    auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con);
+    auto cnc = std::dynamic_pointer_cast<ColumnNullConstraint>(con);
+    auto cil = std::dynamic_pointer_cast<ColumnInListConstraint>(con);
+    if (cov != nullptr && cov->dtype != DataType::VARCHAR) {
+      pred.kind = BatchPredicate::COMPARE;
+      pred.column = column_of(cov->column_offset);
+      pred.op = cov->cmp_op;
+      pred.value_int = cov->value;
+      pred.value_float = cov->value_float;
+    } else if (cnc != nullptr) {
+      pred.kind =
+          cnc->not_null ? BatchPredicate::NOT_NULL : BatchPredicate::IS_NULL;
+      pred.column = column_of(cnc->column_offset);
+    } else if (cil != nullptr && cil->column_offset != -1) {
+      pred.kind = BatchPredicate::IN_LIST;
+      pred.column = column_of(cil->column_offset);
+      pred.vals.assign(cil->vals_int.begin(), cil->vals_int.end());
+    } else {
+      unbatched.push_back(con);
+      continue;
+    }
+    predicates.push_back(std::move(pred));
+  }
+  residual = Conjunction(unbatched, fields_src);
+  batch.init(decoded);
+}
+
+ColumnBatch *VectorScanIterator::next_batch() {
+  batch_pos = 0;
+  while (true) {
+    batch.clear();
+    while (batch.n_rows < ColumnBatch::BATCH_SIZE) {
+      if (slot_pos == slots.size()) {
+        if (scan_page + 1 >= record_manager->n_pages) {
+          break;
+        }
+        if (!page_sampled(++scan_page)) {
+          continue;
+        }
+        uint8_t *page = PagedBuffer::get()->read_file_rd(
+            std::make_pair(fd_src, scan_page));
+        FixedBitmap bits(record_manager->headmask_size,
+                         (uint64_t *)(page + BITMAP_START_OFFSET));
+        slots = bits.get_valid_indices();
+        slot_pos = 0;
+        continue;
+      }
+      /// the rest of a page that does not fit goes to the next batch
+      int n = std::min<int>(slots.size() - slot_pos,
+                            ColumnBatch::BATCH_SIZE - batch.n_rows);
+      const uint8_t *page = PagedBuffer::get()->read_file_rd(
+          std::make_pair(fd_src, scan_page));
+      batch.decode(page + record_manager->header_len,
+                   record_manager->record_len, scan_page,
+                   slots.data() + slot_pos, n);
+      slot_pos += n;
+    }
+    if (batch.n_rows == 0) {
+      return nullptr;
+    }
+    for (const auto &pred : predicates) {
+      pred.filter(batch);
+    }
+    if (!residual.trivial()) {
+      int n = 0;
+      for (int k = 0; k < batch.n_sel; ++k) {
+        int r = batch.sel[k];
+        auto [pn, sn] = batch.locators[r];
+        batch.sel[n] = r;
+        n += residual.check(record_manager->get_record_ref(pn, sn));
+      }
+      batch.n_sel = n;
+    }
+    if (batch.n_sel > 0) {
+      return &batch;
+    }
+  }
+}
+
+bool VectorScanIterator::get_next_valid() {
+  if (source_ended) {
+    return false;
+  }
+  if (batch_pos == batch.n_sel && next_batch() == nullptr) {
+    source_ended = true;
+    return false;
+  }
+  std::tie(pagenum_src, slotnum_src) = batch.locators[batch.sel[batch_pos++]];
+  return true;
+}
+
+void VectorScanIterator::reset_all() {
+  RecordIterator::reset_all();
+  scan_page = -1;
+  slots.clear();
+  slot_pos = 0;
+  batch.clear();
+  batch_pos = 0;
+}
+
+ParallelScanIterator::ParallelScanIterator(
+    std::shared_ptr<RecordManager> rec_,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
+    const std::vector<std::shared_ptr<Field>> &fields_src_,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_)
+    : RecordIterator(rec_, cons_, fields_src_, fields_dst_) {}
+
+int ParallelScanIterator::n_morsels() const {
+  return (record_manager->n_pages + MORSEL_PAGES - 1) / MORSEL_PAGES;
+}
+
+void ParallelScanIterator::scan_morsel(int m, std::vector<uint8_t> &out) const {
+  auto buffer = PagedBuffer::get();
+  int first = m * MORSEL_PAGES;
+  int last = std::min(first + MORSEL_PAGES, record_manager->n_pages);
+  for (int p = first; p < last; ++p) {
+    if (!page_sampled(p)) {
+      continue;
+    }
+    /// other workers load pages meanwhile, this one must stay
+    uint8_t *page = buffer->pin(std::make_pair(fd_src, p));
+    FixedBitmap bits(record_manager->headmask_size,
+                     (uint64_t *)(page + BITMAP_START_OFFSET));
+    const uint8_t *records = page + record_manager->header_len;
+    for (int slot : bits.get_valid_indices()) {
+      const uint8_t *record = records + slot * record_manager->record_len;
+      if (filter.check(record)) {
+        out.resize(out.size() + record_len);
+        project(record, out.data() + out.size() - record_len);
+      }
+    }
+    buffer->unpin(page);
+  }
+}
+
+void ParallelScanIterator::run_round() {
+  auto pool = ThreadPool::get();
+  int first = next_morsel;
+  int n = std::min(pool->size() * ROUND_MORSELS, n_morsels() - first);
+  round.resize(n);
+  for (auto &records : round) {
+    records.clear();
+  }
+  pool->run(n, [&](int, int t) { scan_morsel(first + t, round[t]); });
+  next_morsel += n;
+  round_iter = round_pos = 0;
+}
+
+int ParallelScanIterator::fill_next_block() {
+  n_records = 0;
+  dst_iter = 0;
+  if (source_ended)
+    return 0;
+  int cap = record_per_page * QUERY_MAX_PAGES;
+  while (n_records < cap) {
+    if (round_iter == round.size()) {
+      if (next_morsel == n_morsels()) {
+        source_ended = true;
+        break;
+      }
+      run_round();
+      continue;
+    }
+    /// the rest of the morsel, a page of the block at a time
+    const auto &records = round[round_iter];
+    int slot = n_records % record_per_page;
+    int n = std::min<int>({(int)(records.size() - round_pos) / record_len,
+                           record_per_page - slot, cap - n_records});
+    uint8_t *page = PagedBuffer::get()->read_file_rdwr(
+        std::make_pair(fd_dst, n_records / record_per_page));
+    memcpy(page + slot * record_len, records.data() + round_pos,
+           n * record_len);
+    round_pos += n * record_len;
+    n_records += n;
+    if (round_pos == records.size()) {
+      ++round_iter;
+      round_pos = 0;
+    }
+  }
+  return n_records;
+}
+
+void ParallelScanIterator::reset_all() {
+  RecordIterator::reset_all();
+  next_morsel = 0;
+  round.clear();
+  round_iter = round_pos = 0;
+}
+
+/// write a column into consecutive records of a block
+template <int W>
+static void scatter(uint8_t *dst, int record_len, int offset,
+                    const ColumnBatch::Column &col, const uint16_t *rows,
+                    int n) {
+  int width = W ? W : col.width;
+  for (int j = 0; j < n; ++j) {
+    memcpy(dst + j * record_len + offset, col.data.data() + rows[j] * width,
+           W ? W : width);
+  }
+}
+
+int VectorScanIterator::fill_next_block() {
+  n_records = 0;
+  dst_iter = 0;
+  if (source_ended) {
+    return 0;
+  }
+  int capacity = record_per_page * QUERY_MAX_PAGES;
+  while (n_records < capacity) {
+    if (batch_pos == batch.n_sel && next_batch() == nullptr) {
+      source_ended = true;
+      break;
+    }
+    int slot = n_records % record_per_page;
+    int n = std::min(batch.n_sel - batch_pos, record_per_page - slot);
+    uint8_t *dst = PagedBuffer::get()->read_file_rdwr(
+                       std::make_pair(fd_dst, n_records / record_per_page)) +
+                   slot * record_len;
+    const uint16_t *rows = batch.sel + batch_pos;
+    for (int j = 0; j < n; ++j) {
+      *(bitmap_t *)(dst + j * record_len) = 0;
+    }
+    int offset = sizeof(bitmap_t);
+    for (size_t c = 0; c < fields_dst.size(); ++c) {
+      const auto &col = batch.columns[c];
+      for (int j = 0; j < n; ++j) {
+        *(bitmap_t *)(dst + j * record_len) |= !col.nulls[rows[j]] << c;
+      }
+      switch (col.width) {
+      case 4:
+        scatter<4>(dst, record_len, offset, col, rows, n);
+        break;
+      case 8:
+        scatter<8>(dst, record_len, offset, col, rows, n);
+        break;
+      default:
+        scatter<0>(dst, record_len, offset, col, rows, n);
+      }
+      offset += col.width;
+    }
+    batch_pos += n;
+    n_records += n;
+  }
+  return n_records;
+}
+
 IndexIterator::IndexIterator(
     std::shared_ptr<IndexMeta> index, int lbound_, int rbound_,
     const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
     const std::vector<std::shared_ptr<Field>> &fields_src_,
-    const std::vector<std::shared_ptr<Field>> &fields_dst_)
-    : BlockIterator(IteratorType::INDEX), lbound(lbound_), rbound(rbound_) {
+    const std::vector<std::shared_ptr<Field>> &fields_dst_, bool reverse_)
+    : BlockIterator(IteratorType::INDEX), lbound(lbound_), rbound(rbound_),
+      reverse(reverse_) {
   fields_src = fields_src_;
   tree = index->tree;
   fd_src = tree->get_fd();
@@ -212,6 +527,8 @@ IndexIterator::IndexIterator(
     }
   }
 
+  filter = Conjunction(constraints, fields_src);
+
   record_len = sizeof(bitmap_t);
   for (auto field : fields_src_) {
     if (field_ids_dst.contains(field->field_id)) {
@@ -220,17 +537,27 @@ IndexIterator::IndexIterator(
     }
   }
   record_per_page = Config::PAGE_SIZE / record_len;
+  seek();
+}
+
+IndexIterator::~IndexIterator() { FileMapping::get()->close_temp_file(fd_dst); }
 
+void IndexIterator::seek() {
+  /// the cursor rests one entry outside the range and steps before reading:
+  /// on the last entry below lbound, or just past the last one below rbound
   std::vector<int> key(key_num, INT_MIN);
-  key[0] = lbound;
+  key[0] = reverse ? rbound : lbound;
   auto pos = tree->le_match(key);
-  pagenum_src = pos.pagenum;
   pagenum_init = pos.pagenum;
-  slotnum_src = pos.slotnum;
-  slotnum_init = pos.slotnum;
+  slotnum_init = reverse ? pos.slotnum + 1 : pos.slotnum;
+  reset_all();
 }
 
-IndexIterator::~IndexIterator() { FileMapping::get()->close_temp_file(fd_dst); }
+void IndexIterator::rebind(int lbound_, int rbound_) {
+  lbound = lbound_;
+  rbound = rbound_;
+  seek();
+}
 
 void IndexIterator::reset_all() {
   pagenum_src = pagenum_init;
@@ -249,8 +576,25 @@ bool IndexIterator::get_next_valid() {
   int node_size = meta->size;
   bool match = false;
   do {
-    ++slotnum_src;
-    if (slotnum_src >= node_size) {
+    if (reverse) {
+      if (--slotnum_src < 0) {
+        pagenum_src = meta->left_sibling;
+        if (pagenum_src == -1) {
+          assert(false);
+          source_ended = true;
+          return false;
+        }
+        slice = PagedBuffer::get()->read_file_rd(
+            std::make_pair(fd_src, pagenum_src));
+        tree->prepare_from_slice(slice, meta, keys, data, NodeType::LEAF);
+        slotnum_src = meta->size - 1;
+      }
+      /// the leading INT_MIN sentinel always terminates the scan
+      if (keys[slotnum_src * key_num] < lbound) {
+        source_ended = true;
+        return false;
+      }
+    } else if (++slotnum_src >= node_size) {
       pagenum_src = meta->right_sibling;
       slotnum_src = 0;
       if (pagenum_src == -1) {
@@ -263,19 +607,12 @@ bool IndexIterator::get_next_valid() {
       node_size = ((BPlusNodeMeta *)slice)->size;
       tree->prepare_from_slice(slice, meta, keys, data, NodeType::LEAF);
     }
-    if (keys[slotnum_src * key_num] >= rbound) {
+    if (!reverse && keys[slotnum_src * key_num] >= rbound) {
       source_ended = true;
       return false;
     }
 
-    match = true;
-    for (auto constraint : constraints) {
-      if (!constraint->check(data + slotnum_src * leaf_data_len,
-                             data + slotnum_src * leaf_data_len)) {
-        match = false;
-        break;
-      }
-    }
+    match = filter.check(data + slotnum_src * leaf_data_len);
   } while (!match);
   return true;
 }
@@ -293,7 +630,8 @@ int IndexIterator::fill_next_block() {
   if (source_ended)
     return 0;
 
-  for (int i = 0; i < record_per_page * QUERY_MAX_PAGES; ++i) {
+  int block_len = std::min(record_per_page * QUERY_MAX_PAGES, block_cap);
+  for (int i = 0; i < block_len; ++i) {
     if (!get_next_valid() || source_ended) {
       break;
     }
@@ -346,17 +684,16 @@ JoinIterator::JoinIterator(
 
   /// fields and constraints
   std::set<unified_id_t> field_ids_dst;
-  std::map<unified_id_t, std::pair<int, int>> field_ids_src;
   int off = sizeof(bitmap_t), idx = 0;
   for (auto field : lhs->get_fields_dst()) {
-    field_ids_src[field->field_id] = std::make_pair(idx, off);
+    pos_src[field->field_id] = std::make_pair(idx, off);
     off += field->get_size();
     ++idx;
   }
   off = sizeof(bitmap_t);
   idx = 0;
   for (auto field : rhs->get_fields_dst()) {
-    field_ids_src[field->field_id] = std::make_pair(idx, off);
+    pos_src[field->field_id] = std::make_pair(idx, off);
     off += field->get_size();
     ++idx;
   }
@@ -374,7 +711,7 @@ JoinIterator::JoinIterator(
     int tid2 = col_comp->table_id_other;
     int fid1 = col_comp->field_id1;
     int fid2 = col_comp->field_id2;
-    if (field_ids_src.contains(fid1) != field_ids_src.contains(fid2)) {
+    if (pos_src.contains(fid1) != pos_src.contains(fid2)) {
       field_ids_dst.insert(fid1);
       field_ids_dst.insert(fid2);
     }
@@ -383,8 +720,8 @@ JoinIterator::JoinIterator(
       col_comp->swap_input = true;
     }
     if (ltables.contains(tid1) && rtables.contains(tid2)) {
-      auto [idx1, off1] = field_ids_src[fid1];
-      auto [idx2, off2] = field_ids_src[fid2];
+      auto [idx1, off1] = pos_src[fid1];
+      auto [idx2, off2] = pos_src[fid2];
       col_comp->build(idx1, off1, idx2, off2);
       constraints.push_back(col_comp);
     }
@@ -394,7 +731,7 @@ JoinIterator::JoinIterator(
     if (field_ids_dst.contains(field->field_id)) {
       fields_dst.push_back(field);
       fields_dst_lhs.push_back(field);
-      pos_dst_lhs.push_back(field_ids_src[field->field_id]);
+      pos_dst_lhs.push_back(pos_src[field->field_id]);
       record_len += field->get_size();
     }
   }
@@ -402,7 +739,7 @@ JoinIterator::JoinIterator(
     if (field_ids_dst.contains(field->field_id)) {
       fields_dst.push_back(field);
       fields_dst_rhs.push_back(field);
-      pos_dst_rhs.push_back(field_ids_src[field->field_id]);
+      pos_dst_rhs.push_back(pos_src[field->field_id]);
       record_len += field->get_size();
     }
   }
@@ -459,8 +796,8 @@ int JoinIterator::fill_next_block() {
     if (!get_next_valid() || source_ended) {
       break;
     }
-    auto ptr_lhs = lhs->get();
-    auto ptr_rhs = rhs->get();
+    auto ptr_lhs = get_lhs();
+    auto ptr_rhs = get_rhs();
     bitmap_t src_bitmap_lhs = *(const bitmap_t *)ptr_lhs;
     bitmap_t src_bitmap_rhs = *(const bitmap_t *)ptr_rhs;
 
@@ -503,124 +840,813 @@ void JoinIterator::reset_all() {
   source_ended = false;
 }
 
-PermuteIterator::PermuteIterator(
-    std::shared_ptr<BlockIterator> iter,
-    const std::vector<std::shared_ptr<Field>> fields_dst_)
-    : Iterator(IteratorType::PERMUTE), iter(iter) {
-  fields_dst = fields_dst_;
-  fields_src = iter->get_fields_dst();
-
-  std::map<unified_id_t, std::pair<int, int>> field_id_to_idx;
-  int col_offset = sizeof(bitmap_t);
-  for (size_t i = 0; i < fields_src.size(); i++) {
-    field_id_to_idx[fields_src[i]->field_id] = std::make_pair(i, col_offset);
-    col_offset += fields_src[i]->get_size();
-  }
-  buffer.resize(col_offset);
-  for (auto field : fields_dst) {
-    if (field != nullptr)
-      permute_info.push_back(field_id_to_idx[field->field_id]);
+HashJoinIterator::HashJoinIterator(
+    std::shared_ptr<BlockIterator> lhs_, std::shared_ptr<BlockIterator> rhs_,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_, bool build_left)
+    : JoinIterator(lhs_, rhs_, cons, fields_dst_), build_left(build_left) {
+  build_side = build_left ? lhs : rhs;
+  probe_side = build_left ? rhs : lhs;
+  auto record_size = [](std::shared_ptr<BlockIterator> iter) {
+    int len = sizeof(bitmap_t);
+    for (auto field : iter->get_fields_dst()) {
+      len += field->get_size();
+    }
+    return len;
+  };
+  build_len = record_size(build_side);
+  probe_len = record_size(probe_side);
+  probe_row.resize(probe_len);
+  for (auto col_comp : constraints) {
+    if (col_comp->optype != Operator::EQ) {
+      residual.push_back(col_comp);
+      continue;
+    }
+    auto [idx_l, off_l] = pos_src[col_comp->swap_input ? col_comp->field_id2
+                                                       : col_comp->field_id1];
+    auto [idx_r, off_r] = pos_src[col_comp->swap_input ? col_comp->field_id1
+                                                       : col_comp->field_id2];
+    if (build_left) {
+      keys.push_back((key_column){col_comp->dtype, idx_l, off_l, idx_r, off_r});
+    } else {
+      keys.push_back((key_column){col_comp->dtype, idx_r, off_r, idx_l, off_l});
+    }
   }
+  assert(!keys.empty());
 }
 
-const uint8_t *PermuteIterator::get() const { return buffer.data(); }
-
-bool PermuteIterator::get_next_valid() {
-  iter->block_next();
-  if (iter->block_end()) {
-    iter->fill_next_block();
-  }
-  if (iter->all_end()) {
-    return false;
-  }
-  const uint8_t *p = iter->get();
-  uint8_t *dst = buffer.data();
-  bitmap_t bitmap_src = *(bitmap_t *)p;
-  bitmap_t bitmap_dst = 0;
-  int dst_offset = sizeof(bitmap_t);
-  for (size_t i = 0; i < permute_info.size(); ++i) {
-    auto [idx, offset] = permute_info[i];
-    if ((bitmap_src >> idx) & 1) {
-      bitmap_dst |= 1 << i;
-      memcpy(dst + dst_offset, p + offset, fields_dst[i]->get_size());
+HashJoinIterator::~HashJoinIterator() {
+  for (auto parts : {&build_parts, &probe_parts}) {
+    for (auto [fd, _] : *parts) {
+      FileMapping::get()->close_temp_file(fd);
     }
-    dst_offset += fields_dst[i]->get_size();
   }
-  *(bitmap_t *)dst = bitmap_dst;
-  return true;
 }
 
-AggregateIterator::AggregateIterator(
-    std::shared_ptr<BlockIterator> iterator,
-    std::shared_ptr<Field> group_by_field_,
-    const std::vector<std::shared_ptr<Field>> fields_dst_,
-    const std::vector<Aggregator> &aggrs_)
-    : GatherIterator(IteratorType::AGGERGATE), iter(iterator),
-      group_by_field(group_by_field_), aggrs(aggrs_) {
-  fd = FileMapping::get()->create_temp_file();
-  fields_src = iter->get_fields_dst();
-  std::map<unified_id_t, std::pair<int, int>> field_id_to_idx;
-  int src_offset = sizeof(bitmap_t);
-  for (size_t i = 0; i < fields_src.size(); ++i) {
-    if (group_by_field != nullptr &&
-        fields_src[i]->field_id == group_by_field->field_id) {
-      group_by_field_offset = src_offset;
+bool HashJoinIterator::applicable(
+    std::shared_ptr<BlockIterator> lhs, std::shared_ptr<BlockIterator> rhs,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons) {
+  const auto &ltables = lhs->get_table_ids();
+  const auto &rtables = rhs->get_table_ids();
+  for (auto con : cons) {
+    auto col_comp = std::dynamic_pointer_cast<ColumnOpColumnConstraint>(con);
+    if (col_comp == nullptr || col_comp->optype != Operator::EQ) {
+      continue;
+    }
+    auto tid1 = col_comp->table_id, tid2 = col_comp->table_id_other;
+    if ((ltables.contains(tid1) && rtables.contains(tid2)) ||
+        (ltables.contains(tid2) && rtables.contains(tid1))) {
+      return true;
     }
-    field_id_to_idx[fields_src[i]->field_id] = std::make_pair(i, src_offset);
-    src_offset += fields_src[i]->get_size();
   }
+  return false;
+}
 
-  int offset = 0;
-  export_len = sizeof(bitmap_t);
-  for (size_t i = 0; i < fields_dst_.size(); ++i) {
-    auto aggr = aggrs[i];
-    auto dtype = fields_dst_[i] == nullptr ? DataType::INT
-                                           : fields_dst_[i]->datatype->type;
-    if (fields_dst_[i] == nullptr) {
-      // COUNT(*)
-      caster.push_back((field_caster){DataType::INT, 0, -1, -1});
-    } else {
-      auto [idx, src_offset] = field_id_to_idx[fields_dst_[i]->field_id];
-      caster.push_back((field_caster){
-          fields_dst_[i]->datatype->type,
-          aggr == Aggregator::COUNT ? 0 : fields_dst_[i]->get_size(), idx,
-          src_offset});
+std::optional<uint64_t> HashJoinIterator::hash_keys(const uint8_t *record,
+                                                    bool build) const {
+  bitmap_t bitmap = *(const bitmap_t *)record;
+  uint64_t h = 0x9e3779b97f4a7c15ull;
+  for (const auto &key : keys) {
+    int idx = build ? key.build_idx : key.probe_idx;
+    const uint8_t *p = record + (build ? key.build_off : key.probe_off);
+    if (((bitmap >> idx) & 1) == 0) {
+      return std::nullopt;
     }
-    if ((dtype == DataType::VARCHAR || dtype == DataType::DATE) &&
-        (aggr == Aggregator::AVG || aggr == Aggregator::SUM)) {
-      has_err = true;
-      printf("ERROR: cannot aggregate VARCHAR with AVG/SUM.\n");
+    uint64_t v = 0;
+    switch (key.type) {
+    case DataType::INT:
+    case DataType::DATE:
+      v = *(const uint32_t *)p;
+      break;
+    case DataType::FLOAT: {
+      /// -0.0 == 0.0
+      FloatType::DType d = *(const FloatType::DType *)p + 0.0;
+      memcpy(&v, &d, sizeof(v));
       break;
     }
-    if (aggr == Aggregator::AVG) {
-      auto fake = std::shared_ptr<Field>(new Field(get_unified_id()));
-      fake->datatype = DataTypeBase::build(DataType::FLOAT);
-      fields_dst.push_back(fake);
-    } else if (aggr == Aggregator::COUNT) {
-      auto fake = std::shared_ptr<Field>(new Field(get_unified_id()));
-      fake->datatype = DataTypeBase::build(DataType::INT);
-      fields_dst.push_back(fake);
-    } else {
-      fields_dst.push_back(fields_dst_[i]);
+    case DataType::VARCHAR:
+      v = std::hash<std::string_view>()((const char *)p);
+      break;
     }
-    offset += sizeof(count_t) + caster.back().len;
-    export_len += fields_dst[i]->get_size();
+    h ^= v;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
   }
-  record_len = offset;
-  record_per_page = Config::PAGE_SIZE / record_len;
-  if (group_by_field == nullptr) {
-    auto ptr = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, 0));
-    memset(ptr, 0, Config::PAGE_SIZE);
-  }
-}
-
-AggregateIterator::~AggregateIterator() {
-  FileMapping::get()->close_temp_file(fd);
+  return h;
 }
 
-void AggregateIterator::update(uint8_t *p, const uint8_t *o) {
-  auto ptr = p;
-  bitmap_t bitmap_src = *(bitmap_t *)o;
+bool HashJoinIterator::keys_equal(const uint8_t *build_row,
+                                  const uint8_t *probe_row) const {
+  for (const auto &key : keys) {
+    const uint8_t *p = build_row + key.build_off;
+    const uint8_t *q = probe_row + key.probe_off;
+    switch (key.type) {
+    case DataType::INT:
+    case DataType::DATE:
+      if (*(const IntType::DType *)p != *(const IntType::DType *)q)
+        return false;
+      break;
+    case DataType::FLOAT:
+      if (*(const FloatType::DType *)p != *(const FloatType::DType *)q)
+        return false;
+      break;
+    case DataType::VARCHAR:
+      if (strcmp((const char *)p, (const char *)q) != 0)
+        return false;
+      break;
+    }
+  }
+  return true;
+}
+
+void HashJoinIterator::append(std::pair<int, int> &part, const uint8_t *record,
+                              int len) {
+  int per_page = Config::PAGE_SIZE / len;
+  auto [fd, n] = part;
+  uint8_t *ptr =
+      PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, n / per_page));
+  memcpy(ptr + n % per_page * len, record, len);
+  ++part.second;
+  spilled_bytes += len;
+}
+
+const uint8_t *HashJoinIterator::read(std::pair<int, int> part, int i,
+                                      int len) const {
+  int per_page = Config::PAGE_SIZE / len;
+  auto [fd, _] = part;
+  const uint8_t *ptr =
+      PagedBuffer::get()->read_file_rd(std::make_pair(fd, i / per_page));
+  return ptr + i % per_page * len;
+}
+
+void HashJoinIterator::index_rows() {
+  size_t n = hashes.size();
+  size_t n_buckets = 16;
+  while (n_buckets < n * 2) {
+    n_buckets <<= 1;
+  }
+  heads.assign(n_buckets, -1);
+  next.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    auto &head = heads[hashes[i] & (n_buckets - 1)];
+    next[i] = head;
+    head = i;
+  }
+}
+
+void HashJoinIterator::build() {
+  built = true;
+  /// partitions are picked by the top bits, buckets by the bottom ones
+  auto partition_of = [](uint64_t h) { return h >> 60; };
+  static_assert(N_PARTITIONS == 16);
+  while (true) {
+    build_side->block_next();
+    if (build_side->block_end()) {
+      build_side->fill_next_block();
+    }
+    if (build_side->all_end()) {
+      break;
+    }
+    const uint8_t *record = build_side->get();
+    auto h = hash_keys(record, true);
+    if (!h.has_value()) {
+      continue;
+    }
+    if (!partitioned && rows.size() + build_len > (size_t)QUERY_MAX_BLOCK) {
+      partitioned = true;
+      for (int i = 0; i < N_PARTITIONS; ++i) {
+        build_parts.emplace_back(FileMapping::get()->create_temp_file(), 0);
+        probe_parts.emplace_back(FileMapping::get()->create_temp_file(), 0);
+      }
+      for (size_t i = 0; i < hashes.size(); ++i) {
+        append(build_parts[partition_of(hashes[i])],
+               rows.data() + i * build_len, build_len);
+      }
+      rows.clear();
+      hashes.clear();
+    }
+    if (partitioned) {
+      append(build_parts[partition_of(*h)], record, build_len);
+    } else {
+      rows.insert(rows.end(), record, record + build_len);
+      hashes.push_back(*h);
+    }
+  }
+  if (!partitioned) {
+    index_rows();
+    return;
+  }
+  while (true) {
+    probe_side->block_next();
+    if (probe_side->block_end()) {
+      probe_side->fill_next_block();
+    }
+    if (probe_side->all_end()) {
+      break;
+    }
+    const uint8_t *record = probe_side->get();
+    auto h = hash_keys(record, false);
+    if (h.has_value()) {
+      append(probe_parts[partition_of(*h)], record, probe_len);
+    }
+  }
+}
+
+bool HashJoinIterator::next_probe_row() {
+  while (true) {
+    const uint8_t *record;
+    if (!partitioned) {
+      /// nothing to match, leave the probe input unread
+      if (hashes.empty()) {
+        return false;
+      }
+      probe_side->block_next();
+      if (probe_side->block_end()) {
+        probe_side->fill_next_block();
+      }
+      if (probe_side->all_end()) {
+        return false;
+      }
+      record = probe_side->get();
+    } else {
+      while (part == -1 || probe_iter == probe_parts[part].second) {
+        if (part + 1 == N_PARTITIONS) {
+          return false;
+        }
+        ++part;
+        probe_iter = 0;
+        rows.clear();
+        hashes.clear();
+        for (int i = 0; i < build_parts[part].second; ++i) {
+          const uint8_t *row = read(build_parts[part], i, build_len);
+          rows.insert(rows.end(), row, row + build_len);
+          hashes.push_back(*hash_keys(row, true));
+        }
+        index_rows();
+      }
+      record = read(probe_parts[part], probe_iter++, probe_len);
+    }
+    auto h = hash_keys(record, false);
+    if (!h.has_value()) {
+      continue;
+    }
+    /// the record may live in a page that output writes can evict
+    memcpy(probe_row.data(), record, probe_len);
+    probe_hash = *h;
+    chain = heads[probe_hash & (heads.size() - 1)];
+    return true;
+  }
+}
+
+const uint8_t *HashJoinIterator::get_lhs() const {
+  return build_left ? rows.data() + match * build_len : probe_row.data();
+}
+
+const uint8_t *HashJoinIterator::get_rhs() const {
+  return build_left ? probe_row.data() : rows.data() + match * build_len;
+}
+
+bool HashJoinIterator::get_next_valid() {
+  if (!built) {
+    build();
+  }
+  while (true) {
+    while (chain != -1) {
+      match = chain;
+      chain = next[chain];
+      if (hashes[match] != probe_hash ||
+          !keys_equal(rows.data() + match * build_len, probe_row.data())) {
+        continue;
+      }
+      bool ok = true;
+      for (auto constraint : residual) {
+        if (!constraint->check(get_lhs(), get_rhs())) {
+          ok = false;
+          break;
+        }
+      }
+      if (ok) {
+        return true;
+      }
+    }
+    if (!next_probe_row()) {
+      source_ended = true;
+      return false;
+    }
+  }
+}
+
+void HashJoinIterator::reset_all() {
+  dst_iter = n_records = 0;
+  source_ended = false;
+  chain = -1;
+  if (!built) {
+    return;
+  }
+  /// the table is kept, only the probe input starts over
+  if (partitioned) {
+    part = -1;
+  } else {
+    probe_side->reset_all();
+  }
+}
+
+IndexJoinIterator::IndexJoinIterator(
+    std::shared_ptr<BlockIterator> lhs_, std::shared_ptr<IndexIterator> inner_,
+    std::shared_ptr<ColumnOpColumnConstraint> key,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_)
+    : JoinIterator(lhs_, inner_, cons, fields_dst_), inner(inner_) {
+  assert(key->optype == Operator::EQ);
+  std::tie(key_idx, key_off) =
+      pos_src[key->swap_input ? key->field_id2 : key->field_id1];
+}
+
+bool IndexJoinIterator::get_next_valid() {
+  while (true) {
+    if (outer_valid) {
+      inner->block_next();
+      if (inner->block_end()) {
+        inner->fill_next_block();
+      }
+      if (!inner->all_end()) {
+        /// key is checked again: NULLs are indexed under their raw bytes
+        bool match = true;
+        for (auto constraint : constraints) {
+          if (!constraint->check(lhs->get(), inner->get())) {
+            match = false;
+            break;
+          }
+        }
+        if (match) {
+          return true;
+        }
+        continue;
+      }
+    }
+    lhs->block_next();
+    if (lhs->block_end()) {
+      lhs->fill_next_block();
+    }
+    if (lhs->all_end()) {
+      source_ended = true;
+      return false;
+    }
+    const uint8_t *record = lhs->get();
+    IntType::DType val = *(const IntType::DType *)(record + key_off);
+    /// NULL matches nothing, INT_MIN and INT_MAX are tree sentinels
+    outer_valid = ((*(const bitmap_t *)record >> key_idx) & 1) &&
+                  val != INT_MIN && val != INT_MAX;
+    if (outer_valid) {
+      inner->rebind(val, val + 1);
+    }
+  }
+}
+
+void IndexJoinIterator::reset_all() {
+  lhs->reset_all();
+  dst_iter = n_records = 0;
+  source_ended = false;
+  outer_valid = false;
+}
+
+MergeJoinIterator::MergeJoinIterator(
+    std::shared_ptr<BlockIterator> lhs_, std::shared_ptr<BlockIterator> rhs_,
+    std::shared_ptr<ColumnOpColumnConstraint> key,
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_, bool lhs_sorted,
+    bool rhs_sorted)
+    : JoinIterator(lhs_, rhs_, cons, fields_dst_), lhs_sorted(lhs_sorted),
+      rhs_sorted(rhs_sorted) {
+  assert(key->optype == Operator::EQ);
+  assert(key->dtype == DataType::INT || key->dtype == DataType::DATE);
+  unified_id_t id_lhs = key->swap_input ? key->field_id2 : key->field_id1;
+  unified_id_t id_rhs = key->swap_input ? key->field_id1 : key->field_id2;
+  std::tie(lhs_idx, lhs_off) = pos_src[id_lhs];
+  std::tie(rhs_idx, rhs_off) = pos_src[id_rhs];
+  auto find = [](std::shared_ptr<BlockIterator> iter, unified_id_t field_id,
+                 int &len) {
+    std::shared_ptr<Field> ret = nullptr;
+    len = sizeof(bitmap_t);
+    for (auto field : iter->get_fields_dst()) {
+      if (field->field_id == field_id) {
+        ret = field;
+      }
+      len += field->get_size();
+    }
+    return ret;
+  };
+  key_lhs = find(lhs, id_lhs, lhs_len);
+  key_rhs = find(rhs, id_rhs, rhs_len);
+  lhs_row.resize(lhs_len);
+}
+
+std::shared_ptr<Iterator>
+MergeJoinIterator::open_stream(std::shared_ptr<BlockIterator> side,
+                               std::shared_ptr<Field> key, bool sorted) {
+  /// same fields in the same order, so that pos_src stays valid
+  auto stream = std::shared_ptr<Iterator>(
+      new PermuteIterator(side, side->get_fields_dst()));
+  if (!sorted) {
+    stream =
+        std::shared_ptr<Iterator>(new SortIterator(stream, {{key, false}}));
+  }
+  return stream;
+}
+
+bool MergeJoinIterator::next_lhs() {
+  while (lhs_stream->get_next_valid()) {
+    const uint8_t *record = lhs_stream->get();
+    /// NULL keys never match. an index scan keeps them under their raw bytes,
+    /// out of order, which skipping them makes harmless
+    if ((*(const bitmap_t *)record >> lhs_idx) & 1) {
+      memcpy(lhs_row.data(), record, lhs_len);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MergeJoinIterator::get_next_valid() {
+  if (source_ended) {
+    return false;
+  }
+  if (!started) {
+    started = true;
+    lhs_stream = open_stream(lhs, key_lhs, lhs_sorted);
+    rhs_stream = open_stream(rhs, key_rhs, rhs_sorted);
+    rhs_valid = rhs_stream->get_next_valid();
+    if (!next_lhs()) {
+      source_ended = true;
+      return false;
+    }
+  }
+  auto key_of = [](const uint8_t *record, int off) {
+    return *(const IntType::DType *)(record + off);
+  };
+  while (true) {
+    if (in_run) {
+      while (++run_iter < (int)(run.size() / rhs_len)) {
+        bool match = true;
+        for (auto constraint : constraints) {
+          if (!constraint->check(get_lhs(), get_rhs())) {
+            match = false;
+            break;
+          }
+        }
+        if (match) {
+          return true;
+        }
+      }
+      if (!next_lhs()) {
+        break;
+      }
+      if (key_of(lhs_row.data(), lhs_off) == run_key) {
+        run_iter = -1;
+        continue;
+      }
+      in_run = false;
+    }
+    int key = key_of(lhs_row.data(), lhs_off);
+    const uint8_t *record = nullptr;
+    while (rhs_valid) {
+      record = rhs_stream->get();
+      if (((*(const bitmap_t *)record >> rhs_idx) & 1) &&
+          key_of(record, rhs_off) >= key) {
+        break;
+      }
+      rhs_valid = rhs_stream->get_next_valid();
+    }
+    if (!rhs_valid) {
+      break;
+    }
+    if (key_of(record, rhs_off) > key) {
+      if (!next_lhs()) {
+        break;
+      }
+      continue;
+    }
+    /// gather the rhs run of this key, NULLs inside it are skipped too
+    run.clear();
+    while (rhs_valid) {
+      record = rhs_stream->get();
+      bool non_null = (*(const bitmap_t *)record >> rhs_idx) & 1;
+      if (non_null && key_of(record, rhs_off) != key) {
+        break;
+      }
+      if (non_null) {
+        run.insert(run.end(), record, record + rhs_len);
+      }
+      rhs_valid = rhs_stream->get_next_valid();
+    }
+    run_key = key;
+    run_iter = -1;
+    in_run = true;
+  }
+  source_ended = true;
+  return false;
+}
+
+void MergeJoinIterator::reset_all() {
+  lhs->reset_all();
+  rhs->reset_all();
+  dst_iter = n_records = 0;
+  source_ended = false;
+  started = rhs_valid = in_run = false;
+  run.clear();
+}
+
+PermuteIterator::PermuteIterator(
+    std::shared_ptr<BlockIterator> iter,
+    const std::vector<std::shared_ptr<Field>> fields_dst_)
+    : Iterator(IteratorType::PERMUTE), iter(iter) {
+  fields_dst = fields_dst_;
+  fields_src = iter->get_fields_dst();
+
+  std::map<unified_id_t, std::pair<int, int>> field_id_to_idx;
+  int col_offset = sizeof(bitmap_t);
+  for (size_t i = 0; i < fields_src.size(); i++) {
+    field_id_to_idx[fields_src[i]->field_id] = std::make_pair(i, col_offset);
+    col_offset += fields_src[i]->get_size();
+  }
+  buffer.resize(col_offset);
+  for (auto field : fields_dst) {
+    if (field != nullptr)
+      permute_info.push_back(field_id_to_idx[field->field_id]);
+  }
+}
+
+const uint8_t *PermuteIterator::get() const { return buffer.data(); }
+
+bool PermuteIterator::get_next_valid() {
+  iter->block_next();
+  if (iter->block_end()) {
+    iter->fill_next_block();
+  }
+  if (iter->all_end()) {
+    return false;
+  }
+  const uint8_t *p = iter->get();
+  uint8_t *dst = buffer.data();
+  bitmap_t bitmap_src = *(bitmap_t *)p;
+  bitmap_t bitmap_dst = 0;
+  int dst_offset = sizeof(bitmap_t);
+  for (size_t i = 0; i < permute_info.size(); ++i) {
+    auto [idx, offset] = permute_info[i];
+    if ((bitmap_src >> idx) & 1) {
+      bitmap_dst |= 1 << i;
+      memcpy(dst + dst_offset, p + offset, fields_dst[i]->get_size());
+    }
+    dst_offset += fields_dst[i]->get_size();
+  }
+  *(bitmap_t *)dst = bitmap_dst;
+  return true;
+}
+
+/// append a record of len bytes to a temp file holding part.second of them
+static void append_record(std::pair<int, int> &part, const uint8_t *record,
+                          int len) {
+  int per_page = Config::PAGE_SIZE / len;
+  auto [fd, n] = part;
+  uint8_t *ptr =
+      PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, n / per_page));
+  memcpy(ptr + n % per_page * len, record, len);
+  ++part.second;
+}
+
+SpillPartitions::SpillPartitions(int len, int level)
+    : len(len), level(level), parts(FAN_OUT, {-1, 0}) {}
+
+SpillPartitions::~SpillPartitions() {
+  for (auto [fd, _] : parts) {
+    if (fd != -1) {
+      FileMapping::get()->close_temp_file(fd);
+    }
+  }
+}
+
+bool SpillPartitions::allowed(int len, int level) {
+  return level < MAX_LEVEL && len <= Config::PAGE_SIZE;
+}
+
+void SpillPartitions::append(const uint8_t *record, uint64_t h) {
+  auto &part = parts[(h >> (60 - 4 * level)) & (FAN_OUT - 1)];
+  if (part.first == -1) {
+    part.first = FileMapping::get()->create_temp_file();
+  }
+  append_record(part, record, len);
+  spilled_bytes += len;
+}
+
+void SpillPartitions::drain(
+    int part, const std::function<void(const uint8_t *)> &visit) {
+  auto &[fd, n] = parts[part];
+  if (fd == -1) {
+    return;
+  }
+  int per_page = Config::PAGE_SIZE / len;
+  std::vector<uint8_t> record(len);
+  for (int i = 0; i < n; ++i) {
+    const uint8_t *page =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, i / per_page));
+    memcpy(record.data(), page + i % per_page * len, len);
+    visit(record.data());
+  }
+  FileMapping::get()->close_temp_file(fd);
+  fd = -1;
+  n = 0;
+}
+
+/// the value of a column at dst, with -0.0 as 0.0 and the string tail
+/// zeroed so that equal values have equal bytes
+static void pack_value(uint8_t *dst, DataType type, const uint8_t *val,
+                       int width) {
+  switch (type) {
+  case DataType::INT:
+  case DataType::DATE:
+    memcpy(dst, val, sizeof(IntType::DType));
+    break;
+  case DataType::FLOAT: {
+    FloatType::DType x = *(const FloatType::DType *)val + 0.0;
+    memcpy(dst, &x, sizeof(x));
+    break;
+  }
+  case DataType::VARCHAR:
+    strncpy((char *)dst, (const char *)val, width);
+    break;
+  default:
+    assert(false);
+  }
+}
+
+static int round_to_word(int len) { return (len + 7) / 8 * 8; }
+
+AggregateIterator::AggregateIterator(
+    std::shared_ptr<BlockIterator> iterator,
+    const std::vector<std::shared_ptr<Field>> &group_by,
+    const std::vector<std::shared_ptr<Field>> fields_dst_,
+    const std::vector<Aggregator> &aggrs_)
+    : GatherIterator(IteratorType::AGGERGATE), iter(iterator), aggrs(aggrs_) {
+  fields_src = iter->get_fields_dst();
+  std::map<unified_id_t, std::pair<int, int>> field_id_to_idx;
+  int src_offset = sizeof(bitmap_t);
+  for (size_t i = 0; i < fields_src.size(); ++i) {
+    field_id_to_idx[fields_src[i]->field_id] = std::make_pair(i, src_offset);
+    src_offset += fields_src[i]->get_size();
+  }
+  src_len = src_offset;
+  group_key_len = 0;
+  for (auto field : group_by) {
+    auto [idx, src_offset] = field_id_to_idx[field->field_id];
+    group_columns.push_back((field_caster){field->datatype->type,
+                                           field->get_size(), idx, src_offset});
+    group_key_len += 1 + field->get_size();
+  }
+  group_key_len = round_to_word(group_key_len);
+
+  int offset = 0;
+  int distinct_len = 0;
+  export_len = sizeof(bitmap_t);
+  for (size_t i = 0; i < fields_dst_.size(); ++i) {
+    auto aggr = aggrs[i];
+    auto dtype = fields_dst_[i] == nullptr ? DataType::INT
+                                           : fields_dst_[i]->datatype->type;
+    bool counts = aggr == Aggregator::COUNT ||
+                  aggr == Aggregator::COUNT_DISTINCT ||
+                  aggr == Aggregator::APPROX_COUNT_DISTINCT;
+    if (fields_dst_[i] == nullptr) {
+      // COUNT(*)
+      caster.push_back((field_caster){DataType::INT, 0, -1, -1});
+    } else {
+      auto [idx, src_offset] = field_id_to_idx[fields_dst_[i]->field_id];
+      caster.push_back(
+          (field_caster){fields_dst_[i]->datatype->type,
+                         counts ? 0 : fields_dst_[i]->get_size(), idx,
+                         src_offset});
+    }
+    if ((dtype == DataType::VARCHAR || dtype == DataType::DATE) &&
+        (aggr == Aggregator::AVG || aggr == Aggregator::SUM)) {
+      has_err = true;
+      printf("ERROR: cannot aggregate VARCHAR with AVG/SUM.\n");
+      break;
+    }
+    if (aggr == Aggregator::AVG) {
+      auto fake = std::shared_ptr<Field>(new Field(get_unified_id()));
+      fake->datatype = DataTypeBase::build(DataType::FLOAT);
+      fields_dst.push_back(fake);
+    } else if (counts) {
+      auto fake = std::shared_ptr<Field>(new Field(get_unified_id()));
+      fake->datatype = DataTypeBase::build(DataType::INT);
+      fields_dst.push_back(fake);
+    } else {
+      fields_dst.push_back(fields_dst_[i]);
+    }
+    distinct.emplace_back();
+    if (aggr == Aggregator::COUNT_DISTINCT) {
+      /// the group number, then the value
+      int key_len = round_to_word(sizeof(int) + fields_dst_[i]->get_size());
+      distinct.back() = std::make_unique<HashDedup>(key_len);
+      distinct_len = std::max(distinct_len, key_len);
+    }
+    sketches.emplace_back();
+    if (aggr == Aggregator::APPROX_COUNT_DISTINCT) {
+      /// the value is normalized in distinct_key before it is hashed
+      distinct_len = std::max(distinct_len,
+                              round_to_word(fields_dst_[i]->get_size()));
+    }
+    offset += sizeof(count_t) + caster.back().len;
+    export_len += fields_dst[i]->get_size();
+  }
+  record_len = offset;
+  record_per_page = Config::PAGE_SIZE / std::max(record_len, 1);
+  distinct_key.resize(distinct_len);
+  groups = std::make_unique<GroupTable>(group_key_len, record_len);
+  if (group_columns.empty()) {
+    /// the one group, of an empty key
+    uint64_t empty = 0;
+    groups->find_or_insert((const uint8_t *)&empty);
+  }
+}
+
+AggregateIterator::~AggregateIterator() {
+  if (finished.first != -1) {
+    FileMapping::get()->close_temp_file(finished.first);
+  }
+}
+
+int AggregateIterator::find_group(const uint8_t *key, uint64_t h) {
+  if (partitions != nullptr) {
+    return groups->find(key, h);
+  }
+  int n = groups->size();
+  int group = groups->find_or_insert(key, h);
+  if (group == n &&
+      groups->memory() + sketch_memory > Config::get()->hash_memory &&
+      SpillPartitions::allowed(src_len, level) &&
+      record_len <= Config::PAGE_SIZE) {
+    partitions = std::make_unique<SpillPartitions>(src_len, level);
+  }
+  return group;
+}
+
+void AggregateIterator::set_aside(const uint8_t *record, uint64_t h) {
+  partitions->append(record, h);
+}
+
+void AggregateIterator::pack_key(const uint8_t *record, uint8_t *key) const {
+  /// NULL keys make one group of their own
+  memset(key, 0, group_key_len);
+  bitmap_t bitmap = *(const bitmap_t *)record;
+  for (auto &column : group_columns) {
+    if ((bitmap >> column.idx) & 1) {
+      key[0] = 1;
+      pack_value(key + 1, column.type, record + column.offset, column.len);
+    }
+    key += 1 + column.len;
+  }
+}
+
+bool AggregateIterator::first_distinct(int i, int group, const uint8_t *val) {
+  uint8_t *key = distinct_key.data();
+  memset(key, 0, distinct_key.size());
+  memcpy(key, &group, sizeof(int));
+  pack_value(key + sizeof(int), caster[i].type, val,
+             fields_src[caster[i].idx]->get_size());
+  return distinct[i]->insert(key);
+}
+
+void AggregateIterator::sketch_insert(int i, int group, const uint8_t *val) {
+  auto &sketch = sketches[i];
+  if ((int)sketch.size() <= group) {
+    sketch_memory += (group + 1 - sketch.size()) * HyperLogLog::N_REGISTERS;
+    sketch.resize(group + 1);
+  }
+  int len = fields_src[caster[i].idx]->get_size();
+  pack_value(distinct_key.data(), caster[i].type, val, len);
+  sketch[group].insert(HyperLogLog::hash_bytes(distinct_key.data(), len));
+}
+
+void AggregateIterator::none_differs() {
+  has_err = true;
+  if (in_workers) {
+    none_mismatch = true;
+  } else {
+    printf("ERROR: cannot aggregate data with NONE.\n");
+  }
+}
+
+void AggregateIterator::none_differs(int a, int b) {
+  has_err = true;
+  if (in_workers) {
+    none_mismatch = true;
+  } else {
+    printf("ERROR: cannot aggregate data with NONE (%d != %d).\n", a, b);
+  }
+}
+
+void AggregateIterator::update(uint8_t *state, int group, const uint8_t *o) {
+  auto ptr = state;
+  bitmap_t bitmap_src = *(bitmap_t *)o;
   for (size_t i = 0; i < caster.size(); ++i) {
     auto aggr = aggrs[i];
     auto oelem = o + caster[i].offset;
@@ -635,6 +1661,16 @@ void AggregateIterator::update(uint8_t *p, const uint8_t *o) {
       ptr += sizeof(count_t) + caster[i].len;
       continue;
     }
+    if (aggr == Aggregator::COUNT_DISTINCT) {
+      *(count_t *)ptr += first_distinct(i, group, oelem);
+      ptr += sizeof(count_t);
+      continue;
+    }
+    if (aggr == Aggregator::APPROX_COUNT_DISTINCT) {
+      sketch_insert(i, group, oelem);
+      ptr += sizeof(count_t);
+      continue;
+    }
     count_t cnt = ++(*(count_t *)ptr);
     ptr += sizeof(count_t);
     if (aggr == Aggregator::COUNT) {
@@ -660,9 +1696,7 @@ void AggregateIterator::update(uint8_t *p, const uint8_t *o) {
         break;
       case Aggregator::NONE:
         if (old_data != new_data) {
-          has_err = true;
-          printf("ERROR: cannot aggregate data with NONE (%d != %d).\n",
-                 old_data, new_data);
+          none_differs(old_data, new_data);
         }
         break;
       default:
@@ -685,97 +1719,554 @@ void AggregateIterator::update(uint8_t *p, const uint8_t *o) {
         break;
       case Aggregator::NONE:
         if (old_data != new_data) {
-          has_err = true;
+          none_differs();
+        }
+        break;
+      default:
+        assert(false);
+      }
+    } else if (caster[i].type == DataType::VARCHAR) {
+      switch (aggr) {
+      case Aggregator::MIN:
+        if (strcmp((const char *)ptr, (const char *)(oelem)) > 0) {
+          memcpy(ptr, oelem, caster[i].len);
+        }
+        break;
+      case Aggregator::MAX:
+        if (strcmp((const char *)ptr, (const char *)(oelem)) < 0) {
+          memcpy(ptr, oelem, caster[i].len);
+        }
+        break;
+      case Aggregator::NONE:
+        if (strcmp((const char *)ptr, (const char *)(oelem)) != 0) {
+          none_differs();
+        }
+        break;
+      default:
+        assert(false);
+      }
+    }
+    ptr += caster[i].len;
+  }
+}
+
+void AggregateIterator::merge_state(uint8_t *dst, const uint8_t *src) {
+  for (size_t i = 0; i < caster.size(); ++i) {
+    auto aggr = aggrs[i];
+    count_t cnt = *(count_t *)dst, add = *(const count_t *)src;
+    uint8_t *val = dst + sizeof(count_t);
+    const uint8_t *other = src + sizeof(count_t);
+    *(count_t *)dst = cnt + add;
+    dst += sizeof(count_t) + caster[i].len;
+    src += sizeof(count_t) + caster[i].len;
+    if (caster[i].len == 0 || add == 0) {
+      continue;
+    }
+    if (cnt == 0) {
+      memcpy(val, other, caster[i].len);
+    } else if (caster[i].type == DataType::INT ||
+               caster[i].type == DataType::DATE) {
+      using DType = IntType::DType;
+      DType old_data = *(const DType *)val;
+      DType new_data = *(const DType *)other;
+      switch (aggr) {
+      case Aggregator::SUM:
+      case Aggregator::AVG:
+        /// wraps around like the row path
+        *(DType *)val = (DType)((uint32_t)old_data + (uint32_t)new_data);
+        break;
+      case Aggregator::MIN:
+        *(DType *)val = std::min(old_data, new_data);
+        break;
+      case Aggregator::MAX:
+        *(DType *)val = std::max(old_data, new_data);
+        break;
+      case Aggregator::NONE:
+        if (old_data != new_data) {
+          none_differs(old_data, new_data);
+        }
+        break;
+      default:
+        assert(false);
+      }
+    } else if (caster[i].type == DataType::FLOAT) {
+      using DType = FloatType::DType;
+      DType old_data = *(const DType *)val;
+      DType new_data = *(const DType *)other;
+      switch (aggr) {
+      case Aggregator::SUM:
+      case Aggregator::AVG:
+        *(DType *)val += new_data;
+        break;
+      case Aggregator::MIN:
+        *(DType *)val = std::min(old_data, new_data);
+        break;
+      case Aggregator::MAX:
+        *(DType *)val = std::max(old_data, new_data);
+        break;
+      case Aggregator::NONE:
+        if (old_data != new_data) {
+          none_differs();
+        }
+        break;
+      default:
+        assert(false);
+      }
+    } else {
+      int cmp = strcmp((const char *)val, (const char *)other);
+      if ((aggr == Aggregator::MIN && cmp > 0) ||
+          (aggr == Aggregator::MAX && cmp < 0)) {
+        memcpy(val, other, caster[i].len);
+      } else if (aggr == Aggregator::NONE && cmp != 0) {
+        none_differs();
+      }
+    }
+  }
+}
+
+/// fold a column of batch into the state (count, then value) of each
+/// selected row's group, or into the state at states + offset when gids is
+/// nullptr. the first value of a group is taken as is, as update() does
+template <typename T, typename Fold>
+static void fold_column(uint8_t *states, int stride, int offset,
+                        const ColumnBatch &batch,
+                        const ColumnBatch::Column &col, const int *gids,
+                        Fold fold) {
+  using count_t = IntType::DType;
+  const T *vals = col.values<T>();
+  if (gids == nullptr) {
+    uint8_t *p = states + offset;
+    count_t cnt;
+    T acc;
+    memcpy(&cnt, p, sizeof(count_t));
+    memcpy(&acc, p + sizeof(count_t), sizeof(T));
+    for (int k = 0; k < batch.n_sel; ++k) {
+      int r = batch.sel[k];
+      if (!col.nulls[r]) {
+        acc = cnt++ ? fold(acc, vals[r]) : vals[r];
+      }
+    }
+    memcpy(p, &cnt, sizeof(count_t));
+    memcpy(p + sizeof(count_t), &acc, sizeof(T));
+    return;
+  }
+  for (int k = 0; k < batch.n_sel; ++k) {
+    int r = batch.sel[k];
+    if (col.nulls[r]) {
+      continue;
+    }
+    uint8_t *p = states + gids[k] * stride + offset;
+    count_t cnt;
+    T acc;
+    memcpy(&cnt, p, sizeof(count_t));
+    memcpy(&acc, p + sizeof(count_t), sizeof(T));
+    acc = cnt++ ? fold(acc, vals[r]) : vals[r];
+    memcpy(p, &cnt, sizeof(count_t));
+    memcpy(p + sizeof(count_t), &acc, sizeof(T));
+  }
+}
+
+template <typename T>
+static void fold_numeric(Aggregator aggr, uint8_t *states, int stride,
+                         int offset, const ColumnBatch &batch,
+                         const ColumnBatch::Column &col, const int *gids) {
+  auto fold = [&](auto f) {
+    fold_column<T>(states, stride, offset, batch, col, gids, f);
+  };
+  switch (aggr) {
+  case Aggregator::SUM:
+  case Aggregator::AVG:
+    if constexpr (std::is_integral_v<T>) {
+      /// wraps around like the row path
+      fold([](T a, T b) { return (T)((uint32_t)a + (uint32_t)b); });
+    } else {
+      fold([](T a, T b) { return a + b; });
+    }
+    break;
+  case Aggregator::MIN:
+    fold([](T a, T b) { return std::min(a, b); });
+    break;
+  case Aggregator::MAX:
+    fold([](T a, T b) { return std::max(a, b); });
+    break;
+  case Aggregator::NONE:
+    fold([](T a, T b) {
+      if (a != b) {
+        has_err = true;
+        if constexpr (std::is_integral_v<T>) {
+          printf("ERROR: cannot aggregate data with NONE (%d != %d).\n", a,
+                 b);
+        } else {
           printf("ERROR: cannot aggregate data with NONE.\n");
         }
-        break;
-      default:
-        assert(false);
       }
-    } else if (caster[i].type == DataType::VARCHAR) {
-      switch (aggr) {
-      case Aggregator::MIN:
-        if (strcmp((const char *)ptr, (const char *)(oelem)) > 0) {
-          memcpy(ptr, oelem, caster[i].len);
+      return a;
+    });
+    break;
+  default:
+    assert(false);
+  }
+}
+
+static void fold_string(Aggregator aggr, uint8_t *states, int stride,
+                        int offset, const ColumnBatch &batch,
+                        const ColumnBatch::Column &col, const int *gids) {
+  using count_t = IntType::DType;
+  for (int k = 0; k < batch.n_sel; ++k) {
+    int r = batch.sel[k];
+    if (col.nulls[r]) {
+      continue;
+    }
+    uint8_t *p = states + (gids ? gids[k] * stride : 0) + offset;
+    char *acc = (char *)p + sizeof(count_t);
+    const char *val = col.str(r);
+    if (++*(count_t *)p == 1) {
+      memcpy(acc, val, col.width);
+      continue;
+    }
+    int cmp = strcmp(acc, val);
+    if ((aggr == Aggregator::MIN && cmp > 0) ||
+        (aggr == Aggregator::MAX && cmp < 0)) {
+      memcpy(acc, val, col.width);
+    } else if (aggr == Aggregator::NONE && cmp != 0) {
+      has_err = true;
+      printf("ERROR: cannot aggregate data with NONE.\n");
+    }
+  }
+}
+
+void AggregateIterator::build_batched(
+    std::shared_ptr<VectorScanIterator> scan) {
+  /// the batch columns start with the fields handed to us
+  int stride = groups->get_entry_len();
+  int gids[ColumnBatch::BATCH_SIZE];
+  group_keys.resize(ColumnBatch::BATCH_SIZE * group_key_len);
+  /// where each column goes in an input record, for the rows set aside
+  std::vector<int> src_offsets;
+  int src_offset = sizeof(bitmap_t);
+  for (auto field : fields_src) {
+    src_offsets.push_back(src_offset);
+    src_offset += field->get_size();
+  }
+  std::vector<uint8_t> row(src_len);
+  while (auto batch = scan->next_batch()) {
+    int n = batch->n_sel;
+    uint8_t *keys = group_keys.data();
+    /// all keys of the batch first, then their lookups back to back
+    if (group_columns.size() == 1 &&
+        (group_columns[0].type == DataType::INT ||
+         group_columns[0].type == DataType::DATE)) {
+      /// the NULL byte and the value make up a single word
+      const auto &col = batch->columns[group_columns[0].idx];
+      const auto *vals = col.values<IntType::DType>();
+      for (int k = 0; k < n; ++k) {
+        int r = batch->sel[k];
+        uint64_t w = col.nulls[r] ? 0 : 1 | (uint64_t)(uint32_t)vals[r] << 8;
+        memcpy(keys + k * group_key_len, &w, sizeof(w));
+      }
+    } else if (!group_columns.empty()) {
+      memset(keys, 0, n * group_key_len);
+      int key_offset = 0;
+      for (auto &column : group_columns) {
+        const auto &col = batch->columns[column.idx];
+        for (int k = 0; k < n; ++k) {
+          int r = batch->sel[k];
+          if (!col.nulls[r]) {
+            uint8_t *dst = keys + k * group_key_len + key_offset;
+            dst[0] = 1;
+            pack_value(dst + 1, col.type, col.data.data() + r * col.width,
+                       col.width);
+          }
+        }
+        key_offset += 1 + column.len;
+      }
+    }
+    if (!group_columns.empty()) {
+      /// the rows set aside leave the selection
+      int kept = 0;
+      for (int k = 0; k < n; ++k) {
+        const uint8_t *key = keys + k * group_key_len;
+        uint64_t h = GroupTable::hash(key, group_key_len);
+        int group = find_group(key, h);
+        if (group != -1) {
+          batch->sel[kept] = batch->sel[k];
+          gids[kept++] = group;
+          continue;
         }
-        break;
-      case Aggregator::MAX:
-        if (strcmp((const char *)ptr, (const char *)(oelem)) < 0) {
-          memcpy(ptr, oelem, caster[i].len);
+        int r = batch->sel[k];
+        bitmap_t bitmap = 0;
+        for (size_t c = 0; c < fields_src.size(); ++c) {
+          const auto &col = batch->columns[c];
+          if (!col.nulls[r]) {
+            bitmap |= 1 << c;
+            memcpy(row.data() + src_offsets[c],
+                   col.data.data() + r * col.width, col.width);
+          }
         }
-        break;
-      case Aggregator::NONE:
-        if (strcmp((const char *)ptr, (const char *)(oelem)) != 0) {
-          has_err = true;
-          printf("ERROR: cannot aggregate data with NONE.\n");
+        memcpy(row.data(), &bitmap, sizeof(bitmap));
+        set_aside(row.data(), h);
+      }
+      batch->n_sel = kept;
+    }
+    /// the states stay put until the next batch adds groups
+    uint8_t *states = groups->state(0);
+    const int *g = group_columns.empty() ? nullptr : gids;
+    int offset = 0;
+    for (size_t i = 0; i < caster.size(); ++i) {
+      if (aggrs[i] == Aggregator::COUNT_DISTINCT) {
+        const auto &col = batch->columns[caster[i].idx];
+        for (int k = 0; k < batch->n_sel; ++k) {
+          int r = batch->sel[k], group = g ? g[k] : 0;
+          if (!col.nulls[r] &&
+              first_distinct(i, group, col.data.data() + r * col.width)) {
+            ++*(count_t *)(states + group * stride + offset);
+          }
+        }
+      } else if (aggrs[i] == Aggregator::APPROX_COUNT_DISTINCT) {
+        const auto &col = batch->columns[caster[i].idx];
+        for (int k = 0; k < batch->n_sel; ++k) {
+          int r = batch->sel[k];
+          if (!col.nulls[r]) {
+            sketch_insert(i, g ? g[k] : 0, col.data.data() + r * col.width);
+          }
+        }
+      } else if (caster[i].idx == -1 || aggrs[i] == Aggregator::COUNT) {
+        /// COUNT(*) and COUNT(column)
+        const auto *col =
+            caster[i].idx == -1 ? nullptr : &batch->columns[caster[i].idx];
+        for (int k = 0; k < batch->n_sel; ++k) {
+          if (col == nullptr || !col->nulls[batch->sel[k]]) {
+            ++*(count_t *)(states + (g ? g[k] * stride : 0) + offset);
+          }
+        }
+      } else {
+        const auto &col = batch->columns[caster[i].idx];
+        switch (caster[i].type) {
+        case DataType::INT:
+        case DataType::DATE:
+          fold_numeric<IntType::DType>(aggrs[i], states, stride, offset,
+                                       *batch, col, g);
+          break;
+        case DataType::FLOAT:
+          fold_numeric<FloatType::DType>(aggrs[i], states, stride, offset,
+                                         *batch, col, g);
+          break;
+        default:
+          fold_string(aggrs[i], states, stride, offset, *batch, col, g);
         }
-        break;
-      default:
-        assert(false);
       }
+      offset += sizeof(count_t) + caster[i].len;
     }
-    ptr += caster[i].len;
   }
 }
 
+bool AggregateIterator::build_parallel(
+    std::shared_ptr<ParallelScanIterator> scan) {
+  auto pool = ThreadPool::get();
+  int n_workers = pool->size();
+  /// each worker folds its morsels into a table of partial states
+  std::vector<std::unique_ptr<GroupTable>> locals;
+  std::vector<std::vector<uint8_t>> rows(n_workers), keys(n_workers);
+  for (int w = 0; w < n_workers; ++w) {
+    locals.push_back(std::make_unique<GroupTable>(group_key_len, record_len));
+    keys[w].resize(group_key_len);
+    if (group_columns.empty()) {
+      uint64_t empty = 0;
+      locals[w]->find_or_insert((const uint8_t *)&empty);
+    }
+  }
+  size_t budget = Config::get()->hash_memory / n_workers;
+  std::atomic<bool> overflow{false};
+  in_workers = true;
+  pool->run(scan->n_morsels(), [&](int w, int m) {
+    if (overflow) {
+      return;
+    }
+    auto &table = *locals[w];
+    rows[w].clear();
+    scan->scan_morsel(m, rows[w]);
+    for (size_t offset = 0; offset < rows[w].size(); offset += src_len) {
+      const uint8_t *o = rows[w].data() + offset;
+      int group = 0;
+      if (!group_columns.empty()) {
+        pack_key(o, keys[w].data());
+        group = table.find_or_insert(keys[w].data());
+      }
+      update(table.state(group), group, o);
+    }
+    if (table.memory() > budget) {
+      overflow = true;
+    }
+  });
+  if (overflow) {
+    in_workers = false;
+    none_mismatch = false;
+    return false;
+  }
+  /// then a task per partition merges the states of its keys. partitions
+  /// go by the top bits of the hash, the table slots by the bottom ones
+  int n_parts = group_columns.empty() ? 1 : n_workers * 4;
+  auto part_of = [&](const uint8_t *key) {
+    uint64_t h = GroupTable::hash(key, group_key_len);
+    return (int)((h >> 32) * n_parts >> 32);
+  };
+  std::vector<std::vector<std::vector<int>>> buckets(
+      n_workers, std::vector<std::vector<int>>(n_parts));
+  pool->run(n_workers, [&](int, int w) {
+    for (int g = 0; g < locals[w]->size(); ++g) {
+      buckets[w][part_of(locals[w]->key(g))].push_back(g);
+    }
+  });
+  std::vector<std::unique_ptr<GroupTable>> parts(n_parts);
+  pool->run(n_parts, [&](int, int p) {
+    auto part = std::make_unique<GroupTable>(group_key_len, record_len);
+    for (int w = 0; w < n_workers; ++w) {
+      for (int g : buckets[w][p]) {
+        int n = part->size();
+        int group = part->find_or_insert(locals[w]->key(g));
+        if (group == n) {
+          memcpy(part->state(group), locals[w]->state(g), record_len);
+        } else {
+          merge_state(part->state(group), locals[w]->state(g));
+        }
+      }
+    }
+    parts[p] = std::move(part);
+  });
+  in_workers = false;
+  if (none_mismatch) {
+    printf("ERROR: cannot aggregate data with NONE.\n");
+  }
+  locals.clear();
+  std::vector<size_t> begin(n_parts + 1, 0);
+  for (int p = 0; p < n_parts; ++p) {
+    begin[p + 1] = begin[p] + parts[p]->size();
+  }
+  merged.resize(begin[n_parts] * record_len);
+  pool->run(n_parts, [&](int, int p) {
+    for (int g = 0; g < parts[p]->size(); ++g) {
+      memcpy(merged.data() + (begin[p] + g) * record_len, parts[p]->state(g),
+             record_len);
+    }
+    parts[p].reset();
+  });
+  n_records = begin[n_parts];
+  return true;
+}
+
 void AggregateIterator::build() {
   if (built)
     return;
   built = true;
-  std::unordered_map<IntType::DType, int> map_int;
-  std::unordered_map<FloatType::DType, int> map_float;
-  std::unordered_map<std::string, int> map_string;
-  while (true) {
-    iter->block_next();
-    if (iter->block_end()) {
-      iter->fill_next_block();
-    }
-    if (iter->all_end()) {
-      break;
+  auto parallel = std::dynamic_pointer_cast<ParallelScanIterator>(iter);
+  /// the dedups and sketches are keyed by group numbers of a single table
+  bool mergeable = std::none_of(aggrs.begin(), aggrs.end(), [](auto aggr) {
+    return aggr == Aggregator::COUNT_DISTINCT ||
+           aggr == Aggregator::APPROX_COUNT_DISTINCT;
+  });
+  if (parallel != nullptr && mergeable) {
+    if (build_parallel(parallel)) {
+      return;
     }
-    int pos = 0;
-    const uint8_t *const o = iter->get();
-    if (group_by_field != nullptr) {
-      switch (group_by_field->datatype->type) {
-      case DataType::INT:
-      case DataType::DATE: {
-        IntType::DType val =
-            *(const IntType::DType *)(o + group_by_field_offset);
-        if (map_int.contains(val)) {
-          pos = map_int[val];
-        } else {
-          pos = map_int[val] = assign_page();
-        }
-        break;
+    /// too many groups for the workers, the serial build can spill
+    parallel->reset_all();
+  }
+  if (auto scan = std::dynamic_pointer_cast<VectorScanIterator>(iter)) {
+    build_batched(scan);
+  } else {
+    group_keys.resize(group_key_len);
+    while (true) {
+      iter->block_next();
+      if (iter->block_end()) {
+        iter->fill_next_block();
       }
-      case DataType::FLOAT: {
-        FloatType::DType val =
-            *(const FloatType::DType *)(o + group_by_field_offset);
-        if (map_float.contains(val)) {
-          pos = map_float[val];
-        } else {
-          pos = map_float[val] = assign_page();
-        }
+      if (iter->all_end()) {
         break;
       }
-      case DataType::VARCHAR: {
-        std::string val((const char *)(o + group_by_field_offset));
-        if (map_string.contains(val)) {
-          pos = map_string[val];
-        } else {
-          pos = map_string[val] = assign_page();
+      const uint8_t *const o = iter->get();
+      int group = 0;
+      if (!group_columns.empty()) {
+        pack_key(o, group_keys.data());
+        uint64_t h = GroupTable::hash(group_keys.data(), group_key_len);
+        if ((group = find_group(group_keys.data(), h)) == -1) {
+          set_aside(o, h);
+          continue;
         }
-        break;
-      }
-      default:
-        assert(false);
       }
+      update(groups->state(group), group, o);
+    }
+  }
+  finish_pass();
+  aggregate_partitions();
+  n_records = finished.first == -1 ? groups->size() : finished.second;
+}
+
+void AggregateIterator::finish_pass() {
+  /// the distinct values the dedups set aside
+  int offset = 0;
+  for (size_t i = 0; i < caster.size(); ++i) {
+    if (distinct[i] != nullptr) {
+      distinct[i]->drain([&](const uint8_t *key) {
+        int group;
+        memcpy(&group, key, sizeof(int));
+        ++*(count_t *)(groups->state(group) + offset);
+      });
+    }
+    /// the estimates stand in for the counts from here on
+    for (int g = 0; g < (int)sketches[i].size(); ++g) {
+      *(count_t *)(groups->state(g) + offset) =
+          (count_t)std::llround(sketches[i][g].estimate());
     }
-    uint8_t *ptr = PagedBuffer::get()->read_file_rdwr(
-        std::make_pair(fd, pos / record_per_page));
-    ptr += pos % record_per_page * record_len;
-    update(ptr, o);
+    std::vector<HyperLogLog>().swap(sketches[i]);
+    offset += sizeof(count_t) + caster[i].len;
+  }
+  sketch_memory = 0;
+  if (partitions == nullptr && finished.first == -1) {
+    return;
+  }
+  if (finished.first == -1) {
+    finished.first = FileMapping::get()->create_temp_file();
+  }
+  for (int g = 0; g < groups->size(); ++g) {
+    append_record(finished, groups->state(g), record_len);
+  }
+  spilled_bytes += (uint64_t)groups->size() * record_len;
+  groups->clear();
+  /// group numbers start over, so do the dedups keyed by them
+  for (size_t i = 0; i < caster.size(); ++i) {
+    if (distinct[i] != nullptr) {
+      int len = fields_src[caster[i].idx]->get_size();
+      distinct[i] =
+          std::make_unique<HashDedup>(round_to_word(sizeof(int) + len));
+    }
+  }
+}
+
+void AggregateIterator::aggregate_partitions() {
+  if (partitions == nullptr) {
+    return;
+  }
+  auto parts = std::move(partitions);
+  ++level;
+  group_keys.resize(std::max<size_t>(group_keys.size(), group_key_len));
+  for (int p = 0; p < SpillPartitions::FAN_OUT; ++p) {
+    if (parts->count(p) == 0) {
+      continue;
+    }
+    parts->drain(p, [&](const uint8_t *row) {
+      pack_key(row, group_keys.data());
+      uint64_t h = GroupTable::hash(group_keys.data(), group_key_len);
+      int group = find_group(group_keys.data(), h);
+      if (group == -1) {
+        set_aside(row, h);
+      } else {
+        update(groups->state(group), group, row);
+      }
+    });
+    finish_pass();
+    aggregate_partitions();
   }
+  --level;
 }
 
 const uint8_t *AggregateIterator::get() const { return buffer.data(); }
@@ -785,26 +2276,39 @@ bool AggregateIterator::get_next_valid() {
     build();
   } else {
     iter_dst++;
-    if (iter_dst >= n_records)
-      return false;
   }
+  /// GROUP BY over no rows has no groups
+  if (iter_dst >= n_records)
+    return false;
   buffer.resize(export_len);
   uint8_t *ptr = buffer.data();
   bitmap_t mask = (1 << (sizeof(bitmap_t) << 3)) - 1;
   ptr += sizeof(bitmap_t);
-  uint8_t *ptr_raw = PagedBuffer::get()->read_file_rd(
-      std::make_pair(fd, iter_dst / record_per_page));
-  ptr_raw += iter_dst % record_per_page * record_len;
+  const uint8_t *ptr_raw;
+  if (!merged.empty()) {
+    ptr_raw = merged.data() + (size_t)iter_dst * record_len;
+  } else if (finished.first == -1) {
+    ptr_raw = groups->state(iter_dst);
+  } else {
+    ptr_raw = PagedBuffer::get()->read_file_rd(
+                  std::make_pair(finished.first, iter_dst / record_per_page)) +
+              iter_dst % record_per_page * record_len;
+  }
   for (size_t i = 0; i < caster.size(); ++i) {
     auto aggr = aggrs[i];
     count_t cnt = *(count_t *)ptr_raw;
     if (aggr == Aggregator::COUNT) {
       /// COUNT(*)
+      *(IntType::DType *)ptr =
+          scale == 1 ? cnt : (IntType::DType)std::llround(cnt * scale);
+      ptr += sizeof(IntType::DType);
+    } else if (aggr == Aggregator::COUNT_DISTINCT ||
+               aggr == Aggregator::APPROX_COUNT_DISTINCT) {
+      /// distinct values do not grow with the sample
       *(IntType::DType *)ptr = cnt;
       ptr += sizeof(IntType::DType);
-    } else if (cnt == 0 &&
-               (aggr == Aggregator::MIN || aggr == Aggregator::MAX ||
-                aggr == Aggregator::AVG)) {
+    } else if (cnt == 0) {
+      /// MIN, MAX and AVG of no values, or the NULL group's key
       mask &= ~(1 << i);
       ptr += caster[i].len;
     } else if (aggr == Aggregator::AVG) {
@@ -816,6 +2320,15 @@ bool AggregateIterator::get_next_valid() {
       }
       *(FloatType::DType *)ptr = value;
       ptr += sizeof(FloatType::DType);
+    } else if (aggr == Aggregator::SUM && scale != 1) {
+      if (caster[i].type == DataType::INT) {
+        *(IntType::DType *)ptr = (IntType::DType)std::llround(
+            *(IntType::DType *)(ptr_raw + sizeof(count_t)) * scale);
+      } else {
+        *(FloatType::DType *)ptr =
+            *(FloatType::DType *)(ptr_raw + sizeof(count_t)) * scale;
+      }
+      ptr += caster[i].len;
     } else {
       memcpy(ptr, ptr_raw + sizeof(count_t), caster[i].len);
       ptr += caster[i].len;
@@ -827,46 +2340,366 @@ bool AggregateIterator::get_next_valid() {
   return true;
 }
 
-int AggregateIterator::assign_page() {
-  if (n_records % record_per_page == 0) {
-    auto ptr = PagedBuffer::get()->read_file_rdwr(
-        std::make_pair(fd, n_records / record_per_page));
-    memset(ptr, 0, Config::PAGE_SIZE);
+HashDedup::HashDedup(int key_len, int level)
+    : key_len(key_len), level(level), table(key_len, 0) {}
+
+bool HashDedup::insert(const uint8_t *key) {
+  uint64_t h = GroupTable::hash(key, key_len);
+  if (partitions == nullptr) {
+    int n = table.size();
+    if (table.find_or_insert(key, h) < n) {
+      return false;
+    }
+    if (table.memory() > Config::get()->hash_memory &&
+        SpillPartitions::allowed(key_len, level)) {
+      partitions = std::make_unique<SpillPartitions>(key_len, level);
+    }
+    return true;
+  }
+  if (table.find(key, h) != -1) {
+    return false;
+  }
+  partitions->append(key, h);
+  return false;
+}
+
+void HashDedup::drain(const std::function<void(const uint8_t *)> &visit) {
+  if (partitions == nullptr) {
+    return;
+  }
+  for (int p = 0; p < SpillPartitions::FAN_OUT; ++p) {
+    if (partitions->count(p) == 0) {
+      continue;
+    }
+    HashDedup part(key_len, level + 1);
+    partitions->drain(p, [&](const uint8_t *key) {
+      if (part.insert(key)) {
+        visit(key);
+      }
+    });
+    part.drain(visit);
+  }
+  partitions.reset();
+}
+
+DistinctIterator::DistinctIterator(std::shared_ptr<Iterator> iterator)
+    : GatherIterator(IteratorType::DISTINCT), iter(iterator) {
+  fields_src = iterator->get_fields_dst();
+  fields_dst = fields_src;
+  record_len = sizeof(bitmap_t);
+  for (auto field : fields_src) {
+    record_len += field->get_size();
+  }
+  key_len = round_to_word(record_len);
+  record_per_page = Config::PAGE_SIZE / record_len;
+  fd = FileMapping::get()->create_temp_file();
+}
+
+DistinctIterator::~DistinctIterator() {
+  FileMapping::get()->close_temp_file(fd);
+}
+
+void DistinctIterator::append(const uint8_t *row) {
+  std::pair<int, int> out(fd, n_records);
+  append_record(out, row, record_len);
+  n_records = out.second;
+}
+
+void DistinctIterator::build() {
+  if (built)
+    return;
+  built = true;
+  HashDedup dedup(key_len);
+  std::vector<uint8_t> key(key_len);
+  while (iter->get_next_valid()) {
+    /// the row with NULL fields and string tails zeroed
+    const uint8_t *record = iter->get();
+    bitmap_t bitmap = *(const bitmap_t *)record &
+                      (bitmap_t)((1u << fields_src.size()) - 1);
+    memset(key.data(), 0, key_len);
+    memcpy(key.data(), &bitmap, sizeof(bitmap_t));
+    int offset = sizeof(bitmap_t);
+    for (size_t i = 0; i < fields_src.size(); ++i) {
+      int width = fields_src[i]->get_size();
+      if ((bitmap >> i) & 1) {
+        pack_value(key.data() + offset, fields_src[i]->datatype->type,
+                   record + offset, width);
+      }
+      offset += width;
+    }
+    if (dedup.insert(key.data())) {
+      append(key.data());
+    }
+  }
+  dedup.drain([this](const uint8_t *row) { append(row); });
+}
+
+const uint8_t *DistinctIterator::get() const {
+  return PagedBuffer::get()->read_file_rd(
+             std::make_pair(fd, iter_dst / record_per_page)) +
+         iter_dst % record_per_page * record_len;
+}
+
+bool DistinctIterator::get_next_valid() {
+  if (!built) {
+    build();
+  } else {
+    iter_dst++;
+  }
+  return iter_dst < n_records;
+}
+
+MetaAggregateIterator::MetaAggregateIterator(
+    std::shared_ptr<RecordManager> record_manager_,
+    std::vector<Source> &&sources_, int lbound_, int rbound_,
+    const std::vector<std::shared_ptr<Field>> &fields_dst_)
+    : GatherIterator(IteratorType::META_AGGREGATE),
+      record_manager(record_manager_), sources(std::move(sources_)),
+      lbound(lbound_), rbound(rbound_) {
+  record_len = sizeof(bitmap_t);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (sources[i].aggr == Aggregator::COUNT) {
+      auto fake = std::shared_ptr<Field>(new Field(get_unified_id()));
+      fake->datatype = DataTypeBase::build(DataType::INT);
+      fields_dst.push_back(fake);
+    } else {
+      fields_dst.push_back(fields_dst_[i]);
+    }
+    record_len += fields_dst.back()->get_size();
+  }
+}
+
+void MetaAggregateIterator::build() {
+  if (built)
+    return;
+  built = true;
+  buffer.assign(record_len, 0);
+  bitmap_t mask = 0;
+  uint8_t *ptr = buffer.data() + sizeof(bitmap_t);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    auto [aggr, index, null_index] = sources[i];
+    auto not_null = [=](const uint8_t *record) {
+      return (*(const bitmap_t *)record >> null_index) & 1;
+    };
+    IntType::DType value = 0;
+    bool found = false;
+    if (aggr == Aggregator::COUNT) {
+      found = true;
+      if (index == nullptr) {
+        value = record_manager->get_record_num();
+      } else {
+        index->scan_range(lbound, rbound, false,
+                          [&](int *, const uint8_t *record) {
+                            value += not_null(record);
+                            return true;
+                          });
+      }
+    } else {
+      index->scan_range(lbound, rbound, aggr == Aggregator::MAX,
+                        [&](int *entry, const uint8_t *record) {
+                          found = not_null(record);
+                          value = entry[0];
+                          return !found;
+                        });
+    }
+    if (found) {
+      mask |= 1 << i;
+      *(IntType::DType *)ptr = value;
+    }
+    ptr += fields_dst[i]->get_size();
+  }
+  *(bitmap_t *)buffer.data() = mask;
+}
+
+const uint8_t *MetaAggregateIterator::get() const { return buffer.data(); }
+
+bool MetaAggregateIterator::get_next_valid() {
+  if (built) {
+    return false;
   }
-  return n_records++;
+  build();
+  return true;
 }
 
-SortIterator::SortIterator(std::shared_ptr<Iterator> iterator,
-                           std::shared_ptr<Field> sort_by_field, bool desc)
-    : GatherIterator(IteratorType::SORT), desc(desc), iter(iterator) {
+SortIterator::SortIterator(
+    std::shared_ptr<Iterator> iterator,
+    const std::vector<std::pair<std::shared_ptr<Field>, bool>> &order_by)
+    : GatherIterator(IteratorType::SORT), iter(iterator) {
   if (std::dynamic_pointer_cast<BlockIterator>(iterator) != nullptr) {
     assert(false);
   }
-  sort_by_field_type = sort_by_field->datatype->type;
   fields_src = iterator->get_fields_dst();
-  fd = FileMapping::get()->create_temp_file();
   fields_dst = fields_src;
-  int offset = sizeof(bitmap_t);
-  sort_by_field_index = -1;
-  for (size_t i = 0; i < fields_src.size(); ++i) {
-    if (fields_src[i] != nullptr &&
-        fields_src[i]->field_id == sort_by_field->field_id) {
-      sort_by_field_index = i;
-      sort_by_field_offset = offset;
+  record_len = row_size(fields_src, {});
+  key_len = row_size({}, order_by) - sizeof(bitmap_t);
+  run_len = key_len + record_len;
+  record_per_page = Config::PAGE_SIZE / run_len;
+  for (auto [field, desc] : order_by) {
+    int offset = sizeof(bitmap_t), index = -1;
+    for (size_t i = 0; i < fields_src.size() && index == -1; ++i) {
+      if (fields_src[i]->field_id == field->field_id) {
+        index = i;
+      } else {
+        offset += fields_src[i]->get_size();
+      }
+    }
+    if (index == -1) {
+      has_err = true;
+      printf("ERROR: sort_by_field must appear in selectors.\n");
+      return;
     }
-    offset += fields_src[i]->get_size();
+    columns.push_back((sort_column){field->datatype->type, desc, index, offset,
+                                    field->get_size()});
   }
-  if (sort_by_field_index == -1) {
-    has_err = true;
-    printf("ERROR: sort_by_field must appear in selectors.\n");
-    return;
+}
+
+SortIterator::~SortIterator() {
+  for (auto [fd, _] : runs) {
+    FileMapping::get()->close_temp_file(fd);
   }
-  record_len = offset;
-  record_per_page = Config::PAGE_SIZE / record_len;
 }
 
-inline bool null_check(const uint8_t *p, int pos) {
-  return ((*(const bitmap_t *)p) >> pos) & 1;
+int SortIterator::row_size(
+    const std::vector<std::shared_ptr<Field>> &fields,
+    const std::vector<std::pair<std::shared_ptr<Field>, bool>> &order_by) {
+  /// the record, then the key and its tie-breaking position
+  int len = sizeof(bitmap_t);
+  for (auto field : fields) {
+    len += field->get_size();
+  }
+  for (auto [field, desc] : order_by) {
+    len += 1 + field->get_size();
+  }
+  return len + (order_by.empty() ? 0 : sizeof(int));
+}
+
+template <typename T> static void store_big_endian(uint8_t *dst, T x) {
+  for (int i = sizeof(T) - 1; i >= 0; --i, x >>= 8) {
+    dst[i] = x & 0xff;
+  }
+}
+
+void SortIterator::encode(const uint8_t *record, int pos, uint8_t *key) const {
+  bitmap_t bitmap = *(const bitmap_t *)record;
+  for (auto &column : columns) {
+    uint8_t *dst = key;
+    *dst++ = (bitmap >> column.index) & 1;
+    memset(dst, 0, column.width);
+    if (key[0]) {
+      const uint8_t *val = record + column.offset;
+      switch (column.type) {
+      case DataType::INT:
+      case DataType::DATE:
+        /// flipping the sign bit makes two's complement order unsigned
+        store_big_endian(dst,
+                         std::bit_cast<uint32_t>(*(const IntType::DType *)val) ^
+                             0x80000000u);
+        break;
+      case DataType::FLOAT: {
+        /// negatives have every bit inverted, the rest only the sign bit
+        uint64_t bits = std::bit_cast<uint64_t>(
+            *(const FloatType::DType *)val + 0.0);
+        store_big_endian(dst, bits >> 63 ? ~bits : bits | 1ull << 63);
+        break;
+      }
+      case DataType::VARCHAR:
+        memcpy(dst, val, strnlen((const char *)val, column.width));
+        break;
+      default:
+        assert(false);
+      }
+    }
+    if (column.desc) {
+      for (int i = 0; i <= column.width; ++i) {
+        key[i] = ~key[i];
+      }
+    }
+    key += 1 + column.width;
+  }
+  uint32_t tie = pos;
+  store_big_endian(key, columns.back().desc ? ~tie : tie);
+}
+
+void SortIterator::sort_rows() {
+  /// LSD radix sort on the first 8 key bytes, a pass per byte, then the
+  /// rows sharing a prefix by the rest of their keys. a shorter key, of a
+  /// single VARCHAR(1) say, is zero padded and sorted by the prefix alone
+  const uint8_t *base = rows.data();
+  size_t n = rows.size() / run_len;
+  int prefix_len = std::min(8, key_len);
+  std::vector<std::pair<uint64_t, int>> entries(n), buffer(n);
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t prefix = 0;
+    for (int j = 0; j < 8; ++j) {
+      prefix = prefix << 8 | (j < prefix_len ? base[i * run_len + j] : 0);
+    }
+    entries[i] = {prefix, i};
+  }
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t count[257] = {};
+    for (auto [prefix, _] : entries) {
+      ++count[(prefix >> shift & 0xff) + 1];
+    }
+    if (std::find(count + 1, count + 257, n) != count + 257) {
+      continue;
+    }
+    for (int b = 0; b < 256; ++b) {
+      count[b + 1] += count[b];
+    }
+    for (auto entry : entries) {
+      buffer[count[entry.first >> shift & 0xff]++] = entry;
+    }
+    entries.swap(buffer);
+  }
+  auto suffix_less = [=, this](const std::pair<uint64_t, int> &a,
+                               const std::pair<uint64_t, int> &b) {
+    return memcmp(base + (size_t)a.second * run_len + 8,
+                  base + (size_t)b.second * run_len + 8, key_len - 8) < 0;
+  };
+  for (size_t i = 0, j; i < n && key_len > 8; i = j) {
+    for (j = i + 1; j < n && entries[j].first == entries[i].first; ++j)
+      ;
+    if (j - i > 1) {
+      std::sort(entries.begin() + i, entries.begin() + j, suffix_less);
+    }
+  }
+  order.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    order[i] = entries[i].second;
+  }
+}
+
+void SortIterator::spill_rows() {
+  std::pair<int, int> run(FileMapping::get()->create_temp_file(), 0);
+  for (int i : order) {
+    append_record(run, rows.data() + (size_t)i * run_len, run_len);
+  }
+  spilled_bytes += (uint64_t)run.second * run_len;
+  runs.push_back(run);
+  rows.clear();
+  order.clear();
+}
+
+bool SortIterator::load_head(int first, int i) {
+  auto [fd, n] = runs[first + i];
+  int pos = run_pos[i]++;
+  if (pos == n) {
+    return false;
+  }
+  const uint8_t *ptr = PagedBuffer::get()->read_file_rd(
+      std::make_pair(fd, pos / record_per_page));
+  memcpy(heads.data() + i * run_len, ptr + pos % record_per_page * run_len,
+         run_len);
+  return true;
+}
+
+void SortIterator::start_merge(int first, int count) {
+  run_pos.assign(count, 0);
+  heads.resize((size_t)count * run_len);
+  for (int i = 0; i < count; ++i) {
+    load_head(first, i);
+  }
+  tree = std::make_unique<LoserTree<HeadLess>>(count, HeadLess{this});
 }
 
 void SortIterator::build() {
@@ -874,91 +2707,92 @@ void SortIterator::build() {
     return;
   built = true;
   while (iter->get_next_valid()) {
+    if (rows.size() + run_len > (size_t)QUERY_MAX_BLOCK) {
+      sort_rows();
+      spill_rows();
+    }
+    rows.resize(rows.size() + run_len);
+    uint8_t *dst = rows.data() + rows.size() - run_len;
     const uint8_t *ptr = iter->get();
-    uint8_t *ptr_dst = PagedBuffer::get()->read_file_rdwr(
-        std::make_pair(fd, n_records / record_per_page));
-    ptr_dst += (n_records % record_per_page) * record_len;
-    memcpy(ptr_dst, ptr, record_len);
+    encode(ptr, n_records, dst);
+    memcpy(dst + key_len, ptr, record_len);
     ++n_records;
   }
-  uint8_t *ptr = nullptr;
-  sorted.reserve(n_records);
-  for (int i = 0; i < n_records; i++) {
-    if (i % record_per_page == 0) {
-      ptr = PagedBuffer::get()->read_file_rd(
-          std::make_pair(fd, i / record_per_page));
-    }
-    uint8_t *ptr_cur = ptr + (i % record_per_page) * record_len;
-    sorted.push_back(sort_t(i, ptr_cur));
-  }
-  fprintf(stderr, "sort %d records\n", (int)sorted.size());
-  const bool desc = this->desc;
-  const int sort_by_field_index = this->sort_by_field_index;
-  const int sort_by_field_offset = this->sort_by_field_offset;
-  const DataType sort_by_field_type = this->sort_by_field_type;
-  std::sort(sorted.begin(), sorted.end(),
-            [=](const sort_t &a, const sort_t &b) {
-              const uint8_t *ptr_a = a.second;
-              const uint8_t *ptr_b = b.second;
-              bool na = null_check(ptr_a, sort_by_field_index);
-              bool nb = null_check(ptr_b, sort_by_field_index);
-              if (na == 0 && nb == 0) {
-                return desc ? a.first > b.first : a.first < b.first;
-              }
-              if (na == 0) {
-                return !desc;
-              }
-              if (nb == 0) {
-                return desc;
-              }
-              switch (sort_by_field_type) {
-              case DataType::INT:
-              case DataType::DATE: {
-                IntType::DType val_a =
-                    *(const IntType::DType *)(ptr_a + sort_by_field_offset);
-                IntType::DType val_b =
-                    *(const IntType::DType *)(ptr_b + sort_by_field_offset);
-                if (val_a == val_b) {
-                  return desc ? a.first > b.first : a.first < b.first;
-                }
-                return desc ? val_a > val_b : val_a < val_b;
-              }
-              case DataType::FLOAT: {
-                FloatType::DType val_a =
-                    *(const FloatType::DType *)(ptr_a + sort_by_field_offset);
-                FloatType::DType val_b =
-                    *(const FloatType::DType *)(ptr_b + sort_by_field_offset);
-                if (val_a == val_b) {
-                  return desc ? a.first > b.first : a.first < b.first;
-                }
-                return desc ? val_a > val_b : val_a < val_b;
-              }
-              case DataType::VARCHAR: {
-                auto cmp = strcmp((const char *)(ptr_a + sort_by_field_offset),
-                                  (const char *)(ptr_b + sort_by_field_offset));
-                if (cmp == 0) {
-                  return desc ? a.first > b.first : a.first < b.first;
-                }
-                return desc ? cmp > 0 : cmp < 0;
-              }
-              default:
-                assert(false);
-              }
-            });
+  sort_rows();
+  if (runs.empty()) {
+    return;
+  }
+  spill_rows();
+  /// merge the oldest runs into longer ones until a single pass is left
+  while (runs.size() > (size_t)SORT_MAX_FAN_IN) {
+    start_merge(0, SORT_MAX_FAN_IN);
+    std::pair<int, int> run(FileMapping::get()->create_temp_file(), 0);
+    for (int i; (i = tree->top()) != -1;) {
+      append_record(run, heads.data() + i * run_len, run_len);
+      tree->replay(!load_head(0, i));
+    }
+    spilled_bytes += (uint64_t)run.second * run_len;
+    for (int i = 0; i < SORT_MAX_FAN_IN; ++i) {
+      FileMapping::get()->close_temp_file(runs[i].first);
+    }
+    runs.erase(runs.begin(), runs.begin() + SORT_MAX_FAN_IN);
+    runs.push_back(run);
+  }
+  start_merge(0, runs.size());
 }
 
 const uint8_t *SortIterator::get() const {
-  auto idx = sorted[iter_dst].first;
-  auto ptr = PagedBuffer::get()->read_file_rd(
-      std::make_pair(fd, idx / record_per_page));
-  return ptr + (idx % record_per_page) * record_len;
+  if (runs.empty()) {
+    return rows.data() + (size_t)order[iter_dst] * run_len + key_len;
+  }
+  return heads.data() + tree->top() * run_len + key_len;
 }
 
 bool SortIterator::get_next_valid() {
   if (!built) {
     build();
   } else {
+    if (!runs.empty() && iter_dst < n_records) {
+      tree->replay(!load_head(0, tree->top()));
+    }
     iter_dst++;
   }
   return iter_dst < n_records;
-}
\ No newline at end of file
+}
+
+TopKIterator::TopKIterator(
+    std::shared_ptr<Iterator> iterator,
+    const std::vector<std::pair<std::shared_ptr<Field>, bool>> &order_by,
+    int k)
+    : SortIterator(iterator, order_by), k(std::max(k, 1)) {}
+
+void TopKIterator::build() {
+  if (built)
+    return;
+  built = true;
+  /// k slots and a scratch one for the row being read
+  rows.resize((size_t)(k + 1) * run_len);
+  auto slot = [this](int i) { return rows.data() + (size_t)i * run_len; };
+  uint8_t *scratch = slot(k);
+  /// a max-heap of slots, the last row of the order kept so far on top
+  auto before = [&](int a, int b) {
+    return memcmp(slot(a), slot(b), key_len) < 0;
+  };
+  for (int pos = 0; iter->get_next_valid(); ++pos) {
+    const uint8_t *ptr = iter->get();
+    encode(ptr, pos, scratch);
+    if ((int)order.size() < k) {
+      memcpy(slot(order.size()), scratch, key_len);
+      memcpy(slot(order.size()) + key_len, ptr, record_len);
+      order.push_back(order.size());
+      std::push_heap(order.begin(), order.end(), before);
+    } else if (memcmp(scratch, slot(order.front()), key_len) < 0) {
+      std::pop_heap(order.begin(), order.end(), before);
+      memcpy(slot(order.back()), scratch, key_len);
+      memcpy(slot(order.back()) + key_len, ptr, record_len);
+      std::push_heap(order.begin(), order.end(), before);
+    }
+  }
+  std::sort_heap(order.begin(), order.end(), before);
+  n_records = order.size();
+}
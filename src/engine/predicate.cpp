@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+
+#include <engine/field.h>
+#include <engine/predicate.h>
+#include <engine/query.h>
+
+using Term = Conjunction::Term;
+using IType = IntType::DType;
+using FType = FloatType::DType;
+
+static bool never(const Term &, const uint8_t *) { return false; }
+
+static bool int_range(const Term &t, const uint8_t *record) {
+  /// lo <= x <= hi, in one unsigned comparison
+  uint32_t x = *(const IType *)(record + t.offset);
+  return x - (uint32_t)t.lo <= (uint32_t)t.hi - (uint32_t)t.lo;
+}
+
+static bool int_not_equal(const Term &t, const uint8_t *record) {
+  return *(const IType *)(record + t.offset) != t.lo;
+}
+
+static bool int_in(const Term &t, const uint8_t *record) {
+  IType x = *(const IType *)(record + t.offset);
+  return std::binary_search(t.vals.begin(), t.vals.end(), x);
+}
+
+struct FloatValue {
+  template <Operator op>
+  static bool test(const Term &t, const uint8_t *record) {
+    return compare_op<op>(*(const FType *)(record + t.offset), t.value_float);
+  }
+};
+
+struct StringValue {
+  template <Operator op>
+  static bool test(const Term &t, const uint8_t *record) {
+    return compare_op<op>(
+        strcmp((const char *)record + t.offset, t.value_str.data()), 0);
+  }
+};
+
+template <typename T> struct NumericColumns {
+  template <Operator op>
+  static bool test(const Term &t, const uint8_t *record) {
+    return compare_op<op>(*(const T *)(record + t.offset),
+                          *(const T *)(record + t.offset_o));
+  }
+};
+
+struct StringColumns {
+  template <Operator op>
+  static bool test(const Term &t, const uint8_t *record) {
+    return compare_op<op>(strcmp((const char *)record + t.offset,
+                                 (const char *)record + t.offset_o),
+                          0);
+  }
+};
+
+/// the instance of K::test for op
+template <typename K> static Conjunction::Kernel pick(Operator op) {
+  switch (op) {
+  case Operator::EQ:
+    return &K::template test<Operator::EQ>;
+  case Operator::LT:
+    return &K::template test<Operator::LT>;
+  case Operator::LE:
+    return &K::template test<Operator::LE>;
+  case Operator::GT:
+    return &K::template test<Operator::GT>;
+  case Operator::GE:
+    return &K::template test<Operator::GE>;
+  case Operator::NE:
+    return &K::template test<Operator::NE>;
+  }
+  return never;
+}
+
+Conjunction::Conjunction(
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+    const std::vector<std::shared_ptr<Field>> &fields) {
+  /// INT and DATE comparisons by column offset, narrowed to [lo, hi]
+  std::map<int, std::pair<int64_t, int64_t>> ranges;
+  auto add_value = [&](const ValueComparison &cmp) {
+    present |= 1 << cmp.column_index;
+    Term term{};
+    term.offset = cmp.column_offset;
+    switch (cmp.dtype) {
+    case DataType::INT:
+    case DataType::DATE: {
+      if (cmp.cmp_op == Operator::NE) {
+        term.test = int_not_equal;
+        term.lo = cmp.value;
+        break;
+      }
+      auto [it, fresh] =
+          ranges.try_emplace(cmp.column_offset, INT_MIN, INT_MAX);
+      auto &[lo, hi] = it->second;
+      int64_t v = cmp.value;
+      if (cmp.cmp_op & Operator::GT) {
+        lo = std::max(lo, cmp.cmp_op & Operator::EQ ? v : v + 1);
+      }
+      if (cmp.cmp_op & Operator::LT) {
+        hi = std::min(hi, cmp.cmp_op & Operator::EQ ? v : v - 1);
+      }
+      if (cmp.cmp_op == Operator::EQ) {
+        lo = std::max(lo, v);
+        hi = std::min(hi, v);
+      }
+      return;
+    }
+    case DataType::FLOAT:
+      term.test = pick<FloatValue>(cmp.cmp_op);
+      term.value_float = cmp.value_float;
+      break;
+    default:
+      term.test = pick<StringValue>(cmp.cmp_op);
+      term.value_str = cmp.value_str;
+    }
+    terms.push_back(std::move(term));
+  };
+  auto add_in = [&](int index, int offset, const std::set<int> &vals) {
+    present |= 1 << index;
+    Term term{};
+    term.test = int_in;
+    term.offset = offset;
+    term.vals.assign(vals.begin(), vals.end());
+    terms.push_back(std::move(term));
+  };
+  auto field_of = [&](unified_id_t field_id) -> std::shared_ptr<Field> {
+    for (auto field : fields) {
+      if (field->field_id == field_id) {
+        return field;
+      }
+    }
+    return nullptr;
+  };
+
+  for (auto con : cons) {
+    if (auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con)) {
+      add_value(*cov);
+    } else if (auto cos =
+                   std::dynamic_pointer_cast<ColumnOpSubqueryConstraint>(con)) {
+      add_value(*cos);
+    } else if (auto cnc =
+                   std::dynamic_pointer_cast<ColumnNullConstraint>(con)) {
+      (cnc->not_null ? present : absent) |= 1 << cnc->column_index;
+    } else if (auto cil =
+                   std::dynamic_pointer_cast<ColumnInListConstraint>(con);
+               cil != nullptr && cil->column_offset != -1) {
+      add_in(cil->column_index, cil->column_offset, cil->vals_int);
+    } else if (auto cis =
+                   std::dynamic_pointer_cast<ColumnInSubqueryConstraint>(con);
+               cis != nullptr && cis->column_offset != -1) {
+      add_in(cis->column_index, cis->column_offset, cis->vals_int);
+    } else if (auto coc =
+                   std::dynamic_pointer_cast<ColumnOpColumnConstraint>(con);
+               coc != nullptr && field_of(coc->field_id1) != nullptr &&
+               field_of(coc->field_id2) != nullptr) {
+      /// two columns of the same record
+      auto lhs = field_of(coc->field_id1), rhs = field_of(coc->field_id2);
+      present |= (1 << lhs->pers_index) | (1 << rhs->pers_index);
+      Term term{};
+      term.offset = lhs->pers_offset;
+      term.offset_o = rhs->pers_offset;
+      switch (coc->dtype) {
+      case DataType::INT:
+      case DataType::DATE:
+        term.test = pick<NumericColumns<IType>>(coc->optype);
+        break;
+      case DataType::FLOAT:
+        term.test = pick<NumericColumns<FType>>(coc->optype);
+        break;
+      default:
+        term.test = pick<StringColumns>(coc->optype);
+      }
+      terms.push_back(std::move(term));
+    } else {
+      residual.push_back(con);
+    }
+  }
+
+  /// the ranges are the cheapest terms, they go first
+  std::vector<Term> range_terms;
+  for (auto [offset, range] : ranges) {
+    auto [lo, hi] = range;
+    if (lo > hi) {
+      terms = {Term{never}};
+      residual.clear();
+      return;
+    }
+    if (lo == INT_MIN && hi == INT_MAX) {
+      continue;
+    }
+    Term term{};
+    term.test = int_range;
+    term.offset = offset;
+    term.lo = lo;
+    term.hi = hi;
+    range_terms.push_back(std::move(term));
+  }
+  terms.insert(terms.begin(), std::make_move_iterator(range_terms.begin()),
+               std::make_move_iterator(range_terms.end()));
+}
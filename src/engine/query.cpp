@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <regex>
 
@@ -31,43 +32,344 @@ inline bool get_compare_result(int val, Operator op) {
   return false;
 }
 
-void QueryPlanner::generate_plan() {
+std::pair<std::shared_ptr<ColumnOpColumnConstraint>,
+          std::shared_ptr<IndexIterator>>
+QueryPlanner::make_lookup(std::shared_ptr<BlockIterator> outer,
+                          std::shared_ptr<TableManager> table,
+                          const std::vector<std::shared_ptr<Field>> &fullset) {
+  const auto &outer_tables = outer->get_table_ids();
+  for (auto con : constraints) {
+    auto col_comp = std::dynamic_pointer_cast<ColumnOpColumnConstraint>(con);
+    if (col_comp == nullptr || col_comp->optype != Operator::EQ) {
+      continue;
+    }
+    for (auto field : table->get_fields()) {
+      unified_id_t other_table;
+      if (field->field_id == col_comp->field_id1) {
+        other_table = col_comp->table_id_other;
+      } else if (field->field_id == col_comp->field_id2) {
+        other_table = col_comp->table_id;
+      } else {
+        continue;
+      }
+      if (!outer_tables.contains(other_table)) {
+        continue;
+      }
+      auto lookup = table->make_keyed_iterator(constraints, fullset, field);
+      if (lookup != nullptr) {
+        return {col_comp, lookup};
+      }
+    }
+  }
+  return {nullptr, nullptr};
+}
+
+std::tuple<std::shared_ptr<ColumnOpColumnConstraint>,
+           std::shared_ptr<IndexIterator>, std::shared_ptr<IndexIterator>>
+QueryPlanner::make_merge(std::shared_ptr<TableManager> lhs,
+                         std::shared_ptr<TableManager> rhs,
+                         const std::vector<std::shared_ptr<Field>> &fullset) {
+  auto find = [](std::shared_ptr<TableManager> table, unified_id_t field_id) {
+    std::shared_ptr<Field> ret = nullptr;
+    for (auto field : table->get_fields()) {
+      if (field->field_id == field_id) {
+        ret = field;
+      }
+    }
+    return ret;
+  };
+  for (auto con : constraints) {
+    auto col_comp = std::dynamic_pointer_cast<ColumnOpColumnConstraint>(con);
+    if (col_comp == nullptr || col_comp->optype != Operator::EQ) {
+      continue;
+    }
+    auto field_lhs = find(lhs, col_comp->field_id1);
+    auto field_rhs = find(rhs, col_comp->field_id2);
+    if (field_lhs == nullptr || field_rhs == nullptr) {
+      field_lhs = find(lhs, col_comp->field_id2);
+      field_rhs = find(rhs, col_comp->field_id1);
+    }
+    if (field_lhs == nullptr || field_rhs == nullptr) {
+      continue;
+    }
+    auto scan_lhs =
+        lhs->make_keyed_iterator(constraints, fullset, field_lhs, true);
+    auto scan_rhs =
+        rhs->make_keyed_iterator(constraints, fullset, field_rhs, true);
+    if (scan_lhs != nullptr && scan_rhs != nullptr) {
+      return {col_comp, scan_lhs, scan_rhs};
+    }
+  }
+  return {nullptr, nullptr, nullptr};
+}
+
+/// left-deep orders are searched exhaustively up to this many tables
+static const int JOIN_DP_MAX_TABLES = 10;
+
+void QueryPlanner::order_tables() {
   std::sort(tables.begin(), tables.end(), cmp);
-  if (group_by_field != nullptr && !selector->has_aggregate) {
+  int n = tables.size();
+  std::vector<double> scan_rows(n);
+  table_rows.resize(n);
+  for (int i = 0; i < n; ++i) {
+    scan_rows[i] = std::max(tables[i]->get_record_num(), 1);
+    table_rows[i] = std::max(
+        1.0, scan_rows[i] * tables[i]->estimate_selectivity(constraints));
+  }
+  /// constraints between two tables, with the selectivity of each
+  struct edge {
+    int t1, t2;
+    double sel;
+    /// `=` on columns, and whether each side has an index to probe
+    bool eq, keyed1, keyed2;
+  };
+  std::vector<edge> edges;
+  auto locate = [&](unified_id_t field_id, int &t) {
+    for (t = 0; t < n; ++t) {
+      for (auto field : tables[t]->get_fields()) {
+        if (field->field_id == field_id) {
+          return field;
+        }
+      }
+    }
+    return std::shared_ptr<Field>(nullptr);
+  };
+  for (auto con : constraints) {
+    auto col_comp = std::dynamic_pointer_cast<ColumnOpColumnConstraint>(con);
+    if (col_comp == nullptr) {
+      continue;
+    }
+    edge e;
+    auto f1 = locate(col_comp->field_id1, e.t1);
+    auto f2 = locate(col_comp->field_id2, e.t2);
+    if (f1 == nullptr || f2 == nullptr || e.t1 == e.t2) {
+      continue;
+    }
+    e.eq = col_comp->optype == Operator::EQ;
+    double distinct =
+        std::max(tables[e.t1]->estimate_distinct(f1->pers_offset),
+                 tables[e.t2]->estimate_distinct(f2->pers_offset));
+    e.sel = e.eq ? 1 / distinct : 1.0 / 3;
+    e.keyed1 = e.eq && tables[e.t1]->has_keyed_index(f1);
+    e.keyed2 = e.eq && tables[e.t2]->has_keyed_index(f2);
+    edges.push_back(e);
+  }
+  /// rows and cost of joining table t to the tables for which joined(i)
+  /// holds, `rows` rows. the cost counts rows read, probed and produced
+  auto step = [&](auto joined, double rows, int t) {
+    double sel = 1;
+    bool eq = false, keyed = false;
+    for (auto &e : edges) {
+      if ((joined(e.t1) && e.t2 == t) || (joined(e.t2) && e.t1 == t)) {
+        sel *= e.sel;
+        eq |= e.eq;
+        keyed |= e.t1 == t ? e.keyed1 : e.keyed2;
+      }
+    }
+    double out = std::max(1.0, rows * table_rows[t] * sel);
+    double cost = eq ? rows + scan_rows[t] : rows * scan_rows[t];
+    if (keyed && rows * INDEX_JOIN_RATIO < scan_rows[t]) {
+      cost = rows * INDEX_JOIN_RATIO;
+    }
+    return std::make_pair(out, cost + out);
+  };
+
+  std::vector<int> order;
+  if (n <= JOIN_DP_MAX_TABLES) {
+    /// best[mask]: cost, rows and last table of the cheapest order of mask
+    struct plan {
+      double cost{INFINITY}, rows;
+      int last{-1};
+    };
+    std::vector<plan> best(1 << n);
+    for (int t = 0; t < n; ++t) {
+      best[1 << t] = {scan_rows[t], table_rows[t], t};
+    }
+    for (uint32_t mask = 1; mask < (1u << n); ++mask) {
+      if (best[mask].last == -1) {
+        continue;
+      }
+      for (int t = 0; t < n; ++t) {
+        if ((mask >> t) & 1) {
+          continue;
+        }
+        auto [rows, cost] = step([&](int i) { return (mask >> i) & 1; },
+                                 best[mask].rows, t);
+        auto &next = best[mask | (1 << t)];
+        if (best[mask].cost + cost < next.cost) {
+          next = {best[mask].cost + cost, rows, t};
+        }
+      }
+    }
+    for (uint32_t mask = (1u << n) - 1; mask; mask ^= 1 << best[mask].last) {
+      order.push_back(best[mask].last);
+    }
+    std::reverse(order.begin(), order.end());
+  } else {
+    /// start from the smallest filtered table, add the cheapest one each time
+    std::vector<bool> in(n);
+    double rows = 0;
+    for (int i = 0; i < n; ++i) {
+      int pick = -1;
+      std::pair<double, double> pick_step;
+      for (int t = 0; t < n; ++t) {
+        if (in[t]) {
+          continue;
+        }
+        auto cur = i == 0 ? std::make_pair(table_rows[t], scan_rows[t])
+                          : step([&](int j) { return in[j]; }, rows, t);
+        /// the first pick goes by filtered rows, later ones by step cost
+        bool better = i == 0 ? cur.first < pick_step.first
+                             : cur.second < pick_step.second;
+        if (pick == -1 || better) {
+          pick = t;
+          pick_step = cur;
+        }
+      }
+      order.push_back(pick);
+      in[pick] = true;
+      rows = pick_step.first;
+    }
+  }
+
+  std::vector<std::shared_ptr<TableManager>> ordered;
+  std::vector<double> ordered_rows;
+  std::vector<bool> in(n);
+  joined_rows.clear();
+  for (int t : order) {
+    ordered.push_back(tables[t]);
+    ordered_rows.push_back(table_rows[t]);
+    joined_rows.push_back(
+        joined_rows.empty()
+            ? table_rows[t]
+            : step([&](int i) { return in[i]; }, joined_rows.back(), t).first);
+    in[t] = true;
+  }
+  tables = std::move(ordered);
+  table_rows = std::move(ordered_rows);
+}
+
+void QueryPlanner::generate_plan() {
+  order_tables();
+  if (!group_by.empty() && !selector->has_aggregate) {
     printf("ERROR: GROUP BY without aggregate\n");
     has_err = true;
     return;
   }
   std::vector<std::shared_ptr<Field>> fullset = selector->columns;
-  if (group_by_field != nullptr) {
+  for (auto field : group_by) {
     bool extend = true;
     for (auto it : fullset) {
-      if (it != nullptr && it->field_id == group_by_field->field_id) {
+      if (it != nullptr && it->field_id == field->field_id) {
         extend = false;
       }
     }
     if (extend) {
-      fullset.push_back(group_by_field);
+      fullset.push_back(field);
+    }
+  }
+  /// a sample is read from the pages of the table, never through an index
+  bool sampled = sample_percent < 100;
+  /// COUNT(*), MIN and MAX of a single table may not need its records
+  if (selector->has_aggregate && group_by.empty() && order_by.empty() &&
+      tables.size() == 1 && !sampled) {
+    auto meta = tables[0]->make_meta_aggregate(constraints, selector->columns,
+                                               selector->aggrs);
+    if (meta != nullptr) {
+      iter = meta;
+      selector->columns = iter->get_fields_dst();
+      return;
     }
   }
-  for (auto tbl : tables) {
-    direct_iterators.push_back(tbl->make_iterator(constraints, fullset));
+  /// a single table scanned through an index on the ORDER BY column comes
+  /// out sorted, and with a LIMIT only its first rows are read
+  bool presorted = false;
+  if (order_by.size() == 1 && tables.size() == 1 &&
+      !selector->has_aggregate && !distinct && !sampled &&
+      std::any_of(fullset.begin(), fullset.end(), [&](auto field) {
+        return field != nullptr &&
+               field->field_id == order_by[0].first->field_id;
+      })) {
+    auto ordered = tables[0]->make_ordered_iterator(
+        constraints, fullset, order_by[0].first, order_by[0].second,
+        req_limit != INT_MAX);
+    if (ordered != nullptr) {
+      if (req_limit != INT_MAX) {
+        ordered->set_block_cap(
+            (int)std::min<int64_t>(INT_MAX, (int64_t)req_offset + req_limit));
+      }
+      direct_iterators.push_back(ordered);
+      presorted = true;
+    }
+  }
+  if (!presorted) {
+    for (auto tbl : tables) {
+      direct_iterators.push_back(
+          tbl->make_iterator(constraints, fullset,
+                             Config::get()->vectorized_execution,
+                             sample_percent, Config::get()->scan_threads > 1));
+    }
   }
   auto tmp_it = direct_iterators[0];
   for (size_t i = 1; i < direct_iterators.size(); ++i) {
-    tmp_it = std::shared_ptr<JoinIterator>(
-        new JoinIterator(tmp_it, direct_iterators[i], constraints, fullset));
+    auto rhs = direct_iterators[i];
+    double outer_rows = joined_rows[i - 1];
+    /// a small outer input probes an index of the table instead of reading it
+    std::shared_ptr<ColumnOpColumnConstraint> key = nullptr;
+    std::shared_ptr<IndexIterator> lookup = nullptr;
+    if (outer_rows * INDEX_JOIN_RATIO < tables[i]->get_record_num()) {
+      std::tie(key, lookup) = make_lookup(tmp_it, tables[i], fullset);
+    }
+    if (lookup != nullptr) {
+      direct_iterators[i] = lookup;
+      tmp_it = std::shared_ptr<IndexJoinIterator>(
+          new IndexJoinIterator(tmp_it, lookup, key, constraints, fullset));
+      continue;
+    }
+    /// two base tables both readable in join key order are merged
+    std::shared_ptr<IndexIterator> scan_lhs = nullptr, scan_rhs = nullptr;
+    if (i == 1) {
+      std::tie(key, scan_lhs, scan_rhs) =
+          make_merge(tables[0], tables[1], fullset);
+    }
+    if (scan_lhs != nullptr) {
+      direct_iterators[0] = scan_lhs;
+      direct_iterators[1] = scan_rhs;
+      tmp_it = std::shared_ptr<MergeJoinIterator>(new MergeJoinIterator(
+          scan_lhs, scan_rhs, key, constraints, fullset, true, true));
+    } else if (HashJoinIterator::applicable(tmp_it, rhs, constraints)) {
+      /// hash the side estimated to be smaller
+      tmp_it = std::shared_ptr<HashJoinIterator>(new HashJoinIterator(
+          tmp_it, rhs, constraints, fullset, outer_rows <= table_rows[i]));
+    } else {
+      tmp_it = std::shared_ptr<JoinIterator>(
+          new JoinIterator(tmp_it, rhs, constraints, fullset));
+    }
   }
   if (selector->has_aggregate) {
-    iter = std::shared_ptr<AggregateIterator>(new AggregateIterator(
-        tmp_it, group_by_field, selector->columns, selector->aggrs));
+    auto aggregate = std::shared_ptr<AggregateIterator>(new AggregateIterator(
+        tmp_it, group_by, selector->columns, selector->aggrs));
+    if (sampled) {
+      aggregate->set_scale(100.0 / sample_percent);
+    }
+    iter = aggregate;
   } else {
     iter = std::shared_ptr<PermuteIterator>(
         new PermuteIterator(tmp_it, selector->columns));
   }
-  if (order_by_field != nullptr) {
-    iter = std::shared_ptr<SortIterator>(
-        new SortIterator(iter, order_by_field, order_by_desc));
+  if (distinct) {
+    iter = std::shared_ptr<DistinctIterator>(new DistinctIterator(iter));
+  }
+  if (!order_by.empty() && !presorted) {
+    /// with a LIMIT whose rows fit in memory, only those rows are kept
+    int64_t k = (int64_t)req_offset + req_limit;
+    int64_t row_len = SortIterator::row_size(iter->get_fields_dst(), order_by);
+    if (req_limit != INT_MAX && k * row_len <= QUERY_MAX_BLOCK) {
+      iter = std::shared_ptr<TopKIterator>(
+          new TopKIterator(iter, order_by, k));
+    } else {
+      iter = std::shared_ptr<SortIterator>(new SortIterator(iter, order_by));
+    }
   }
   selector->columns = iter->get_fields_dst();
 }
@@ -97,8 +399,11 @@ ColumnOpValueConstraint::ColumnOpValueConstraint(std::shared_ptr<Field> field,
   table_id = field->table_id;
   int col_idx = field->pers_index;
   int col_off = field->pers_offset;
+  this->column_index = col_idx;
   this->column_offset = col_off;
   this->op = Operator::NE;
+  this->dtype = field->datatype->type;
+  this->cmp_op = op;
   if (field->datatype->type == DataType::INT ||
       field->datatype->type == DataType::DATE) {
     int value = 0;
@@ -143,6 +448,7 @@ ColumnOpValueConstraint::ColumnOpValueConstraint(std::shared_ptr<Field> field,
       has_err = true;
       return;
     }
+    this->value_float = value;
     cmp = [=](const char *record) {
       if (!null_check(record, col_idx))
         return false;
@@ -156,6 +462,7 @@ ColumnOpValueConstraint::ColumnOpValueConstraint(std::shared_ptr<Field> field,
       return;
     }
     std::string value = std::any_cast<std::string>(std::move(val));
+    this->value_str = value;
     cmp = [=](const char *record) {
       if (!null_check(record, col_idx))
         return false;
@@ -183,7 +490,7 @@ void ColumnOpColumnConstraint::build(int col_idx, int col_off, int col_idx_o,
   case DataType::INT:
   case DataType::DATE: {
     cmp = [=](const char *record, const char *other) {
-      if (!null_check(record, col_idx) && !null_check(other, col_idx_o))
+      if (!null_check(record, col_idx) || !null_check(other, col_idx_o))
         return false;
       IType val = *(const IType *)(record + col_off);
       IType val_o = *(const IType *)(other + col_off_o);
@@ -193,7 +500,7 @@ void ColumnOpColumnConstraint::build(int col_idx, int col_off, int col_idx_o,
   }
   case DataType::FLOAT: {
     cmp = [=](const char *record, const char *other) {
-      if (!null_check(record, col_idx) && !null_check(other, col_idx_o))
+      if (!null_check(record, col_idx) || !null_check(other, col_idx_o))
         return false;
       FType val = *(const FType *)(record + col_off);
       FType val_o = *(const FType *)(other + col_off_o);
@@ -203,7 +510,7 @@ void ColumnOpColumnConstraint::build(int col_idx, int col_off, int col_idx_o,
   }
   case DataType::VARCHAR: {
     cmp = [=](const char *record, const char *other) {
-      if (!null_check(record, col_idx) && !null_check(other, col_idx_o))
+      if (!null_check(record, col_idx) || !null_check(other, col_idx_o))
         return false;
       return get_compare_result(strcmp(record + col_off, other + col_off_o),
                                 op);
@@ -218,6 +525,9 @@ void ColumnOpColumnConstraint::build(int col_idx, int col_off, int col_idx_o,
 ColumnNullConstraint::ColumnNullConstraint(std::shared_ptr<Field> field,
                                            bool field_not_null) {
   table_id = field->table_id;
+  column_index = field->pers_index;
+  column_offset = field->pers_offset;
+  not_null = field_not_null;
   int col_idx = field->pers_index;
   chk = [=](const char *record) {
     return null_check(record, col_idx) == field_not_null;
@@ -258,6 +568,10 @@ ColumnOpSubqueryConstraint::ColumnOpSubqueryConstraint(
   }
   int index = field->pers_index;
   int offset = field->pers_offset;
+  dtype = col[0]->datatype->type;
+  cmp_op = op;
+  column_index = index;
+  column_offset = offset;
   switch (col[0]->datatype->type) {
   case DataType::INT:
   case DataType::DATE: {
@@ -273,6 +587,7 @@ ColumnOpSubqueryConstraint::ColumnOpSubqueryConstraint(
       printf("ERROR: subquery must select exactly one row\n");
       return;
     }
+    value = val_int;
     cmp = [=](const char *record) {
       if (!null_check(record, index))
         return false;
@@ -294,6 +609,7 @@ ColumnOpSubqueryConstraint::ColumnOpSubqueryConstraint(
       printf("ERROR: subquery must select exactly one row\n");
       return;
     }
+    value_float = val_float;
     cmp = [=](const char *record) {
       if (!null_check(record, index))
         return false;
@@ -316,6 +632,7 @@ ColumnOpSubqueryConstraint::ColumnOpSubqueryConstraint(
       printf("ERROR: subquery must select exactly one row\n");
       return;
     }
+    value_str = val_str;
     cmp = [=](const char *record) {
       if (!null_check(record, index))
         return false;
@@ -339,12 +656,14 @@ ColumnInSubqueryConstraint::ColumnInSubqueryConstraint(
   }
   int index = field->pers_index;
   int offset = field->pers_offset;
+  column_index = index;
   switch (col[0]->datatype->type) {
   case DataType::INT:
   case DataType::DATE: {
     while (subquery->next()) {
       vals_int.insert(*(const IType *)(subquery->get() + sizeof(bitmap_t)));
     }
+    column_offset = offset;
     cmp = [=, this](const char *record) {
       if (!null_check(record, index))
         return false;
@@ -382,6 +701,90 @@ ColumnInSubqueryConstraint::ColumnInSubqueryConstraint(
   }
 }
 
+ColumnInListConstraint::ColumnInListConstraint(std::shared_ptr<Field> field,
+                                               std::vector<std::any> &&vals) {
+  table_id = field->table_id;
+  int index = field->pers_index;
+  int offset = field->pers_offset;
+  column_index = index;
+  /// NULL never compares equal, drop it from the list
+  std::erase_if(vals, [](const std::any &val) { return !val.has_value(); });
+  switch (field->datatype->type) {
+  case DataType::INT:
+  case DataType::DATE: {
+    for (auto &val : vals) {
+      if (field->datatype->type == DataType::INT) {
+        if (val.type() != typeid(IType)) {
+          printf("ERROR: where clause type mismatch (expect INT)\n");
+          has_err = true;
+          return;
+        }
+        vals_int.insert(std::any_cast<IType>(val));
+        continue;
+      }
+      if (val.type() != typeid(std::string)) {
+        printf("ERROR: where clause type mismatch (expect DATE)\n");
+        has_err = true;
+        return;
+      }
+      auto ret = DateType::parse_date(std::any_cast<std::string>(val));
+      if (!ret.has_value()) {
+        Logger::tabulate({"!ERROR", "invalid date format"}, 2, 1);
+        has_err = true;
+        return;
+      }
+      vals_int.insert(ret.value());
+    }
+    column_offset = offset;
+    cmp = [=, this](const char *record) {
+      if (!null_check(record, index))
+        return false;
+      IType val = *(const IType *)(record + offset);
+      return this->vals_int.contains(val);
+    };
+    break;
+  }
+  case DataType::FLOAT: {
+    for (auto &val : vals) {
+      if (val.type() == typeid(IType)) {
+        vals_float.insert(std::any_cast<IType>(val));
+      } else if (val.type() == typeid(FType)) {
+        vals_float.insert(std::any_cast<FType>(val));
+      } else {
+        printf("ERROR: where clause type mismatch (expect FLOAT)\n");
+        has_err = true;
+        return;
+      }
+    }
+    cmp = [=, this](const char *record) {
+      if (!null_check(record, index))
+        return false;
+      FType val = *(const FType *)(record + offset);
+      return this->vals_float.contains(val);
+    };
+    break;
+  }
+  case DataType::VARCHAR: {
+    for (auto &val : vals) {
+      if (val.type() != typeid(std::string)) {
+        printf("ERROR: where clause type mismatch (expect VARCHAR)\n");
+        has_err = true;
+        return;
+      }
+      vals_str.insert(std::any_cast<std::string>(val));
+    }
+    cmp = [=, this](const char *record) {
+      if (!null_check(record, index))
+        return false;
+      return this->vals_str.contains(std::string(record + offset));
+    };
+    break;
+  }
+  default:
+    throw std::runtime_error("unknown data type");
+  }
+}
+
 SetVariable::SetVariable(std::shared_ptr<Field> field, std::any &&value_) {
   /// default value should not be used here
   int col_idx = field->pers_index;
@@ -1,3 +1,5 @@
+#include <bit>
+
 #include <engine/query.h>
 #include <engine/record.h>
 #include <engine/system.h>
@@ -33,6 +35,7 @@ RecordManager::RecordManager(const std::string &datafile_name, int record_len)
   fd = FileMapping::get()->open_file(filename);
   n_pages = 0;
   ptr_available = -1;
+  n_records = 0;
   records_per_page = eval_records_per_page(record_len);
   headmask_size = (records_per_page + 63) / 64;
   header_len = BITMAP_START_OFFSET + headmask_size * sizeof(uint64_t);
@@ -50,6 +53,17 @@ RecordManager::RecordManager(SequentialAccessor &accessor) {
   header_len = BITMAP_START_OFFSET + headmask_size * sizeof(uint64_t);
 }
 
+void RecordManager::recount() {
+  n_records = 0;
+  for (int i = 0; i < n_pages; ++i) {
+    auto page = PagedBuffer::get()->read_file_rd(std::make_pair(fd, i));
+    auto mask = (const uint64_t *)(page + BITMAP_START_OFFSET);
+    for (int j = 0; j < headmask_size; ++j) {
+      n_records += std::popcount(mask[j]);
+    }
+  }
+}
+
 void RecordManager::serialize(SequentialAccessor &accessor) {
   accessor.write_str(filename);
   accessor.write<uint32_t>(n_pages);
@@ -2,12 +2,15 @@
 
 #include <engine/defs.h>
 #include <engine/field.h>
+#include <engine/index.h>
 #include <engine/iterator.h>
 #include <engine/query.h>
 #include <engine/record.h>
 #include <engine/scape_sql.h>
+#include <engine/stats.h>
 #include <frontend/frontend.h>
 #include <storage/fastio.h>
+#include <utils/bloom_filter.h>
 #include <utils/logger.h>
 
 namespace ScapeSQL {
@@ -77,6 +80,42 @@ void show_tables() {
   Logger::tabulate(table, table.size(), 1);
 }
 
+void show_indexes() {
+  CHECK_DB_EXISTS(db);
+  std::vector<std::string> table{"TABLE", "KEY",   "KIND",
+                                 "USING", "PROBES", "FP RATE"};
+  auto add_row = [&](std::shared_ptr<TableManager> tbl,
+                     std::shared_ptr<KeyBase> key, const std::string &kind) {
+    auto index = tbl->get_index(key->local_hash());
+    std::string using_type = "BTREE", probes = "-", fp_rate = "-";
+    if (index != nullptr && index->hash != nullptr) {
+      using_type = "HASH";
+    }
+    /// bloom filters only exist on unique indexes
+    if (index != nullptr && index->bloom != nullptr) {
+      char buf[32];
+      probes = std::to_string(index->bloom->probes);
+      snprintf(buf, sizeof(buf), "%.4f", index->bloom->false_positive_rate());
+      fp_rate = buf;
+    }
+    table.insert(table.end(),
+                 {tbl->get_name(), key->random_name ? "" : key->key_name, kind,
+                  using_type, probes, fp_rate});
+  };
+  for (const auto &[_, tbl] : db->get_tables()) {
+    if (tbl->get_primary_key() != nullptr) {
+      add_row(tbl, tbl->get_primary_key(), "PRIMARY");
+    }
+    for (auto uk : tbl->get_unique_keys()) {
+      add_row(tbl, uk, "UNIQUE");
+    }
+    for (auto ek : tbl->get_explicit_index()) {
+      add_row(tbl, ek, "INDEX");
+    }
+  }
+  Logger::tabulate(table, table.size() / 6, 6);
+}
+
 void create_table(const std::string &s,
                   std::vector<std::shared_ptr<Field>> &&fields) {
   if (has_err)
@@ -163,10 +202,51 @@ void describe_table(const std::string &table_name) {
     printf("INDEX ");
     printf("%s", ek->key_name.data());
     print_list(ek->field_names);
+    if (ek->use_hash) {
+      printf(" USING HASH");
+    }
     puts(";");
   }
 }
 
+void analyze_table(const std::string &table_name) {
+  CHECK_DB_EXISTS(db);
+  CHECK_TABLE_EXISTS(db, table_name, table);
+  table->analyze();
+  auto stats = table->get_stats();
+  auto bound_str = [](const ColumnStats &col, double v) -> std::string {
+    static char buf[32];
+    if (!col.numeric() || col.bounds.empty()) {
+      return "NULL";
+    } else if (col.type == DataType::FLOAT) {
+      snprintf(buf, sizeof(buf), "%.2lf", v);
+    } else if (col.type == DataType::DATE) {
+      int d = v;
+      snprintf(buf, sizeof(buf), "%d-%02d-%02d", d / 10000, d / 100 % 100,
+               d % 100);
+    } else {
+      snprintf(buf, sizeof(buf), "%d", (int)v);
+    }
+    return buf;
+  };
+  const auto &fields = table->get_fields();
+  std::vector<std::string> content{"Field", "NDV", "Null Frac",
+                                   "Min",   "Max", "Buckets"};
+  content.reserve(fields.size() * 6 + 6);
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const auto &col = stats->columns[i];
+    char frac[16];
+    snprintf(frac, sizeof(frac), "%.4lf", col.null_frac);
+    content.push_back(fields[i]->field_name);
+    content.push_back(std::to_string((long long)col.ndv));
+    content.push_back(frac);
+    content.push_back(bound_str(col, col.min_val));
+    content.push_back(bound_str(col, col.max_val));
+    content.push_back(std::to_string(std::max<int>(col.bounds.size() - 1, 0)));
+  }
+  Logger::tabulate(content, content.size() / 6, 6);
+}
+
 void update_set_table(
     std::shared_ptr<TableManager> table,
     std::vector<SetVariable> &&set_variables,
@@ -248,6 +328,7 @@ void update_set_table(
     }
     table->insert_record(buf_o.data(), false);
   }
+  table->refresh_stats();
   if (!has_err) {
     Logger::tabulate({"rows", std::to_string(rec.size())}, 2, 1);
   }
@@ -282,6 +363,7 @@ void delete_from_table(
     }
     modified_rows = rec.size();
   }
+  table->refresh_stats();
   if (!has_err) {
     Logger::tabulate({"rows", std::to_string(modified_rows)}, 2, 1);
   }
@@ -303,17 +385,26 @@ void insert_from_file(const std::string &file_path,
     return;
   }
   char ch = fastIO::getchar();
+  /// rows are handed to the table in batches so that indexes are updated
+  /// in key order
+  const int batch_size = 4096;
+  const int record_len = table->get_record_len();
   static std::vector<uint8_t> buf;
-  buf.resize(table->get_record_len());
-  uint8_t *ptr = buf.data();
-  *(bitmap_t *)ptr = (1 << column_num) - 1;
-  int n_entries_inserted = 0;
+  buf.resize(record_len * batch_size);
+  int n_entries_inserted = 0, n_buffered = 0;
   while (true) {
     while (ch == ',' || ch == '\n') {
       ch = fastIO::getchar();
     }
     if (ch == -1)
       break;
+    if (n_buffered == batch_size) {
+      n_entries_inserted +=
+          table->insert_records(buf.data(), n_buffered, false);
+      n_buffered = 0;
+    }
+    uint8_t *ptr = buf.data() + n_buffered * record_len;
+    *(bitmap_t *)ptr = (1 << column_num) - 1;
     for (int i = 0; i < column_num; ++i) {
       if (fields[i]->datatype->type == DataType::INT) {
         while (!isdigit(ch))
@@ -363,9 +454,10 @@ void insert_from_file(const std::string &file_path,
                sizeof(char) * (fields[i]->datatype->get_size() - myit));
       }
     }
-    table->insert_record(ptr, false);
-    ++n_entries_inserted;
+    ++n_buffered;
   }
+  n_entries_inserted += table->insert_records(buf.data(), n_buffered, false);
+  table->refresh_stats();
   fastIO::end_read();
   Logger::tabulate({"rows", std::to_string(n_entries_inserted)}, 2, 1);
 }
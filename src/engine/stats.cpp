@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include <engine/field.h>
+#include <engine/iterator.h>
+#include <engine/record.h>
+#include <engine/stats.h>
+#include <storage/storage.h>
+#include <utils/hyperloglog.h>
+
+double ColumnStats::below(double value) const {
+  int n_buckets = bounds.size() - 1;
+  if (n_buckets < 1 || value <= bounds[0]) {
+    return 0;
+  }
+  if (value > bounds[n_buckets]) {
+    return 1;
+  }
+  /// whole buckets below value, then a linear share of the one holding it
+  int i = std::lower_bound(bounds.begin(), bounds.end(), value) -
+          bounds.begin();
+  double lo = bounds[i - 1], hi = bounds[i];
+  return (i - 1 + (value - lo) / (hi - lo)) / n_buckets;
+}
+
+double ColumnStats::fraction(Operator op, double value) const {
+  if (bounds.empty()) {
+    return 0;
+  }
+  double lt = below(value), le, eq;
+  bool in_range = value >= min_val && value <= max_val;
+  if (type == DataType::FLOAT) {
+    eq = in_range ? 1 / ndv : 0;
+    le = std::min(1.0, lt + eq);
+  } else {
+    /// integers: a value that fills buckets of its own is frequent
+    le = below(value + 1);
+    eq = in_range ? std::max(le - lt, 1 / ndv) : 0;
+  }
+  switch (op) {
+  case Operator::EQ:
+    return eq;
+  case Operator::NE:
+    return 1 - eq;
+  case Operator::LT:
+    return lt;
+  case Operator::LE:
+    return le;
+  case Operator::GT:
+    return 1 - le;
+  case Operator::GE:
+    return 1 - lt;
+  }
+  return 1;
+}
+
+void ColumnStats::serialize(SequentialAccessor &s) const {
+  s.write_byte(type);
+  s.write<uint64_t>(std::bit_cast<uint64_t>(ndv));
+  s.write<uint64_t>(std::bit_cast<uint64_t>(null_frac));
+  s.write<uint64_t>(std::bit_cast<uint64_t>(min_val));
+  s.write<uint64_t>(std::bit_cast<uint64_t>(max_val));
+  s.write<uint32_t>(bounds.size());
+  for (double bound : bounds) {
+    s.write<uint64_t>(std::bit_cast<uint64_t>(bound));
+  }
+}
+
+void ColumnStats::deserialize(SequentialAccessor &s) {
+  type = (DataType)s.read_byte();
+  ndv = std::bit_cast<double>(s.read<uint64_t>());
+  null_frac = std::bit_cast<double>(s.read<uint64_t>());
+  min_val = std::bit_cast<double>(s.read<uint64_t>());
+  max_val = std::bit_cast<double>(s.read<uint64_t>());
+  bounds.resize(s.read<uint32_t>());
+  for (double &bound : bounds) {
+    bound = std::bit_cast<double>(s.read<uint64_t>());
+  }
+}
+
+TableStats::TableStats(const std::vector<std::shared_ptr<Field>> &fields,
+                       std::shared_ptr<RecordManager> record_manager) {
+  int n_cols = fields.size();
+  columns.resize(n_cols);
+  std::vector<HyperLogLog> sketches(n_cols);
+  std::vector<int> nulls(n_cols, 0);
+  /// a reservoir of whole rows, NaN for NULL and VARCHAR slots
+  std::vector<std::vector<double>> sample(n_cols);
+  std::mt19937 rng(n_cols);
+  for (int i = 0; i < n_cols; ++i) {
+    columns[i].type = fields[i]->datatype->type;
+    columns[i].min_val = INFINITY;
+    columns[i].max_val = -INFINITY;
+  }
+
+  RecordIterator it(record_manager, {}, fields, fields);
+  while (it.get_next_valid_no_check()) {
+    auto [pn, sn] = it.get_locator();
+    const uint8_t *record = record_manager->get_record_ref(pn, sn);
+    bitmap_t bitmap = *(const bitmap_t *)record;
+    int slot = n_rows < SAMPLE_ROWS ? n_rows : rng() % (n_rows + 1);
+    bool sampled = slot < SAMPLE_ROWS;
+    ++n_rows;
+    for (int i = 0; i < n_cols; ++i) {
+      auto &col = columns[i];
+      const uint8_t *p = record + fields[i]->pers_offset;
+      double val = NAN;
+      if (!((bitmap >> i) & 1)) {
+        ++nulls[i];
+      } else if (col.type == DataType::VARCHAR) {
+        int len = strnlen((const char *)p, fields[i]->get_size());
+        sketches[i].insert(HyperLogLog::hash_bytes(p, len));
+      } else if (col.type == DataType::FLOAT) {
+        /// -0.0 and 0.0 are the same value
+        val = *(const double *)p + 0.0;
+        sketches[i].insert(HyperLogLog::hash_bytes(&val, sizeof(val)));
+      } else {
+        val = *(const int *)p;
+        sketches[i].insert(HyperLogLog::hash_bytes(p, sizeof(int)));
+      }
+      if (!std::isnan(val)) {
+        col.min_val = std::min(col.min_val, val);
+        col.max_val = std::max(col.max_val, val);
+      }
+      if (sampled && slot == (int)sample[i].size()) {
+        sample[i].push_back(val);
+      } else if (sampled) {
+        sample[i][slot] = val;
+      }
+    }
+  }
+
+  for (int i = 0; i < n_cols; ++i) {
+    auto &col = columns[i];
+    int non_null = n_rows - nulls[i];
+    col.null_frac = n_rows ? (double)nulls[i] / n_rows : 0;
+    col.ndv = std::clamp(std::round(sketches[i].estimate()),
+                         std::min(1.0, (double)non_null), (double)non_null);
+    if (non_null == 0 || !col.numeric()) {
+      col.min_val = col.max_val = 0;
+      continue;
+    }
+    auto &vals = sample[i];
+    std::erase_if(vals, [](double v) { return std::isnan(v); });
+    std::sort(vals.begin(), vals.end());
+    /// a mostly NULL column may have no sampled value, min to max then
+    int n_buckets = std::clamp((int)vals.size(), 1, HISTOGRAM_BUCKETS);
+    col.bounds.resize(n_buckets + 1);
+    for (int b = 1; b < n_buckets; ++b) {
+      col.bounds[b] = vals[(size_t)b * vals.size() / n_buckets];
+    }
+    col.bounds[0] = col.min_val;
+    col.bounds[n_buckets] = col.max_val;
+  }
+}
+
+void TableStats::serialize(SequentialAccessor &s) const {
+  s.write<uint32_t>(n_rows);
+  s.write<uint32_t>(n_modified);
+  s.write<uint32_t>(columns.size());
+  for (const auto &col : columns) {
+    col.serialize(s);
+  }
+}
+
+void TableStats::deserialize(SequentialAccessor &s) {
+  n_rows = s.read<uint32_t>();
+  n_modified = s.read<uint32_t>();
+  columns.resize(s.read<uint32_t>());
+  for (auto &col : columns) {
+    col.deserialize(s);
+  }
+}
@@ -1,5 +1,12 @@
+#include <algorithm>
 #include <filesystem>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <optional>
+#include <random>
+#include <set>
+#include <tuple>
 
 #include <engine/defs.h>
 #include <engine/field.h>
@@ -7,6 +14,7 @@
 #include <engine/iterator.h>
 #include <engine/query.h>
 #include <engine/record.h>
+#include <engine/stats.h>
 #include <engine/system.h>
 #include <storage/storage.h>
 #include <utils/config.h>
@@ -156,7 +164,9 @@ TableManager::TableManager(const std::string &db_dir, const std::string &name,
 void TableManager::deserialize() {
   record_len = sizeof(bitmap_t);
   SequentialAccessor accessor(FileMapping::get()->open_file(meta_file));
-  if (accessor.read<uint32_t>() != Config::SCAPE_SIGNATURE) {
+  uint32_t signature = accessor.read<uint32_t>();
+  if (signature != Config::SCAPE_TABLE_SIGNATURE &&
+      signature != Config::SCAPE_SIGNATURE) {
     printf("ERROR: table metadata file %s is invalid.\n", meta_file.data());
     std::exit(0);
   }
@@ -173,6 +183,10 @@ void TableManager::deserialize() {
     record_len += fields[i]->get_size();
   }
   record_manager = std::make_shared<RecordManager>(accessor);
+  if (signature == Config::SCAPE_SIGNATURE) {
+    /// earlier builds left n_records uninitialized on new tables
+    record_manager->recount();
+  }
   auto nindex = accessor.read<uint32_t>();
   for (size_t i = 0; i < nindex; i++) {
     auto hash = accessor.read<key_hash_t>();
@@ -183,6 +197,7 @@ void TableManager::deserialize() {
     primary_key->deserialize(accessor);
     primary_key->build(this);
     primary_key->index = get_index(primary_key->local_hash());
+    primary_key->index->build_bloom();
   }
   int fkcount = accessor.read<uint32_t>();
   foreign_keys.resize(fkcount);
@@ -204,6 +219,11 @@ void TableManager::deserialize() {
     unique_keys[i]->deserialize(accessor);
     unique_keys[i]->build(this);
     unique_keys[i]->index = get_index(unique_keys[i]->local_hash());
+    unique_keys[i]->index->build_bloom();
+  }
+  if (accessor.read_byte()) {
+    stats = std::make_shared<TableStats>();
+    stats->deserialize(accessor);
   }
 }
 
@@ -257,7 +277,7 @@ TableManager::~TableManager() {
     return;
   }
   SequentialAccessor accessor(FileMapping::get()->open_file(meta_file));
-  accessor.write<uint32_t>(Config::SCAPE_SIGNATURE);
+  accessor.write<uint32_t>(Config::SCAPE_TABLE_SIGNATURE);
   accessor.write_str(db_name);
   accessor.write<uint32_t>(fields.size());
   for (const auto &field : fields) {
@@ -285,6 +305,10 @@ TableManager::~TableManager() {
   for (const auto &uk : unique_keys) {
     uk->serialize(accessor);
   }
+  accessor.write_byte(stats != nullptr);
+  if (stats != nullptr) {
+    stats->serialize(accessor);
+  }
 }
 
 void TableManager::build_fk() {
@@ -318,16 +342,14 @@ void TableManager::purge() {
   purged = true;
 }
 
-void TableManager::insert_record(const std::vector<std::any> &values) {
+bool TableManager::build_record(const std::vector<std::any> &values,
+                                uint8_t *ptr) {
   if (values.size() != fields.size()) {
     printf("ERROR: insert values size mismatch.\n");
     has_err = true;
-    return;
+    return false;
   }
-  static std::vector<uint8_t> temp_buf;
-  temp_buf.resize(record_len);
-  memset(temp_buf.data(), 0, temp_buf.size());
-  uint8_t *ptr = temp_buf.data();
+  memset(ptr, 0, record_len);
   uint8_t *ptr_cur = ptr + sizeof(bitmap_t);
   bitmap_t bitmap = 0;
   int has_val = 0;
@@ -337,11 +359,54 @@ void TableManager::insert_record(const std::vector<std::any> &values) {
       bitmap |= (1 << i);
     }
     if (has_err) {
-      return;
+      return false;
     }
   }
   *(bitmap_t *)ptr = bitmap;
-  insert_record(ptr, true);
+  return true;
+}
+
+void TableManager::insert_record(const std::vector<std::any> &values) {
+  static std::vector<uint8_t> temp_buf;
+  temp_buf.resize(record_len);
+  if (build_record(values, temp_buf.data())) {
+    insert_record(temp_buf.data(), true);
+  }
+}
+
+int TableManager::insert_records(
+    const std::vector<std::vector<std::any>> &values) {
+  std::vector<uint8_t> buf(values.size() * record_len);
+  int n = 0;
+  while (n < (int)values.size() &&
+         build_record(values[n], buf.data() + n * record_len)) {
+    ++n;
+  }
+  return insert_records(buf.data(), n, true);
+}
+
+int TableManager::insert_records(uint8_t *buf, int n, bool enable_checking) {
+  if (enable_checking) {
+    n = check_insert_validity(buf, n);
+  }
+  std::vector<KeyCollection> locators;
+  locators.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    uint8_t *ptr = buf + i * record_len;
+    auto pos = record_manager->insert_record(ptr);
+    locators.emplace_back(pos.first, pos.second, ptr);
+  }
+  if (n == 0) {
+    return 0;
+  }
+  count_modified(n);
+  for (auto [_, index] : index_manager) {
+    index->insert_records(locators);
+  }
+  for (auto fk : foreign_keys) {
+    fk->index->add_refcounts(buf, n, record_len);
+  }
+  return n;
 }
 
 void TableManager::insert_record(uint8_t *ptr, bool enable_checking) {
@@ -349,6 +414,7 @@ void TableManager::insert_record(uint8_t *ptr, bool enable_checking) {
     return;
   }
   auto pos = record_manager->insert_record(ptr);
+  count_modified(1);
   for (auto [_, index] : index_manager) {
     index->insert_record(KeyCollection(pos.first, pos.second, ptr));
   }
@@ -367,22 +433,20 @@ void TableManager::erase_record(int pn, int sn, bool enable_checking) {
     return;
   }
   for (auto [_, index] : index_manager) {
-    [[maybe_unused]] bool ret = index->tree->erase(
-        index->extractKeys(KeyCollection(pn, sn, temp_buf.data())));
+    [[maybe_unused]] bool ret =
+        index->erase_record(KeyCollection(pn, sn, temp_buf.data()));
   }
   for (auto fk : foreign_keys) {
     auto refcnt = fk->index->get_refcount(temp_buf.data());
     --(*refcnt);
   }
   record_manager->erase_record(pn, sn);
+  count_modified(1);
 }
 
 bool TableManager::check_insert_validity_primary(uint8_t *ptr) {
   if (primary_key != nullptr) {
-    auto index = primary_key->index;
-    auto data = index->extractKeys(KeyCollection(INT_MAX, INT_MAX, ptr));
-    auto ret = index->tree->le_match(data);
-    if (index->approx_eq(ret.keyptr, data.data())) {
+    if (primary_key->index->contains(ptr)) {
       Logger::tabulate({"!ERROR", "duplicate (insert)"}, 2, 1);
       has_err = true;
       return false;
@@ -393,10 +457,7 @@ bool TableManager::check_insert_validity_primary(uint8_t *ptr) {
 
 bool TableManager::check_insert_validity_unique(uint8_t *ptr) {
   for (auto uk : unique_keys) {
-    auto index = uk->index;
-    auto data = index->extractKeys(KeyCollection(INT_MAX, INT_MAX, ptr));
-    auto ret = index->tree->le_match(data);
-    if (index->approx_eq(ret.keyptr, data.data())) {
+    if (uk->index->contains(ptr)) {
       Logger::tabulate({"!ERROR", "duplicate (insert)"}, 2, 1);
       has_err = true;
       return false;
@@ -407,10 +468,7 @@ bool TableManager::check_insert_validity_unique(uint8_t *ptr) {
 
 bool TableManager::check_insert_validity_foreign(uint8_t *ptr) {
   for (auto fk : foreign_keys) {
-    auto index = fk->index;
-    auto data = index->extractKeys(KeyCollection(INT_MAX, INT_MAX, ptr));
-    auto ret = index->tree->le_match(data);
-    if (!index->approx_eq(ret.keyptr, data.data())) {
+    if (!fk->index->contains(ptr)) {
       Logger::tabulate({"!ERROR", "foreign (insert)"}, 2, 1);
       has_err = true;
       return false;
@@ -425,6 +483,67 @@ bool TableManager::check_insert_validity(uint8_t *ptr) {
          check_insert_validity_foreign(ptr);
 }
 
+int TableManager::check_insert_validity(uint8_t *buf, int n) {
+  /// per record, the first failing check in single row order
+  enum { OK, DUPLICATE, FOREIGN };
+  std::vector<int> fail(n, OK);
+  auto check_unique = [&](std::shared_ptr<IndexMeta> index) {
+    auto hits = index->contains_batch(buf, n, record_len);
+    std::vector<std::pair<std::vector<int>, int>> keys(n);
+    for (int i = 0; i < n; ++i) {
+      keys[i].first =
+          index->extractKeys(KeyCollection(0, 0, buf + i * record_len));
+      keys[i].second = i;
+    }
+    std::sort(keys.begin(), keys.end());
+    for (int i = 0; i < n; ++i) {
+      bool repeated = i > 0 && keys[i - 1].first == keys[i].first;
+      int id = keys[i].second;
+      if ((hits[id] || repeated) && fail[id] == OK) {
+        fail[id] = DUPLICATE;
+      }
+    }
+  };
+  if (primary_key != nullptr) {
+    check_unique(primary_key->index);
+  }
+  for (auto uk : unique_keys) {
+    check_unique(uk->index);
+  }
+  for (auto fk : foreign_keys) {
+    auto hits = fk->index->contains_batch(buf, n, record_len);
+    /// a table referencing itself may point at a row earlier in the batch,
+    /// which one INSERT per row would have written first
+    std::map<std::vector<int>, int> earlier;
+    if (primary_key != nullptr && fk->index->tree == primary_key->index->tree) {
+      for (int i = n - 1; i >= 0; --i) {
+        earlier[primary_key->index->extractKeys(
+            KeyCollection(0, 0, buf + i * record_len))] = i;
+      }
+    }
+    for (int i = 0; i < n; ++i) {
+      if (hits[i] || fail[i] != OK) {
+        continue;
+      }
+      auto it = earlier.find(
+          fk->index->extractKeys(KeyCollection(0, 0, buf + i * record_len)));
+      if (it == earlier.end() || it->second >= i) {
+        fail[i] = FOREIGN;
+      }
+    }
+  }
+  for (int i = 0; i < n; ++i) {
+    if (fail[i] != OK) {
+      Logger::tabulate({"!ERROR", fail[i] == DUPLICATE ? "duplicate (insert)"
+                                                       : "foreign (insert)"},
+                       2, 1);
+      has_err = true;
+      return i;
+    }
+  }
+  return n;
+}
+
 bool TableManager::check_erase_validity(uint8_t *ptr) {
   if (primary_key != nullptr) {
     auto refcnt = primary_key->index->get_refcount(ptr);
@@ -454,8 +573,10 @@ void TableManager::add_index(const std::vector<std::shared_ptr<Field>> &fields,
     return;
   }
   std::string filename = index_prefix + std::to_string(hash);
-  auto tree = std::shared_ptr<BPlusTree>(new BPlusTree(
-      filename, fields.size() + 2, store_full_data ? record_len + 4 : 4));
+  /// a unique column prefix suffices to separate subtrees
+  auto tree = std::shared_ptr<BPlusTree>(
+      new BPlusTree(filename, fields.size() + 2,
+                    store_full_data ? record_len + 4 : 4, enable_unique_check));
   auto iter = RecordIterator(record_manager, {}, fields, {});
   auto index = std::make_shared<IndexMeta>(fields, false, tree);
   while (iter.get_next_valid_no_check()) {
@@ -483,7 +604,48 @@ void TableManager::drop_index(key_hash_t hash) {
   }
   if (--it->second->refcount == 0) {
     it->second->tree->purge();
+    it->second->drop_hash();
     index_manager.erase(it);
+    return;
+  }
+  bool unique = primary_key != nullptr && primary_key->local_hash() == hash;
+  for (auto uk : unique_keys) {
+    unique = unique || uk->local_hash() == hash;
+  }
+  if (!unique) {
+    it->second->tree->widen_separators();
+    it->second->bloom = nullptr;
+  }
+}
+
+void TableManager::sync_hash(key_hash_t hash) {
+  auto index = get_index(hash);
+  if (index == nullptr) {
+    return;
+  }
+  bool use_hash = false;
+  for (auto ik : explicit_index_keys) {
+    use_hash = use_hash || (ik->use_hash && ik->local_hash() == hash);
+  }
+  if (use_hash == (index->hash != nullptr)) {
+    return;
+  }
+  if (use_hash) {
+    index->build_hash(index_prefix + std::to_string(hash) + ".hash");
+  } else {
+    index->drop_hash();
+  }
+  if (primary_key == nullptr || primary_key->index != index) {
+    return;
+  }
+  /// foreign keys elsewhere hold remapped copies of the pk index
+  auto db = GlobalManager::get()->get_db_manager(db_name);
+  for (const auto &[_, table] : db->get_tables()) {
+    for (auto fk : table->foreign_keys) {
+      if (fk->built && fk->ref_table_name == table_name) {
+        fk->index->hash = index->hash;
+      }
+    }
   }
 }
 
@@ -494,6 +656,7 @@ void TableManager::add_pk(std::shared_ptr<PrimaryKey> pk) {
     if (has_err)
       return;
     pk->index = get_index(pk->local_hash());
+    pk->index->build_bloom();
     primary_key = pk;
     for (auto field : pk->fields) {
       field->notnull = true;
@@ -525,9 +688,10 @@ void TableManager::drop_pk() {
     Logger::tabulate({"!ERROR", "foreign (drop referenced pk)"}, 2, 1);
     return;
   }
-  drop_index(primary_key->local_hash());
+  auto hash = primary_key->local_hash();
   used_names.erase(primary_key->key_name);
   primary_key = nullptr;
+  drop_index(hash);
 }
 
 void TableManager::add_fk(std::shared_ptr<ForeignKey> fk) {
@@ -545,10 +709,7 @@ void TableManager::add_fk(std::shared_ptr<ForeignKey> fk) {
   while (it.get_next_valid_no_check()) {
     auto [pn, sn] = it.get_locator();
     auto ptr = record_manager->get_record_ref(pn, sn);
-    auto index = fk->index;
-    auto data = index->extractKeys(KeyCollection(INT_MAX, INT_MAX, ptr));
-    auto ret = index->tree->le_match(data);
-    if (!index->approx_eq(ret.keyptr, data.data())) {
+    if (!fk->index->contains(ptr)) {
       Logger::tabulate({"!ERROR", "foreign"}, 2, 1);
       has_err = true;
       return;
@@ -598,23 +759,27 @@ void TableManager::add_explicit_index(std::shared_ptr<ExplicitIndexKey> idx) {
   add_index(idx->fields, true, false);
   used_names.insert(idx->key_name);
   explicit_index_keys.push_back(idx);
+  sync_hash(idx->local_hash());
 }
 
 void TableManager::drop_index(const std::string &idx_name) {
   for (auto it = explicit_index_keys.begin(); it != explicit_index_keys.end();
        ++it) {
     if ((*it)->key_name == idx_name) {
-      drop_index((*it)->local_hash());
+      auto hash = (*it)->local_hash();
       explicit_index_keys.erase(it);
       used_names.erase(idx_name);
+      sync_hash(hash);
+      drop_index(hash);
       return;
     }
   }
   for (auto it = unique_keys.begin(); it != unique_keys.end(); ++it) {
     if ((*it)->key_name == idx_name) {
-      drop_index((*it)->local_hash());
+      auto hash = (*it)->local_hash();
       unique_keys.erase(it);
       used_names.erase(idx_name);
+      drop_index(hash);
       return;
     }
   }
@@ -631,6 +796,7 @@ void TableManager::add_unique(std::shared_ptr<UniqueKey> uk) {
   if (has_err)
     return;
   uk->index = get_index(uk->local_hash());
+  uk->index->build_bloom();
   used_names.insert(uk->key_name);
   unique_keys.push_back(uk);
 }
@@ -638,53 +804,525 @@ void TableManager::add_unique(std::shared_ptr<UniqueKey> uk) {
 void TableManager::drop_unique(const std::string &uk_name) {
   for (auto it = unique_keys.begin(); it != unique_keys.end(); ++it) {
     if ((*it)->key_name == uk_name) {
-      drop_index((*it)->local_hash());
+      auto hash = (*it)->local_hash();
       unique_keys.erase(it);
       used_names.erase(uk_name);
+      drop_index(hash);
       return;
     }
   }
   printf("ERROR: unique key %s not found.\n", uk_name.data());
 }
 
+/// the keys [lbound, rbound) satisfying `key op value`, nullopt for <>
+static std::optional<std::pair<int, int>> key_range(Operator op, int value) {
+  switch (op) {
+  case Operator::EQ:
+    return std::make_pair(value, value + 1);
+  case Operator::GE:
+    return std::make_pair(value, INT_MAX);
+  case Operator::GT:
+    return std::make_pair(value + 1, INT_MAX);
+  case Operator::LE:
+    return std::make_pair(INT_MIN + 1, value + 1);
+  case Operator::LT:
+    return std::make_pair(INT_MIN + 1, value);
+  default:
+    return std::nullopt;
+  }
+}
+
+/// share of the rows above which an indexed predicate is cheaper to check
+/// per row than to intersect
+static const double BROAD_PREDICATE_SHARE = 0.25;
+
 std::shared_ptr<BlockIterator> TableManager::make_iterator(
     const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
-    const std::vector<std::shared_ptr<Field>> &fields_dst) {
+    const std::vector<std::shared_ptr<Field>> &fields_dst, bool vectorized,
+    int sample_percent, bool parallel) {
+  auto full_scan = [&]() -> std::shared_ptr<RecordIterator> {
+    if (parallel && record_manager->n_pages >= PARALLEL_SCAN_MIN_PAGES) {
+      return std::shared_ptr<ParallelScanIterator>(
+          new ParallelScanIterator(record_manager, cons_, fields, fields_dst));
+    }
+    if (vectorized) {
+      return std::shared_ptr<VectorScanIterator>(
+          new VectorScanIterator(record_manager, cons_, fields, fields_dst));
+    }
+    return std::shared_ptr<RecordIterator>(
+        new RecordIterator(record_manager, cons_, fields, fields_dst));
+  };
+  if (sample_percent < 100) {
+    auto scan = full_scan();
+    uint64_t seed = Config::get()->sample_seed;
+    if (seed == 0) {
+      std::random_device rd;
+      seed = (uint64_t)rd() << 32 | rd();
+    }
+    scan->set_sample(sample_percent, seed);
+    return scan;
+  }
   std::map<int, std::shared_ptr<IndexMeta>> first_key_offsets;
   for (auto [_, index] : index_manager) {
-    first_key_offsets[index->key_offset[0]] = index;
+    /// prefer narrow keys, only a single-column hash answers point lookups
+    auto &slot = first_key_offsets[index->key_offset[0]];
+    if (slot == nullptr || index->key_offset.size() < slot->key_offset.size()) {
+      slot = index;
+    }
   }
+  /// range predicates on the same column are merged into [lbound, rbound),
+  /// IN lists on the same column are intersected
+  std::map<int, std::pair<int, int>> ranges;
+  std::map<int, std::set<int>> in_lists;
   for (auto con : cons_) {
+    if (!con->live_in(table_id)) {
+      continue;
+    }
+    if (auto cil = std::dynamic_pointer_cast<ColumnInListConstraint>(con)) {
+      if (!first_key_offsets.contains(cil->column_offset)) {
+        continue;
+      }
+      auto it = in_lists.find(cil->column_offset);
+      if (it == in_lists.end()) {
+        in_lists[cil->column_offset] = cil->vals_int;
+      } else {
+        std::erase_if(it->second,
+                      [&](int v) { return !cil->vals_int.contains(v); });
+      }
+      continue;
+    }
     auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con);
-    if (cov == nullptr || !cov->live_in(table_id) ||
-        !first_key_offsets.contains(cov->column_offset)) {
+    if (cov == nullptr || !first_key_offsets.contains(cov->column_offset)) {
       continue;
     }
-    auto index = first_key_offsets[cov->column_offset];
-    int lbound = INT_MIN + 1, rbound = INT_MAX;
-    switch (cov->op) {
-    case Operator::EQ:
-      lbound = cov->value;
-      rbound = cov->value + 1;
-      break;
-    case Operator::GE:
-      lbound = cov->value;
-      break;
-    case Operator::GT:
-      lbound = cov->value + 1;
+    auto range = key_range(cov->op, cov->value);
+    if (!range.has_value()) {
+      continue;
+    }
+    auto [it, fresh] = ranges.try_emplace(cov->column_offset, *range);
+    if (!fresh) {
+      it->second.first = std::max(it->second.first, range->first);
+      it->second.second = std::min(it->second.second, range->second);
+    }
+  }
+  /// with statistics, locators are only gathered for selective predicates,
+  /// broad ones are left to the per-row checks. the narrowest always stays
+  if (ranges.size() + in_lists.size() > 1 && get_stats() != nullptr) {
+    std::vector<std::tuple<double, bool, int>> shares;
+    for (auto [offset, range] : ranges) {
+      /// the keys from range.first to range.second - 1, both included
+      auto col = column_stats(offset);
+      shares.emplace_back(range.first >= range.second
+                              ? 0
+                              : col->fraction(Operator::LE, range.second - 1) -
+                                    col->fraction(Operator::LT, range.first),
+                          false, offset);
+    }
+    for (auto &[offset, vals] : in_lists) {
+      double share = 0;
+      for (int val : vals) {
+        share += column_stats(offset)->fraction(Operator::EQ, val);
+      }
+      shares.emplace_back(share, true, offset);
+    }
+    std::sort(shares.begin(), shares.end());
+    for (size_t i = 1; i < shares.size(); ++i) {
+      auto [share, is_list, offset] = shares[i];
+      if (share > BROAD_PREDICATE_SHARE) {
+        is_list ? in_lists.erase(offset) : ranges.erase(offset);
+      }
+    }
+  }
+  auto is_hashed_point = [&](int offset, std::pair<int, int> range) {
+    auto index = first_key_offsets[offset];
+    return index->hash != nullptr && index->key_offset.size() == 1 &&
+           range.second == range.first + 1;
+  };
+  /// a single range keeps the streaming index scan
+  if (ranges.size() == 1 && in_lists.empty()) {
+    auto [offset, range] = *ranges.begin();
+    if (!is_hashed_point(offset, range)) {
+      return std::shared_ptr<IndexIterator>(
+          new IndexIterator(first_key_offsets[offset], range.first,
+                            range.second, cons_, fields, fields_dst));
+    }
+  }
+  if (ranges.empty() && in_lists.empty()) {
+    return full_scan();
+  }
+  /// several indexed predicates: gather sorted locator sets from every index
+  /// and intersect them, an IN list is the union of its point lookups
+  std::vector<std::vector<PageLocator>> rid_sets;
+  for (auto [offset, range] : ranges) {
+    if (range.first >= range.second) {
+      rid_sets.clear();
+      rid_sets.emplace_back();
       break;
-    case Operator::LE:
-      rbound = cov->value + 1;
+    }
+    /// the IN list is cheaper to probe, the range is checked per row
+    if (in_lists.contains(offset)) {
+      continue;
+    }
+    auto index = first_key_offsets[offset];
+    rid_sets.push_back(is_hashed_point(offset, range)
+                           ? index->point_rids(range.first)
+                           : index->collect_rids(range.first, range.second));
+  }
+  for (auto &[offset, vals] : in_lists) {
+    std::vector<PageLocator> rids;
+    for (int val : vals) {
+      /// reserved as sentinels, never stored in the tree
+      if (val == INT_MIN || val == INT_MAX) {
+        continue;
+      }
+      auto part = first_key_offsets[offset]->point_rids(val);
+      rids.insert(rids.end(), part.begin(), part.end());
+    }
+    std::sort(rids.begin(), rids.end());
+    rid_sets.push_back(std::move(rids));
+  }
+  std::sort(rid_sets.begin(), rid_sets.end(),
+            [](const auto &a, const auto &b) { return a.size() < b.size(); });
+  std::vector<PageLocator> rids = std::move(rid_sets[0]), tmp;
+  for (size_t i = 1; i < rid_sets.size() && !rids.empty(); ++i) {
+    tmp.clear();
+    std::set_intersection(rids.begin(), rids.end(), rid_sets[i].begin(),
+                          rid_sets[i].end(), std::back_inserter(tmp));
+    rids.swap(tmp);
+  }
+  return std::shared_ptr<RecordIterator>(new RecordIterator(
+      record_manager, cons_, fields, fields_dst, std::move(rids)));
+}
+
+std::shared_ptr<IndexIterator> TableManager::make_ordered_iterator(
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
+    const std::vector<std::shared_ptr<Field>> &fields_dst,
+    std::shared_ptr<Field> order_field, bool desc, bool limited) {
+  auto type = order_field->datatype->type;
+  if (type != DataType::INT && type != DataType::DATE) {
+    return nullptr;
+  }
+  int offset = -1;
+  for (auto field : fields) {
+    if (field->field_id == order_field->field_id) {
+      offset = field->pers_offset;
+    }
+  }
+  if (offset == -1) {
+    return nullptr;
+  }
+  std::shared_ptr<IndexMeta> index = nullptr;
+  std::set<int> indexed_offsets;
+  for (auto [_, idx] : index_manager) {
+    indexed_offsets.insert(idx->key_offset[0]);
+    /// only an index on the column alone keeps ties in (pagenum, slotnum)
+    /// order, a longer key orders them by its other columns first
+    if (idx->key_offset[0] == offset && idx->key_offset.size() == 1) {
+      index = idx;
+    }
+  }
+  if (index == nullptr) {
+    return nullptr;
+  }
+  /// NULLs are stored in the tree under whatever bytes the slot holds, so the
+  /// index order is only the sort order once the column cannot be NULL
+  bool non_null = order_field->notnull;
+  bool other_indexed = false;
+  int lbound = INT_MIN + 1, rbound = INT_MAX;
+  for (auto con : cons_) {
+    if (!con->live_in(table_id)) {
+      continue;
+    }
+    if (auto cil = std::dynamic_pointer_cast<ColumnInListConstraint>(con)) {
+      other_indexed |= indexed_offsets.contains(cil->column_offset);
+      continue;
+    }
+    auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con);
+    if (cov == nullptr) {
+      continue;
+    }
+    if (cov->column_offset != offset) {
+      other_indexed |= indexed_offsets.contains(cov->column_offset);
+      continue;
+    }
+    auto range = key_range(cov->op, cov->value);
+    if (range.has_value()) {
+      non_null = true;
+      lbound = std::max(lbound, range->first);
+      rbound = std::min(rbound, range->second);
+    }
+  }
+  if (!non_null || (other_indexed && !limited)) {
+    return nullptr;
+  }
+  return std::shared_ptr<IndexIterator>(new IndexIterator(
+      index, lbound, rbound, cons_, fields, fields_dst, desc));
+}
+
+std::shared_ptr<IndexMeta>
+TableManager::keyed_index(std::shared_ptr<Field> key_field, int &offset) const {
+  auto type = key_field->datatype->type;
+  if (type != DataType::INT && type != DataType::DATE) {
+    return nullptr;
+  }
+  offset = -1;
+  for (auto field : fields) {
+    if (field->field_id == key_field->field_id) {
+      offset = field->pers_offset;
+    }
+  }
+  std::shared_ptr<IndexMeta> index = nullptr;
+  for (auto [_, idx] : index_manager) {
+    if (offset == -1 || idx->key_offset[0] != offset) {
+      continue;
+    }
+    if (index == nullptr || idx->key_offset.size() < index->key_offset.size()) {
+      index = idx;
+    }
+  }
+  return index;
+}
+
+bool TableManager::has_keyed_index(std::shared_ptr<Field> key_field) const {
+  int offset;
+  return keyed_index(key_field, offset) != nullptr;
+}
+
+/// guesses for predicates that the estimates below cannot work out
+static const double RANGE_SELECTIVITY = 1.0 / 3;
+static const double DEFAULT_SELECTIVITY = 0.1;
+/// changed rows that always allow a refresh, so that tiny or freshly
+/// emptied tables are not analyzed again on every query
+static const int STATS_REFRESH_MIN_ROWS = 200;
+
+void TableManager::analyze() {
+  stats = std::make_shared<TableStats>(fields, record_manager);
+}
+
+void TableManager::refresh_stats() {
+  double fraction = Config::get()->stats_refresh_fraction;
+  if (stats != nullptr && fraction > 0 &&
+      stats->n_modified >
+          std::max(fraction * stats->n_rows, (double)STATS_REFRESH_MIN_ROWS)) {
+    analyze();
+  }
+}
+
+void TableManager::count_modified(int n) {
+  if (stats != nullptr) {
+    stats->n_modified += n;
+  }
+}
+
+const ColumnStats *TableManager::column_stats(int offset) {
+  if (get_stats() == nullptr) {
+    return nullptr;
+  }
+  for (auto field : fields) {
+    if (field->pers_offset == offset) {
+      return &stats->columns[field->pers_index];
+    }
+  }
+  return nullptr;
+}
+
+double TableManager::estimate_distinct(int offset) {
+  double rows = std::max(get_record_num(), 1);
+  if (auto col = column_stats(offset)) {
+    return std::clamp(col->ndv, 1.0, rows);
+  }
+  auto single = [&](std::shared_ptr<KeyBase> key) {
+    return key != nullptr && key->fields.size() == 1 &&
+           key->fields[0]->pers_offset == offset;
+  };
+  if (single(primary_key)) {
+    return rows;
+  }
+  for (auto uk : unique_keys) {
+    if (single(uk)) {
+      return rows;
+    }
+  }
+  return std::max(1.0, rows * DEFAULT_SELECTIVITY);
+}
+
+double TableManager::estimate_selectivity(
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_) {
+  /// the histogram answers integer predicates, which carry their value
+  auto int_stats = [&](int offset) -> const ColumnStats * {
+    auto col = column_stats(offset);
+    return col != nullptr && (col->type == DataType::INT ||
+                              col->type == DataType::DATE)
+               ? col
+               : nullptr;
+  };
+  double sel = 1;
+  for (auto con : cons_) {
+    if (!con->live_in(table_id)) {
+      continue;
+    }
+    if (auto cnc = std::dynamic_pointer_cast<ColumnNullConstraint>(con)) {
+      auto col = column_stats(cnc->column_offset);
+      sel *= col == nullptr ? DEFAULT_SELECTIVITY
+             : cnc->not_null ? 1 - col->null_frac
+                             : col->null_frac;
+      continue;
+    }
+    if (auto cil = std::dynamic_pointer_cast<ColumnInListConstraint>(con)) {
+      if (auto col = int_stats(cil->column_offset)) {
+        double in = 0;
+        for (int v : cil->vals_int) {
+          in += col->fraction(Operator::EQ, v);
+        }
+        sel *= std::min(1.0, in) * (1 - col->null_frac);
+        continue;
+      }
+      size_t n_vals = cil->vals_int.size() + cil->vals_float.size() +
+                      cil->vals_str.size();
+      sel *= cil->column_offset == -1
+                 ? DEFAULT_SELECTIVITY
+                 : std::min(1.0, n_vals / estimate_distinct(
+                                         cil->column_offset));
+      continue;
+    }
+    auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con);
+    if (cov == nullptr) {
+      sel *= DEFAULT_SELECTIVITY;
+      continue;
+    }
+    if (auto col = int_stats(cov->column_offset)) {
+      sel *= col->fraction(cov->op, cov->value) * (1 - col->null_frac);
+      continue;
+    }
+    /// cmp_op is the operator as written for every column type
+    switch (cov->cmp_op) {
+    case Operator::EQ:
+      sel /= estimate_distinct(cov->column_offset);
       break;
-    case Operator::LT:
-      rbound = cov->value;
+    case Operator::NE:
+      sel *= 1 - 1 / estimate_distinct(cov->column_offset);
       break;
     default:
+      sel *= RANGE_SELECTIVITY;
+    }
+  }
+  return sel;
+}
+
+std::shared_ptr<IndexIterator> TableManager::make_keyed_iterator(
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
+    const std::vector<std::shared_ptr<Field>> &fields_dst,
+    std::shared_ptr<Field> key_field, bool defer_to_others) {
+  int offset;
+  auto index = keyed_index(key_field, offset);
+  if (index == nullptr) {
+    return nullptr;
+  }
+  std::set<int> indexed_offsets;
+  for (auto [_, idx] : index_manager) {
+    indexed_offsets.insert(idx->key_offset[0]);
+  }
+  int lbound = INT_MIN + 1, rbound = INT_MAX;
+  for (auto con : cons_) {
+    if (!con->live_in(table_id)) {
+      continue;
+    }
+    if (auto cil = std::dynamic_pointer_cast<ColumnInListConstraint>(con)) {
+      if (defer_to_others && indexed_offsets.contains(cil->column_offset)) {
+        return nullptr;
+      }
+      continue;
+    }
+    auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con);
+    if (cov == nullptr) {
+      continue;
+    }
+    if (cov->column_offset != offset) {
+      if (defer_to_others && indexed_offsets.contains(cov->column_offset)) {
+        return nullptr;
+      }
+      continue;
+    }
+    auto range = key_range(cov->op, cov->value);
+    if (range.has_value()) {
+      lbound = std::max(lbound, range->first);
+      rbound = std::min(rbound, range->second);
+    }
+  }
+  return std::shared_ptr<IndexIterator>(new IndexIterator(
+      index, lbound, rbound, cons_, fields, fields_dst));
+}
+
+std::shared_ptr<MetaAggregateIterator> TableManager::make_meta_aggregate(
+    const std::vector<std::shared_ptr<WhereConstraint>> &cons_,
+    const std::vector<std::shared_ptr<Field>> &columns,
+    const std::vector<Aggregator> &aggrs) {
+  auto leading_index = [&](int offset) {
+    std::shared_ptr<IndexMeta> ret = nullptr;
+    for (auto [_, index] : index_manager) {
+      if (index->key_offset[0] != offset) {
+        continue;
+      }
+      if (ret == nullptr || index->key_offset.size() < ret->key_offset.size()) {
+        ret = index;
+      }
+    }
+    return ret;
+  };
+  auto local_field = [&](std::shared_ptr<Field> field) {
+    std::shared_ptr<Field> ret = nullptr;
+    for (auto f : fields) {
+      if (field != nullptr && f->field_id == field->field_id) {
+        ret = f;
+      }
+    }
+    return ret;
+  };
+  /// the WHERE clause has to reduce to a single indexed range
+  std::shared_ptr<Field> range_field = nullptr;
+  int lbound = INT_MIN + 1, rbound = INT_MAX;
+  for (auto con : cons_) {
+    auto cov = std::dynamic_pointer_cast<ColumnOpValueConstraint>(con);
+    if (cov == nullptr || !cov->live_in(table_id)) {
+      return nullptr;
+    }
+    auto range = key_range(cov->op, cov->value);
+    if (!range.has_value()) {
+      return nullptr;
+    }
+    auto field = *std::find_if(fields.begin(), fields.end(), [&](auto f) {
+      return f->pers_offset == cov->column_offset;
+    });
+    if (range_field != nullptr && range_field != field) {
+      return nullptr;
+    }
+    range_field = field;
+    lbound = std::max(lbound, range->first);
+    rbound = std::min(rbound, range->second);
+  }
+  std::vector<MetaAggregateIterator::Source> sources;
+  for (size_t i = 0; i < columns.size(); ++i) {
+    auto field = local_field(columns[i]);
+    if (aggrs[i] == Aggregator::COUNT && columns[i] == nullptr) {
+      field = range_field;
+    } else if (aggrs[i] != Aggregator::MIN && aggrs[i] != Aggregator::MAX) {
+      return nullptr;
+    } else if (field == nullptr ||
+               (field->datatype->type != DataType::INT &&
+                field->datatype->type != DataType::DATE) ||
+               (range_field != nullptr && range_field != field)) {
+      return nullptr;
+    }
+    if (field == nullptr) {
+      sources.push_back({aggrs[i], nullptr, -1});
       continue;
     }
-    return std::shared_ptr<IndexIterator>(
-        new IndexIterator(index, lbound, rbound, cons_, fields, fields_dst));
+    auto index = leading_index(field->pers_offset);
+    if (index == nullptr) {
+      return nullptr;
+    }
+    sources.push_back({aggrs[i], index, field->pers_index});
   }
-  return std::shared_ptr<RecordIterator>(
-      new RecordIterator(record_manager, cons_, fields, fields_dst));
-}
\ No newline at end of file
+  return std::make_shared<MetaAggregateIterator>(
+      record_manager, std::move(sources), lbound, rbound, columns);
+}
@@ -19,6 +19,7 @@ std::any ScapeVisitor::visitProgram(SQLParser::ProgramContext *ctx) {
 std::any ScapeVisitor::visitStatement(SQLParser::StatementContext *ctx) {
   /// do redundant checking
   has_err = false;
+  spilled_bytes = 0;
   tables_stack.clear();
   insert_into_table = nullptr;
   return visitChildren(ctx);
@@ -52,6 +53,12 @@ std::any ScapeVisitor::visitShow_tables(SQLParser::Show_tablesContext *ctx) {
   return true;
 }
 
+std::any
+ScapeVisitor::visitShow_indexes(SQLParser::Show_indexesContext *ctx) {
+  ScapeSQL::show_indexes();
+  return true;
+}
+
 std::any ScapeVisitor::visitCreate_table(SQLParser::Create_tableContext *ctx) {
   std::string tbl_name = ctx->Identifier()->getText();
   if (ctx->field_list() == nullptr) {
@@ -82,6 +89,13 @@ ScapeVisitor::visitDescribe_table(SQLParser::Describe_tableContext *ctx) {
   return tbl_name;
 }
 
+std::any
+ScapeVisitor::visitAnalyze_table(SQLParser::Analyze_tableContext *ctx) {
+  std::string tbl_name = ctx->Identifier()->getText();
+  ScapeSQL::analyze_table(tbl_name);
+  return tbl_name;
+}
+
 std::any ScapeVisitor::visitLoad_table(SQLParser::Load_tableContext *ctx) {
   if (ctx->String(0) == nullptr || ctx->Identifier() == nullptr) {
     has_err = true;
@@ -110,7 +124,11 @@ ScapeVisitor::visitInsert_into_table(SQLParser::Insert_into_tableContext *ctx) {
     has_err = true;
     return std::any();
   }
+  insert_rows.clear();
   ctx->value_lists()->accept(this);
+  n_entries_inserted = insert_into_table->insert_records(insert_rows);
+  insert_into_table->refresh_stats();
+  insert_rows.clear();
   /// reset table data so that (column IN value_list) can be parse correctly
   insert_into_table = nullptr;
   if (!has_err) {
@@ -254,18 +272,16 @@ std::any ScapeVisitor::visitSelect_table(SQLParser::Select_tableContext *ctx) {
     if (!ret.has_value()) {
       return std::any();
     }
-    planner->group_by_field =
-        std::any_cast<std::shared_ptr<Field>>(std::move(ret));
+    planner->group_by =
+        std::any_cast<std::vector<std::shared_ptr<Field>>>(std::move(ret));
   }
   if (ctx->order_by() != nullptr) {
     auto ret = ctx->order_by()->accept(this);
     if (!ret.has_value()) {
       return std::any();
     }
-    auto tmp =
-        std::any_cast<std::pair<std::shared_ptr<Field>, bool>>(std::move(ret));
-    planner->order_by_field = tmp.first;
-    planner->order_by_desc = tmp.second;
+    planner->order_by = std::any_cast<
+        std::vector<std::pair<std::shared_ptr<Field>, bool>>>(std::move(ret));
   }
   if (ctx->select_limit() != nullptr) {
     planner->req_limit = std::stoi(ctx->select_limit()->Integer()->getText());
@@ -274,6 +290,21 @@ std::any ScapeVisitor::visitSelect_table(SQLParser::Select_tableContext *ctx) {
           std::stoi(ctx->select_offset()->Integer()->getText());
     }
   }
+  if (ctx->table_sample() != nullptr) {
+    int percent = std::stoi(ctx->table_sample()->Integer()->getText());
+    if (percent < 1 || percent > 100) {
+      printf("ERROR: TABLESAMPLE takes 1 to 100 PERCENT\n");
+      has_err = true;
+      return std::any();
+    }
+    if (table_names.size() != 1) {
+      printf("ERROR: TABLESAMPLE takes a single table\n");
+      has_err = true;
+      return std::any();
+    }
+    planner->sample_percent = percent;
+  }
+  planner->distinct = ctx->Distinct() != nullptr;
   planner->selector = std::move(selector);
   planner->tables = std::move(tables_stack.back());
   planner->constraints = std::move(constraints);
@@ -283,15 +314,31 @@ std::any ScapeVisitor::visitSelect_table(SQLParser::Select_tableContext *ctx) {
 }
 
 std::any ScapeVisitor::visitGroup_by(SQLParser::Group_byContext *ctx) {
-  auto ret = ctx->column()->accept(this);
-  if (!ret.has_value()) {
-    return std::any();
+  std::vector<std::shared_ptr<Field>> fields;
+  for (auto column : ctx->column()) {
+    auto ret = column->accept(this);
+    if (!ret.has_value()) {
+      return std::any();
+    }
+    fields.push_back(std::any_cast<std::shared_ptr<Field>>(std::move(ret)));
   }
-  auto field = std::any_cast<std::shared_ptr<Field>>(std::move(ret));
-  return field;
+  return fields;
 }
 
 std::any ScapeVisitor::visitOrder_by(SQLParser::Order_byContext *ctx) {
+  std::vector<std::pair<std::shared_ptr<Field>, bool>> order_by;
+  for (auto item : ctx->order_item()) {
+    auto ret = item->accept(this);
+    if (!ret.has_value()) {
+      return std::any();
+    }
+    order_by.push_back(
+        std::any_cast<std::pair<std::shared_ptr<Field>, bool>>(std::move(ret)));
+  }
+  return order_by;
+}
+
+std::any ScapeVisitor::visitOrder_item(SQLParser::Order_itemContext *ctx) {
   auto ret = ctx->column()->accept(this);
   if (!ret.has_value()) {
     return std::any();
@@ -418,8 +465,8 @@ std::any ScapeVisitor::visitValue_list(SQLParser::Value_listContext *ctx) {
     vals.push_back(val->accept(this));
   }
   if (insert_into_table != nullptr) {
-    insert_into_table->insert_record(vals);
-    n_entries_inserted++;
+    /// inserted as one batch by visitInsert_into_table
+    insert_rows.push_back(vals);
   }
   return vals;
 }
@@ -481,14 +528,17 @@ std::any ScapeVisitor::visitSelectors(SQLParser::SelectorsContext *ctx) {
 
 /// @return: (caption, field, aggregator)
 /// column | aggregator '(' column ')' | Count '(' '*' ')'
+/// | Count '(' Distinct column ')'
 std::any ScapeVisitor::visitSelector(SQLParser::SelectorContext *ctx) {
-  if (ctx->Count() != nullptr) {
+  if (ctx->Count() != nullptr && ctx->Distinct() == nullptr) {
     return std::make_tuple<std::string, std::shared_ptr<Field>, Aggregator>(
         "COUNT(*)", nullptr, Aggregator::COUNT);
   }
   Aggregator aggr = Aggregator::NONE;
   if (ctx->aggregator() != nullptr) {
     aggr = str2aggr(ctx->aggregator()->getText());
+  } else if (ctx->Distinct() != nullptr) {
+    aggr = Aggregator::COUNT_DISTINCT;
   }
   auto ret = ctx->column()->accept(this);
   if (!ret.has_value()) {
@@ -498,7 +548,9 @@ std::any ScapeVisitor::visitSelector(SQLParser::SelectorContext *ctx) {
 
   std::string caption;
   caption = ctx->column()->identifier().back()->getText();
-  if (aggr != Aggregator::NONE) {
+  if (aggr == Aggregator::COUNT_DISTINCT) {
+    caption = "COUNT(DISTINCT " + ctx->column()->getText() + ")";
+  } else if (aggr != Aggregator::NONE) {
     caption = ctx->getText();
   }
 
@@ -654,6 +706,23 @@ std::any ScapeVisitor::visitWhere_operator_select(
       new ColumnOpSubqueryConstraint(field, op, subquery));
 }
 
+/// column 'IN' value_list
+std::any
+ScapeVisitor::visitWhere_in_list(SQLParser::Where_in_listContext *ctx) {
+  auto ret = ctx->column()->accept(this);
+  if (!ret.has_value()) {
+    return std::any();
+  }
+  auto field = std::any_cast<std::shared_ptr<Field>>(std::move(ret));
+  ret = ctx->value_list()->accept(this);
+  if (!ret.has_value()) {
+    return std::any();
+  }
+  auto vals = std::any_cast<std::vector<std::any>>(std::move(ret));
+  return std::shared_ptr<WhereConstraint>(
+      new ColumnInListConstraint(field, std::move(vals)));
+}
+
 std::any
 ScapeVisitor::visitWhere_in_select(SQLParser::Where_in_selectContext *ctx) {
   auto ret = ctx->column()->accept(this);
@@ -737,7 +806,9 @@ std::any ScapeVisitor ::visitAlter_table_drop_foreign_key(
   return std::any();
 }
 
-/// 'ALTER' 'TABLE' Identifier 'ADD' 'INDEX' (Identifier)? '(' identifiers ')'
+// clang-format off
+/// 'ALTER' 'TABLE' Identifier 'ADD' 'INDEX' (Identifier)? '(' identifiers ')' ('USING' index_type)?
+// clang-format on
 std::any
 ScapeVisitor::visitAlter_add_index(SQLParser::Alter_add_indexContext *ctx) {
   auto exp = std::make_shared<ExplicitIndexKey>();
@@ -750,6 +821,8 @@ ScapeVisitor::visitAlter_add_index(SQLParser::Alter_add_indexContext *ctx) {
   }
   exp->field_names =
       std::any_cast<std::vector<std::string>>(ctx->identifiers()->accept(this));
+  exp->use_hash =
+      ctx->index_type() != nullptr && ctx->index_type()->getText() == "HASH";
   ScapeSQL::add_index(ctx->Identifier(0)->getText(), exp);
   return std::any();
 }
@@ -37,6 +37,26 @@ int main(int argc, char **argv) {
       .implicit_value(true);
   parser.add_argument("--data-dir")
       .help("specify <datadir: string = \"./data\"> as root of database files");
+  parser.add_argument("--no-vectorize")
+      .help("scan and aggregate one row at a time")
+      .default_value(false)
+      .implicit_value(true);
+  parser.add_argument("--stats-refresh")
+      .help("specify <fraction: float = 0.2> of changed rows that refreshes "
+            "table statistics, 0 to refresh only on ANALYZE TABLE")
+      .scan<'g', double>();
+  parser.add_argument("--hash-memory")
+      .help("specify <megabytes: int = 256> a DISTINCT or GROUP BY hash "
+            "table holds before it spills to temp files")
+      .scan<'i', int>();
+  parser.add_argument("--threads")
+      .help("specify <threads: int = cores> that scan large tables, 1 to "
+            "scan on a single thread")
+      .scan<'i', int>();
+  parser.add_argument("--sample-seed")
+      .help("specify <seed: int = 0> of the pages TABLESAMPLE reads, 0 for "
+            "a new choice on every query")
+      .scan<'i', int>();
   try {
     parser.parse_args(argc, argv);
   } catch (const std::runtime_error &e) {
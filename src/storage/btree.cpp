@@ -17,6 +17,7 @@ void BPlusTree::serialize(SequentialAccessor &accessor) const {
   accessor.write<uint32_t>(leaf_data_len);
   accessor.write<uint32_t>(internal_max);
   accessor.write<uint32_t>(leaf_max);
+  accessor.write<uint32_t>(ikey_num);
 }
 
 BPlusTree::BPlusTree(SequentialAccessor &accessor) {
@@ -29,14 +30,17 @@ BPlusTree::BPlusTree(SequentialAccessor &accessor) {
   leaf_data_len = accessor.read<uint32_t>();
   internal_max = accessor.read<uint32_t>();
   leaf_max = accessor.read<uint32_t>();
+  ikey_num = accessor.read<uint32_t>();
 }
 
-BPlusTree::BPlusTree(const std::string &filename, int key_num, int record_len)
+BPlusTree::BPlusTree(const std::string &filename, int key_num, int record_len,
+                     bool truncate_separators)
     : filename(filename), key_num(key_num), leaf_data_len(record_len) {
   ensure_file(filename);
   fd = FileMapping::get()->open_file(filename);
+  ikey_num = truncate_separators && key_num > 2 ? key_num - 2 : key_num;
   internal_max = (Config::PAGE_SIZE - sizeof(BPlusNodeMeta)) /
-                 (sizeof(int) * (key_num + 1));
+                 (sizeof(int) * (ikey_num + 1));
   leaf_max = (Config::PAGE_SIZE - sizeof(BPlusNodeMeta)) /
              (sizeof(int) * key_num + leaf_data_len);
   n_pages = 0;
@@ -53,8 +57,8 @@ BPlusTree::BPlusTree(const std::string &filename, int key_num, int record_len)
   }
 }
 
-int BPlusTree::compare_key(const int *a, const int *b) const {
-  for (int i = 0; i < key_num; ++i) {
+int BPlusTree::compare_prefix(const int *a, const int *b, int width) const {
+  for (int i = 0; i < width; ++i) {
     if (a[i] < b[i]) {
       return -1;
     } else if (a[i] > b[i]) {
@@ -64,9 +68,63 @@ int BPlusTree::compare_key(const int *a, const int *b) const {
   return 0;
 }
 
-int BPlusTree::bin_search(int *a, int len, const std::vector<int> &key,
-                          Operator op) const {
+/// lexicographic comparison unrolled for a fixed key width
+template <int K> inline int compare_fixed(const int *a, const int *b) {
+  for (int i = 0; i < K; ++i) {
+    if (a[i] != b[i])
+      return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+template <int K>
+int BPlusTree::bin_search_fixed(const int *a, int len, const int *key,
+                                Operator op) const {
+  /// count entries < key (LT, GE, EQ) or <= key (LE, GT)
+  const int bound = (op == Operator::LE || op == Operator::GT) ? 1 : 0;
+  int base = 0, n = len;
+  while (n > 1) {
+    int half = n >> 1;
+    /// both possible next probes, the select below does not wait on them
+    __builtin_prefetch(a + (base + half / 2) * K);
+    __builtin_prefetch(a + (base + half + half / 2) * K);
+    base = compare_fixed<K>(a + (base + half) * K, key) < bound ? base + half
+                                                                : base;
+    n -= half;
+  }
+  int pos = base + (len > 0 && compare_fixed<K>(a + base * K, key) < bound);
+  switch (op) {
+  case Operator::LT:
+  case Operator::LE:
+    return pos - 1;
+  case Operator::GT:
+  case Operator::GE:
+    return pos;
+  case Operator::EQ:
+    return pos < len && compare_fixed<K>(a + pos * K, key) == 0 ? pos : -1;
+  default:
+    return -1;
+  }
+}
+
+int BPlusTree::bin_search(const int *a, int len, const std::vector<int> &key,
+                          Operator op, NodeType type) const {
   assert(op != Operator::NE);
+  /// an index key is its columns plus (pagenum, slotnum),
+  /// truncated separators of one or two columns are narrower still
+  int width = key_width(type);
+  switch (width) {
+  case 1:
+    return bin_search_fixed<1>(a, len, key.data(), op);
+  case 2:
+    return bin_search_fixed<2>(a, len, key.data(), op);
+  case 3:
+    return bin_search_fixed<3>(a, len, key.data(), op);
+  case 4:
+    return bin_search_fixed<4>(a, len, key.data(), op);
+  default:
+    break;
+  }
   int l = 0, r = len - 1, mid, ans;
   if (op == Operator::LT || op == Operator::LE || op == Operator::EQ) {
     ans = -1;
@@ -75,7 +133,7 @@ int BPlusTree::bin_search(int *a, int len, const std::vector<int> &key,
   }
   while (l <= r) {
     mid = (l + r) >> 1;
-    int result = compare_key(a + mid * key_num, key.data());
+    int result = compare_prefix(a + mid * width, key.data(), width);
     if (result == -1) { /// a[mid] < key[0]
       l = mid + 1;
       if (op == Operator::LT || op == Operator::LE) {
@@ -134,7 +192,8 @@ void BPlusTree::page_array_insert(NodeType type, int *keys, uint8_t *data,
                                   int size, int pos) {
   if (pos < 0)
     return;
-  native_array_insert((uint8_t *)keys, size, pos, key_num * sizeof(int), bbuf);
+  native_array_insert((uint8_t *)keys, size, pos,
+                      key_width(type) * sizeof(int), bbuf);
   native_array_insert(data, size, pos,
                       type == NodeType::LEAF ? leaf_data_len : sizeof(int),
                       bbuf);
@@ -142,7 +201,8 @@ void BPlusTree::page_array_insert(NodeType type, int *keys, uint8_t *data,
 
 void BPlusTree::page_array_remove(NodeType type, int *keys, uint8_t *data,
                                   int size, int pos) {
-  native_array_remove((uint8_t *)keys, size, pos, key_num * sizeof(int), bbuf);
+  native_array_remove((uint8_t *)keys, size, pos,
+                      key_width(type) * sizeof(int), bbuf);
   native_array_remove(data, size, pos,
                       type == NodeType::LEAF ? leaf_data_len : sizeof(int),
                       bbuf);
@@ -154,7 +214,7 @@ void BPlusTree::leaf_insert(uint8_t *slice, const std::vector<int> &key,
   int *keys;
   uint8_t *data;
   prepare_from_slice(slice, meta, keys, data);
-  int pos = bin_search(keys, meta->size, key, Operator::GT);
+  int pos = bin_search(keys, meta->size, key, Operator::GT, NodeType::LEAF);
 
   page_array_insert(NodeType::LEAF, keys, data, meta->size, pos);
   memcpy(keys + pos * key_num, key.data(), key_num * sizeof(int));
@@ -176,9 +236,14 @@ void BPlusTree::leaf_split(int pagenum, uint8_t *slice,
   prepare_from_slice(nwslice, nwmeta, nwkeys, nwdata, NodeType::LEAF);
 
   int pos = bin_search((int *)(slice + sizeof(BPlusNodeMeta)), leaf_max,
-                       key_pushup, Operator::GT);
+                       key_pushup, Operator::GT, NodeType::LEAF);
   int lsize = (leaf_max + 1) / 2;
-  if (pos < lsize) {
+  /// appending right before the INT_MAX sentinel: the left page stays full
+  /// and only the sentinel moves, keeping sequential inserts dense
+  bool append = meta->right_sibling == -1 && pos == leaf_max - 1;
+  if (append) {
+    lsize = leaf_max - 1;
+  } else if (pos < lsize) {
     lsize--; /// still pos <= lsize
   }
   int rsize = leaf_max - lsize;
@@ -187,9 +252,12 @@ void BPlusTree::leaf_split(int pagenum, uint8_t *slice,
   memcpy(nwdata, data + lsize * leaf_data_len, rsize * leaf_data_len);
   *nwmeta =
       (BPlusNodeMeta){pagenum, meta->right_sibling, rsize, -1, NodeType::LEAF};
+  if (meta->right_sibling != -1) {
+    set_left_sibling(meta->right_sibling, nwpage);
+  }
   meta->right_sibling = nwpage;
   meta->size = lsize;
-  if (pos <= lsize) {
+  if (pos <= lsize && !append) {
     leaf_insert(slice, key_pushup, record);
   } else {
     leaf_insert(nwslice, key_pushup, record);
@@ -204,17 +272,19 @@ void BPlusTree::internal_insert(uint8_t *slice, const std::vector<int> key,
   int *keys;
   uint8_t *data;
   prepare_from_slice(slice, meta, keys, data);
-  int pos =
-      meta->size == 0 ? 0 : bin_search(keys, meta->size, key, Operator::GT);
+  int pos = meta->size == 0 ? 0
+                            : bin_search(keys, meta->size, key, Operator::GT,
+                                         NodeType::INTERNAL);
 
   page_array_insert(NodeType::INTERNAL, keys, data, meta->size, pos);
-  memcpy(keys + pos * key_num, key.data(), sizeof(int) * key_num);
+  memcpy(keys + pos * ikey_num, key.data(), sizeof(int) * ikey_num);
   ((int *)data)[pos] = val;
   ++meta->size;
 }
 
 void BPlusTree::internal_split(int pagenum, uint8_t *slice,
-                               std::vector<int> &key_pushup, int &val_pushup) {
+                               std::vector<int> &key_pushup, int &val_pushup,
+                               bool rightmost) {
   BPlusNodeMeta *meta, *nwmeta;
   int *keys, *nwkeys;
   uint8_t *data, *nwdata;
@@ -224,31 +294,37 @@ void BPlusTree::internal_split(int pagenum, uint8_t *slice,
   prepare_from_slice(slice, meta, keys, data);
   prepare_from_slice(nwslice, nwmeta, nwkeys, nwdata, NodeType::INTERNAL);
 
-  int pos = bin_search(keys, internal_max, key_pushup, Operator::GT);
+  int pos = bin_search(keys, internal_max, key_pushup, Operator::GT,
+                       NodeType::INTERNAL);
   int lsize = (internal_max + 1) / 2;
-  if (pos < lsize) {
+  bool append = rightmost && pos == internal_max;
+  if (append) {
+    lsize = internal_max - 1;
+  } else if (pos < lsize) {
     lsize--;
   }
   int rsize = internal_max - lsize;
 
-  memcpy(nwkeys, keys + lsize * key_num, rsize * key_num * sizeof(int));
+  memcpy(nwkeys, keys + lsize * ikey_num, rsize * ikey_num * sizeof(int));
   memcpy(nwdata, data + lsize * sizeof(int), rsize * sizeof(int));
   nwmeta->size = rsize;
   nwmeta->next_empty = -1;
   nwmeta->type = NodeType::INTERNAL;
   meta->size = lsize;
-  if (pos <= lsize) {
+  if (pos <= lsize && !append) {
     internal_insert(slice, key_pushup, val_pushup);
   } else {
     internal_insert(nwslice, key_pushup, val_pushup);
   }
-  memcpy(key_pushup.data(), nwkeys, key_num * sizeof(int));
+  memcpy(key_pushup.data(), nwkeys, ikey_num * sizeof(int));
   val_pushup = nwpage;
 }
 
 void BPlusTree::insert(const std::vector<int> &key, const uint8_t *record) {
   int pagenum_cur = pagenum_root;
-  std::vector<int> stack;
+  /// (pagenum, whether the node lies on the right edge of its level)
+  std::vector<std::pair<int, bool>> stack;
+  bool rightmost = true;
   uint8_t *slice, *data;
   BPlusNodeMeta *meta;
   int *keys;
@@ -258,8 +334,10 @@ void BPlusTree::insert(const std::vector<int> &key, const uint8_t *record) {
     if (meta->type == NodeType::LEAF) {
       break;
     } else {
-      int idx = bin_search(keys, meta->size, key, Operator::LE);
-      stack.push_back(pagenum_cur);
+      int idx =
+          bin_search(keys, meta->size, key, Operator::LE, NodeType::INTERNAL);
+      stack.emplace_back(pagenum_cur, rightmost);
+      rightmost = rightmost && idx == meta->size - 1;
       pagenum_cur = ((int *)data)[idx];
     }
   }
@@ -281,9 +359,9 @@ void BPlusTree::insert(const std::vector<int> &key, const uint8_t *record) {
       int nwpage = alloc_page();
       slice = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, nwpage));
       prepare_from_slice(slice, meta, keys, data, NodeType::INTERNAL);
-      for (int i = 0; i < key_num; i++)
+      for (int i = 0; i < ikey_num; i++)
         keys[i] = INT_MIN;
-      memcpy(keys + key_num, key_pushup.data(), key_num * sizeof(int));
+      memcpy(keys + ikey_num, key_pushup.data(), ikey_num * sizeof(int));
       ((int *)data)[0] = pagenum_cur;
       ((int *)data)[1] = val_pushup;
       meta->size = 2;
@@ -292,7 +370,8 @@ void BPlusTree::insert(const std::vector<int> &key, const uint8_t *record) {
       pagenum_root = nwpage;
       return;
     }
-    pagenum_cur = stack.back();
+    pagenum_cur = stack.back().first;
+    rightmost = stack.back().second;
     stack.pop_back();
     slice = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, pagenum_cur));
     prepare_from_slice(slice, meta, keys, data);
@@ -300,7 +379,49 @@ void BPlusTree::insert(const std::vector<int> &key, const uint8_t *record) {
       internal_insert(slice, key_pushup, val_pushup);
       return;
     }
-    internal_split(pagenum_cur, slice, key_pushup, val_pushup);
+    internal_split(pagenum_cur, slice, key_pushup, val_pushup, rightmost);
+  }
+}
+
+void BPlusTree::insert_sorted(const std::vector<std::vector<int>> &keys,
+                              const std::vector<const uint8_t *> &records) {
+  size_t i = 0, n = keys.size();
+  /// smallest separator to the right of the path, bounds the leaf reached
+  std::vector<int> fence;
+  while (i < n) {
+    int pagenum_cur = pagenum_root;
+    bool has_fence = false;
+    uint8_t *slice, *data;
+    BPlusNodeMeta *meta;
+    int *nkeys;
+    while (true) {
+      slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum_cur));
+      prepare_from_slice(slice, meta, nkeys, data);
+      if (meta->type == NodeType::LEAF) {
+        break;
+      }
+      int idx = bin_search(nkeys, meta->size, keys[i], Operator::LE,
+                           NodeType::INTERNAL);
+      if (idx + 1 < meta->size) {
+        fence.assign(nkeys + (idx + 1) * ikey_num,
+                     nkeys + (idx + 2) * ikey_num);
+        has_fence = true;
+      }
+      pagenum_cur = ((int *)data)[idx];
+    }
+    if (meta->size >= leaf_max) {
+      insert(keys[i], records[i]);
+      ++i;
+      continue;
+    }
+    slice = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, pagenum_cur));
+    prepare_from_slice(slice, meta, nkeys, data);
+    do {
+      leaf_insert(slice, keys[i], records[i]);
+      ++i;
+    } while (i < n && meta->size < leaf_max &&
+             (!has_fence ||
+              compare_prefix(keys[i].data(), fence.data(), ikey_num) < 0));
   }
 }
 
@@ -317,13 +438,15 @@ bool BPlusTree::erase(const std::vector<int> &key) {
     if (meta->type == NodeType::LEAF) {
       break;
     } else {
-      int idx = bin_search(keys, meta->size, key, Operator::LE);
+      int idx =
+          bin_search(keys, meta->size, key, Operator::LE, NodeType::INTERNAL);
       stack.emplace_back(pagenum_cur, idx);
       pagenum_cur = ((int *)data)[idx];
     }
   }
 
-  int idx_to_remove = bin_search(keys, meta->size, key, Operator::EQ);
+  int idx_to_remove =
+      bin_search(keys, meta->size, key, Operator::EQ, NodeType::LEAF);
   if (idx_to_remove == -1 ||
       compare_key(keys + idx_to_remove * key_num, key.data()) != 0) {
     return false;
@@ -334,11 +457,10 @@ bool BPlusTree::erase(const std::vector<int> &key) {
   int kth_cur, kth_sibling, pagenum_sibling, pagenum_parent;
 
   while (true) {
-    /// copy my key first, since idx_to_remove can be 0
     int thresh = (get_cap(type) + 1) / 2;
     int cur_data_len = type == NodeType::LEAF ? leaf_data_len : sizeof(int);
+    int cur_key_num = key_width(type);
 
-    std::vector<int> temp = std::vector<int>(keys, keys + key_num);
     if (propagate_delete) {
       page_array_remove(type, keys, data, meta->size, idx_to_remove);
       --meta->size;
@@ -367,7 +489,7 @@ bool BPlusTree::erase(const std::vector<int> &key) {
 
     if (propagate_zeroidx) {
       /// the deleted key is at least in parent
-      memcpy(pkeys + kth_cur * key_num, keys, key_num * sizeof(int));
+      memcpy(pkeys + kth_cur * ikey_num, keys, ikey_num * sizeof(int));
       propagate_zeroidx = propagate_zeroidx && kth_cur == 0;
       if (!propagate_delete && !propagate_zeroidx) {
         break;
@@ -386,18 +508,19 @@ bool BPlusTree::erase(const std::vector<int> &key) {
         int idx_insert = kth_cur == 0 ? meta->size : 0;
 
         page_array_insert(type, keys, data, meta->size, idx_insert);
-        memcpy(keys + idx_insert * key_num, skeys + idx_borrow * key_num,
-               key_num * sizeof(int));
+        memcpy(keys + idx_insert * cur_key_num,
+               skeys + idx_borrow * cur_key_num, cur_key_num * sizeof(int));
         memcpy(data + idx_insert * cur_data_len,
                sdata + idx_borrow * cur_data_len, cur_data_len);
         page_array_remove(type, skeys, sdata, smeta->size, idx_borrow);
         --smeta->size;
         ++meta->size;
         if (idx_borrow == 0) { /// sibling key modify
-          memcpy(pkeys + kth_sibling * key_num, skeys, key_num * sizeof(int));
+          memcpy(pkeys + kth_sibling * ikey_num, skeys,
+                 ikey_num * sizeof(int));
         }
         if (idx_insert == 0) { /// this key modify
-          memcpy(pkeys + kth_cur * key_num, keys, key_num * sizeof(int));
+          memcpy(pkeys + kth_cur * ikey_num, keys, ikey_num * sizeof(int));
         }
         // won't cause new zeroidx propagation here
         propagate_delete = false;
@@ -413,13 +536,16 @@ bool BPlusTree::erase(const std::vector<int> &key) {
           std::swap(keys, skeys);
           std::swap(data, sdata);
         }
-        memcpy(keys + meta->size * key_num, skeys,
-               smeta->size * key_num * sizeof(int));
+        memcpy(keys + meta->size * cur_key_num, skeys,
+               smeta->size * cur_key_num * sizeof(int));
         memcpy(data + meta->size * cur_data_len, sdata,
                smeta->size * cur_data_len);
         meta->size += smeta->size;
         if (type == NodeType::LEAF) {
           meta->right_sibling = smeta->right_sibling;
+          if (meta->right_sibling != -1) {
+            set_left_sibling(meta->right_sibling, pagenum_cur);
+          }
         }
 
         free_page(pagenum_sibling);
@@ -444,16 +570,17 @@ BPlusTree::eq_match(const std::vector<int> &key) const {
         PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum_cur));
     BPlusNodeMeta *meta = (BPlusNodeMeta *)slice;
     int *keys = (int *)(slice + sizeof(BPlusNodeMeta));
-    int *data = keys + key_num * get_cap(meta->type);
+    int *data = keys + key_width(meta->type) * get_cap(meta->type);
     if (meta->type == NodeType::LEAF) {
-      int idx = bin_search(keys, meta->size, key, Operator::EQ);
+      int idx = bin_search(keys, meta->size, key, Operator::EQ, NodeType::LEAF);
       if (idx == -1 || compare_key(keys + idx * key_num, key.data()) != 0) {
         return std::nullopt;
       }
       return (BPlusQueryResult){pagenum_cur, idx, keys + idx * key_num,
                                 ((uint8_t *)data) + leaf_data_len * idx};
     } else {
-      int idx = bin_search(keys, meta->size, key, Operator::LE);
+      int idx =
+          bin_search(keys, meta->size, key, Operator::LE, NodeType::INTERNAL);
       pagenum_cur = data[idx];
     }
   }
@@ -466,9 +593,21 @@ BPlusQueryResult BPlusTree::le_match(const std::vector<int> &key) const {
         PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum_cur));
     BPlusNodeMeta *meta = (BPlusNodeMeta *)slice;
     int *keys = (int *)(slice + sizeof(BPlusNodeMeta));
-    int *data = keys + key_num * get_cap(meta->type);
+    int *data = keys + key_width(meta->type) * get_cap(meta->type);
     if (meta->type == NodeType::LEAF) {
-      int idx = bin_search(keys, meta->size, key, Operator::LE);
+      int idx = bin_search(keys, meta->size, key, Operator::LE, NodeType::LEAF);
+      if (idx == -1) {
+        /// only reachable through a truncated separator, the answer is the
+        /// last entry of the left sibling
+        pagenum_cur = meta->left_sibling;
+        assert(pagenum_cur != -1);
+        slice =
+            PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum_cur));
+        meta = (BPlusNodeMeta *)slice;
+        keys = (int *)(slice + sizeof(BPlusNodeMeta));
+        data = keys + key_num * leaf_max;
+        idx = meta->size - 1;
+      }
       if (idx < meta->size) {
         return (BPlusQueryResult){pagenum_cur, idx, keys + idx * key_num,
                                   ((uint8_t *)data) + leaf_data_len * idx};
@@ -483,12 +622,41 @@ BPlusQueryResult BPlusTree::le_match(const std::vector<int> &key) const {
         return (BPlusQueryResult){pagenum_cur, 0, keys, (uint8_t *)data};
       }
     } else {
-      int idx = bin_search(keys, meta->size, key, Operator::LE);
+      int idx =
+          bin_search(keys, meta->size, key, Operator::LE, NodeType::INTERNAL);
       pagenum_cur = data[idx];
     }
   }
 }
 
+void BPlusTree::le_match_sorted(
+    const std::vector<std::vector<int>> &keys,
+    const std::function<void(size_t, const BPlusQueryResult &)> &fn) const {
+  int pagenum = -1;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (pagenum != -1) {
+      uint8_t *slice =
+          PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+      BPlusNodeMeta *meta = (BPlusNodeMeta *)slice;
+      int *lkeys = (int *)(slice + sizeof(BPlusNodeMeta));
+      uint8_t *data = (uint8_t *)(lkeys + key_num * leaf_max);
+      /// the answer stays in this leaf while some entry is still greater
+      if (compare_key(lkeys + (meta->size - 1) * key_num, keys[i].data()) > 0) {
+        int idx = bin_search(lkeys, meta->size, keys[i], Operator::LE,
+                             NodeType::LEAF);
+        if (idx != -1) {
+          fn(i, (BPlusQueryResult){pagenum, idx, lkeys + idx * key_num,
+                                   data + leaf_data_len * idx});
+          continue;
+        }
+      }
+    }
+    auto ret = le_match(keys[i]);
+    pagenum = ret.pagenum;
+    fn(i, ret);
+  }
+}
+
 bool BPlusTree::leaf_unique_check() {
   int pagenum = pagenum_root;
   BPlusNodeMeta *meta;
@@ -553,6 +721,78 @@ void BPlusTree::free_page(int page) {
   ptr_available = page;
 }
 
+void BPlusTree::set_left_sibling(int pagenum, int left) {
+  uint8_t *slice =
+      PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, pagenum));
+  ((BPlusNodeMeta *)slice)->left_sibling = left;
+}
+
+void BPlusTree::widen_separators() {
+  if (!separators_truncated()) {
+    return;
+  }
+  BPlusNodeMeta *meta;
+  int *keys;
+  uint8_t *data;
+  /// leaves stay as they are, every internal page is rebuilt
+  std::vector<int> internal_pages;
+  std::queue<int> Q;
+  int leftmost = pagenum_root;
+  Q.push(pagenum_root);
+  while (Q.size()) {
+    int x = Q.front();
+    Q.pop();
+    uint8_t *slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, x));
+    prepare_from_slice(slice, meta, keys, data);
+    if (meta->type == NodeType::LEAF) {
+      continue;
+    }
+    internal_pages.push_back(x);
+    if (x == leftmost) {
+      leftmost = ((int *)data)[0];
+    }
+    for (int i = 0; i < meta->size; i++) {
+      Q.push(((int *)data)[i]);
+    }
+  }
+  /// (first key, pagenum) of every node on the level being built upon
+  std::vector<std::pair<std::vector<int>, int>> level;
+  for (int x = leftmost; x != -1; x = meta->right_sibling) {
+    uint8_t *slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, x));
+    prepare_from_slice(slice, meta, keys, data);
+    level.emplace_back(std::vector<int>(keys, keys + key_num), x);
+  }
+  for (auto x : internal_pages) {
+    free_page(x);
+  }
+  ikey_num = key_num;
+  internal_max = (Config::PAGE_SIZE - sizeof(BPlusNodeMeta)) /
+                 (sizeof(int) * (ikey_num + 1));
+  while (level.size() > 1) {
+    /// spread children evenly so that no node starts below half full
+    int n = level.size(), m = (n + internal_max - 1) / internal_max;
+    std::vector<std::pair<std::vector<int>, int>> parents;
+    for (int i = 0, begin = 0; i < m; i++) {
+      int size = n / m + (i < n % m);
+      int x = alloc_page();
+      uint8_t *slice =
+          PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, x));
+      prepare_from_slice(slice, meta, keys, data, NodeType::INTERNAL);
+      meta->reset();
+      meta->size = size;
+      for (int j = 0; j < size; j++) {
+        memcpy(keys + j * key_num, level[begin + j].first.data(),
+               key_num * sizeof(int));
+        ((int *)data)[j] = level[begin + j].second;
+      }
+      parents.emplace_back(level[begin].first, x);
+      begin += size;
+    }
+    level = std::move(parents);
+  }
+  pagenum_root = level[0].second;
+}
+
 void BPlusTree::purge() { std::filesystem::remove(filename); }
 
 void BPlusTree::print() const {
@@ -576,12 +816,12 @@ void BPlusTree::print() const {
       }
       for (int i = 0; i < meta->size; i++) {
         fprintf(stderr, "(");
-        for (int j = 0; j < key_num && j < 3; j++) {
-          fprintf(stderr, "%d ", keys[i * key_num + j]);
+        for (int j = 0; j < ikey_num && j < 3; j++) {
+          fprintf(stderr, "%d ", keys[i * ikey_num + j]);
         }
         if (i > 0) {
-          assert(compare_key(keys + i * key_num - key_num,
-                             keys + i * key_num) == -1);
+          assert(compare_prefix(keys + i * ikey_num - ikey_num,
+                                keys + i * ikey_num, ikey_num) == -1);
         }
         fprintf(stderr, ") ");
       }
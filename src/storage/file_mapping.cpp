@@ -87,11 +87,9 @@ bool FileMapping::read_page(PageLocator pos, uint8_t *ptr) {
   if (!is_open(pos.first)) {
     return false;
   }
+  /// positioned, scan workers read the same file at once
   off_t offset = (off_t)pos.second * Config::PAGE_SIZE;
-  off_t res = lseek(pos.first, offset, SEEK_SET);
-  if (res != offset)
-    return false;
-  auto ret = read(pos.first, (void *)ptr, Config::PAGE_SIZE);
+  auto ret = pread(pos.first, (void *)ptr, Config::PAGE_SIZE, offset);
   return ret != -1;
 }
 
@@ -100,10 +98,7 @@ bool FileMapping::write_page(PageLocator pos, uint8_t *ptr) {
     return false;
   }
   off_t offset = (off_t)pos.second * Config::PAGE_SIZE;
-  off_t res = lseek(pos.first, offset, SEEK_SET);
-  if (res != offset)
-    return false;
-  auto ret = write(pos.first, (void *)ptr, Config::PAGE_SIZE);
+  auto ret = pwrite(pos.first, (void *)ptr, Config::PAGE_SIZE, offset);
   return ret != -1;
 }
 
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+
+#include <storage/hash_index.h>
+#include <storage/paged_buffer.h>
+#include <utils/misc.h>
+
+void HashIndex::serialize(SequentialAccessor &accessor) const {
+  accessor.write_str(filename);
+  accessor.write<uint32_t>(n_pages);
+  accessor.write<uint32_t>(ptr_available);
+  accessor.write<uint32_t>(key_num);
+  accessor.write<uint32_t>(bucket_max);
+  accessor.write<uint32_t>(global_depth);
+  for (auto pagenum : directory) {
+    accessor.write<uint32_t>(pagenum);
+  }
+}
+
+HashIndex::HashIndex(SequentialAccessor &accessor) {
+  filename = accessor.read_str();
+  fd = FileMapping::get()->open_file(filename);
+  n_pages = accessor.read<uint32_t>();
+  ptr_available = accessor.read<uint32_t>();
+  key_num = accessor.read<uint32_t>();
+  bucket_max = accessor.read<uint32_t>();
+  global_depth = accessor.read<uint32_t>();
+  directory.resize(1 << global_depth);
+  for (auto &pagenum : directory) {
+    pagenum = accessor.read<uint32_t>();
+  }
+}
+
+HashIndex::HashIndex(const std::string &filename, int key_num)
+    : filename(filename), key_num(key_num) {
+  ensure_file(filename);
+  fd = FileMapping::get()->open_file(filename);
+  bucket_max =
+      (Config::PAGE_SIZE - sizeof(HashBucketMeta)) / (sizeof(int) * key_num);
+  directory.push_back(alloc_page(0));
+}
+
+uint64_t HashIndex::hash_key(const int *key) const {
+  uint64_t h = 0x9e3779b97f4a7c15ull;
+  for (int i = 0; i < key_num - 2; ++i) {
+    h ^= (uint32_t)key[i];
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+  }
+  return h;
+}
+
+bool HashIndex::contains(const std::vector<int> &key) const {
+  HashBucketMeta *meta;
+  int *entries;
+  for (int pagenum = bucket_of(key.data()); pagenum != -1;
+       pagenum = meta->overflow) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    for (int i = 0; i < meta->size; ++i) {
+      if (key_eq(entries + i * key_num, key.data()))
+        return true;
+    }
+  }
+  return false;
+}
+
+std::vector<PageLocator>
+HashIndex::lookup(const std::vector<int> &key) const {
+  std::vector<PageLocator> ret;
+  HashBucketMeta *meta;
+  int *entries;
+  for (int pagenum = bucket_of(key.data()); pagenum != -1;
+       pagenum = meta->overflow) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    for (int i = 0; i < meta->size; ++i) {
+      int *entry = entries + i * key_num;
+      if (key_eq(entry, key.data()))
+        ret.emplace_back(entry[key_num - 2], entry[key_num - 1]);
+    }
+  }
+  return ret;
+}
+
+void HashIndex::insert(const std::vector<int> &key) {
+  while (true) {
+    int head = bucket_of(key.data());
+    if (!chain_full(head) || !splittable(head)) {
+      chain_append(head, key.data());
+      return;
+    }
+    split(head);
+  }
+}
+
+bool HashIndex::erase(const std::vector<int> &key) {
+  HashBucketMeta *meta, *prev_meta = nullptr;
+  int *entries;
+  for (int pagenum = bucket_of(key.data()); pagenum != -1;
+       pagenum = meta->overflow) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    for (int i = 0; i < meta->size; ++i) {
+      int *entry = entries + i * key_num;
+      if (memcmp(entry, key.data(), key_num * sizeof(int)) != 0)
+        continue;
+      PagedBuffer::get()->mark_dirty(slice);
+      --meta->size;
+      memcpy(entry, entries + meta->size * key_num, key_num * sizeof(int));
+      /// unlink emptied overflow pages, the head page always stays
+      if (meta->size == 0 && prev_meta != nullptr) {
+        PagedBuffer::get()->mark_dirty((uint8_t *)prev_meta);
+        prev_meta->overflow = meta->overflow;
+        free_page(pagenum);
+      }
+      return true;
+    }
+    prev_meta = meta;
+  }
+  return false;
+}
+
+bool HashIndex::chain_full(int head) const {
+  HashBucketMeta *meta;
+  int *entries;
+  for (int pagenum = head; pagenum != -1; pagenum = meta->overflow) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    if (meta->size < bucket_max)
+      return false;
+  }
+  return true;
+}
+
+/// splitting helps only if some entries differ in the unused hash bits
+bool HashIndex::splittable(int head) const {
+  HashBucketMeta *meta;
+  int *entries;
+  uint8_t *slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, head));
+  prepare_from_slice(slice, meta, entries);
+  if (meta->local_depth >= MAX_DEPTH)
+    return false;
+  uint64_t mask = (1ull << MAX_DEPTH) - 1;
+  /// compared with the first live entry: erase() may leave the head page
+  /// empty ahead of overflow pages still in use
+  std::optional<uint64_t> first;
+  for (int pagenum = head; pagenum != -1; pagenum = meta->overflow) {
+    slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    for (int i = 0; i < meta->size; ++i) {
+      uint64_t h = hash_key(entries + i * key_num) & mask;
+      if (!first.has_value()) {
+        first = h;
+      } else if (h != *first) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void HashIndex::chain_append(int head, const int *entry) {
+  HashBucketMeta *meta;
+  int *entries;
+  int pagenum = head;
+  while (true) {
+    uint8_t *slice =
+        PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    if (meta->size < bucket_max) {
+      memcpy(entries + meta->size * key_num, entry, key_num * sizeof(int));
+      ++meta->size;
+      return;
+    }
+    if (meta->overflow == -1) {
+      meta->overflow = alloc_page(meta->local_depth);
+    }
+    pagenum = meta->overflow;
+  }
+}
+
+void HashIndex::split(int head) {
+  HashBucketMeta *meta;
+  int *entries;
+  std::vector<int> buf;
+  std::vector<int> overflow_pages;
+  uint8_t *slice =
+      PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, head));
+  prepare_from_slice(slice, meta, entries);
+  int depth = meta->local_depth;
+  for (int pagenum = head; pagenum != -1; pagenum = meta->overflow) {
+    slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    prepare_from_slice(slice, meta, entries);
+    buf.insert(buf.end(), entries, entries + meta->size * key_num);
+    if (pagenum != head)
+      overflow_pages.push_back(pagenum);
+  }
+  for (auto pagenum : overflow_pages) {
+    free_page(pagenum);
+  }
+  slice = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, head));
+  prepare_from_slice(slice, meta, entries);
+  meta->reset(depth + 1);
+
+  if (depth == global_depth) {
+    size_t n = directory.size();
+    directory.resize(n * 2);
+    std::copy_n(directory.begin(), n, directory.begin() + n);
+    ++global_depth;
+  }
+  int sibling = alloc_page(depth + 1);
+  for (size_t i = 0; i < directory.size(); ++i) {
+    if (directory[i] == head && ((i >> depth) & 1))
+      directory[i] = sibling;
+  }
+  for (size_t i = 0; i < buf.size(); i += key_num) {
+    const int *entry = buf.data() + i;
+    chain_append(((hash_key(entry) >> depth) & 1) ? sibling : head, entry);
+  }
+}
+
+int HashIndex::alloc_page(int depth) {
+  int ret;
+  if (ptr_available == -1) {
+    ret = n_pages++;
+  } else {
+    ret = ptr_available;
+    uint8_t *slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, ret));
+    ptr_available = ((HashBucketMeta *)slice)->next_empty;
+  }
+  uint8_t *slice = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, ret));
+  ((HashBucketMeta *)slice)->reset(depth);
+  return ret;
+}
+
+void HashIndex::free_page(int page) {
+  uint8_t *slice = PagedBuffer::get()->read_file_rdwr(std::make_pair(fd, page));
+  ((HashBucketMeta *)slice)->next_empty = ptr_available;
+  ptr_available = page;
+}
+
+void HashIndex::purge() { std::filesystem::remove(filename); }
@@ -64,6 +64,10 @@ void PagedBuffer::access(int id) {
 
 int PagedBuffer::get_replace() {
   int x = list_head;
+  while (pages[x].pins > 0 || pages[x].loading) {
+    x = pages[x].next;
+    assert(x != -1);
+  }
   if (pages[x].dirty) {
     base->write_page(pages[x].pos, pages[x].slice);
     pages[x].dirty = false;
@@ -75,41 +79,51 @@ int PagedBuffer::get_replace() {
   return x;
 }
 
-uint8_t *PagedBuffer::read_file_rd(PageLocator pos) {
-  if (!base->is_open(pos.first)) {
-    return nullptr;
-  }
-  auto it = pos2page.find(pos);
-  if (it != pos2page.end()) {
-    access(it->second);
-    return pages[it->second].slice;
+int PagedBuffer::locate(PageLocator pos, bool dirty,
+                        std::unique_lock<std::mutex> &lock) {
+  while (true) {
+    auto it = pos2page.find(pos);
+    if (it == pos2page.end()) {
+      break;
+    }
+    int id = it->second;
+    if (pages[id].loading) {
+      loaded.wait(lock);
+      continue;
+    }
+    access(id);
+    pages[id].dirty |= dirty;
+    return id;
   }
   int id = get_replace();
-  base->read_page(pos, pages[id].slice);
   pages[id].pos = pos;
-  pages[id].dirty = false;
+  pages[id].dirty = dirty;
+  pages[id].loading = true;
   pos2page[pos] = id;
   list_append(id);
-  return pages[id].slice;
+  /// the slot is claimed, other threads wait for pos or pick other slots
+  lock.unlock();
+  base->read_page(pos, pages[id].slice);
+  lock.lock();
+  pages[id].loading = false;
+  loaded.notify_all();
+  return id;
 }
 
-uint8_t *PagedBuffer::read_file_rdwr(PageLocator pos) {
+uint8_t *PagedBuffer::read_file_rd(PageLocator pos) {
   if (!base->is_open(pos.first)) {
     return nullptr;
   }
-  auto it = pos2page.find(pos);
-  if (it != pos2page.end()) {
-    access(it->second);
-    pages[it->second].dirty = true;
-    return pages[it->second].slice;
+  std::unique_lock<std::mutex> lock(latch);
+  return pages[locate(pos, false, lock)].slice;
+}
+
+uint8_t *PagedBuffer::read_file_rdwr(PageLocator pos) {
+  if (!base->is_open(pos.first)) {
+    return nullptr;
   }
-  int id = get_replace();
-  base->read_page(pos, pages[id].slice);
-  pages[id].pos = pos;
-  pages[id].dirty = true;
-  pos2page[pos] = id;
-  list_append(id);
-  return pages[id].slice;
+  std::unique_lock<std::mutex> lock(latch);
+  return pages[locate(pos, true, lock)].slice;
 }
 
 bool PagedBuffer::mark_dirty(uint8_t *ptr) {
@@ -118,10 +132,28 @@ bool PagedBuffer::mark_dirty(uint8_t *ptr) {
     return false;
   }
   int id = (ptr - head_ptr) / Config::PAGE_SIZE;
+  std::lock_guard<std::mutex> lock(latch);
   pages[id].dirty = true;
   return true;
 }
 
+uint8_t *PagedBuffer::pin(PageLocator pos) {
+  if (!base->is_open(pos.first)) {
+    return nullptr;
+  }
+  std::unique_lock<std::mutex> lock(latch);
+  int id = locate(pos, false, lock);
+  ++pages[id].pins;
+  return pages[id].slice;
+}
+
+void PagedBuffer::unpin(uint8_t *ptr) {
+  int id = (ptr - head_ptr) / Config::PAGE_SIZE;
+  std::lock_guard<std::mutex> lock(latch);
+  assert(pages[id].pins > 0);
+  --pages[id].pins;
+}
+
 SequentialAccessor::SequentialAccessor(int fd) : fd(fd) {
   pagenum = 0;
   headptr = PagedBuffer::get()->read_file_rd(std::make_pair(fd, 0));
@@ -0,0 +1,44 @@
+#include <algorithm>
+
+#include <utils/bloom_filter.h>
+
+/// odd multipliers deriving one bit position per word of a block
+static const uint32_t SALT[8] = {0x47b6137bu, 0x44974d91u, 0x8824ad5bu,
+                                 0xa2b7289du, 0x705495c7u, 0x2df1424bu,
+                                 0x9efc4947u, 0x5c6bfb31u};
+
+uint64_t BloomFilter::hash_key(const int *key, int len) {
+  uint64_t h = 0x9e3779b97f4a7c15ull;
+  for (int i = 0; i < len; ++i) {
+    h ^= (uint32_t)key[i];
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+  }
+  return h;
+}
+
+void BloomFilter::reset(size_t capacity) {
+  this->capacity = std::max<size_t>(capacity, 64);
+  n_blocks = this->capacity * BITS_PER_KEY / (BLOCK_WORDS * 64) + 1;
+  blocks.assign(n_blocks * BLOCK_WORDS, 0);
+  n_keys = 0;
+}
+
+void BloomFilter::insert(const int *key, int len) {
+  uint64_t h = hash_key(key, len);
+  uint64_t *block = blocks.data() + (h >> 32) % n_blocks * BLOCK_WORDS;
+  for (int i = 0; i < BLOCK_WORDS; ++i) {
+    block[i] |= 1ull << (((uint32_t)h * SALT[i]) >> 26);
+  }
+  ++n_keys;
+}
+
+bool BloomFilter::may_contain(const int *key, int len) const {
+  uint64_t h = hash_key(key, len);
+  const uint64_t *block = blocks.data() + (h >> 32) % n_blocks * BLOCK_WORDS;
+  for (int i = 0; i < BLOCK_WORDS; ++i) {
+    if (!((block[i] >> (((uint32_t)h * SALT[i]) >> 26)) & 1))
+      return false;
+  }
+  return true;
+}
@@ -12,6 +12,7 @@ void Config::parse(argparse::ArgumentParser &parser) {
     std::exit(0);
   }
   batch_mode = parser.is_used("-b");
+  vectorized_execution = !parser.is_used("--no-vectorize");
   stdin_is_file = !batch_mode && !isatty(fileno(stdin));
   if (parser.is_used("-d")) {
     preset_db = parser.get("-d");
@@ -25,6 +26,18 @@ void Config::parse(argparse::ArgumentParser &parser) {
   if (parser.is_used("--data-dir")) {
     db_data_root = parser.get("--data-dir");
   }
+  if (parser.is_used("--stats-refresh")) {
+    stats_refresh_fraction = parser.get<double>("--stats-refresh");
+  }
+  if (parser.is_used("--hash-memory")) {
+    hash_memory = (size_t)parser.get<int>("--hash-memory") << 20;
+  }
+  if (parser.is_used("--threads")) {
+    scan_threads = std::max(parser.get<int>("--threads"), 1);
+  }
+  if (parser.is_used("--sample-seed")) {
+    sample_seed = (uint32_t)parser.get<int>("--sample-seed");
+  }
   ensure_directory(db_data_root);
   db_global_meta = fs::path(db_data_root) / "scape_global.meta";
   dbs_dir = fs::path(db_data_root); /// / "dbs";
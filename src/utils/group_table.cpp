@@ -0,0 +1,33 @@
+#include <cassert>
+
+#include <utils/group_table.h>
+
+static const size_t MIN_SLOTS = 64;
+
+GroupTable::GroupTable(int key_len, int state_len)
+    : key_len(key_len), entry_len((key_len + state_len + 7) / 8 * 8) {
+  assert(key_len % 8 == 0);
+  clear();
+}
+
+void GroupTable::grow() {
+  /// the groups keep their numbers, only the slots are rebuilt
+  slots.assign(slots.size() * 2, Slot{0, -1});
+  mask = slots.size() - 1;
+  for (int g = 0; g < n_groups; ++g) {
+    uint64_t h = hash(key(g), key_len);
+    size_t i = h & mask;
+    while (slots[i].group != -1) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = {(uint32_t)(h >> 32), g};
+  }
+}
+
+void GroupTable::clear() {
+  /// the memory goes back too, memory() starts over
+  std::vector<uint8_t>().swap(entries);
+  slots.assign(MIN_SLOTS, Slot{0, -1});
+  mask = MIN_SLOTS - 1;
+  n_groups = 0;
+}
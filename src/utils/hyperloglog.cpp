@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <utils/hyperloglog.h>
+
+uint64_t HyperLogLog::hash_bytes(const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    h = (h ^ w) * 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+  }
+  uint64_t w = 0;
+  memcpy(&w, p, len);
+  h = (h ^ w) * 0xff51afd7ed558ccdull;
+  /// final avalanche, the register index and the run length need all bits
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+void HyperLogLog::insert(uint64_t hash) {
+  int idx = hash >> (64 - PRECISION);
+  /// a sentinel bit caps the run at 64 - PRECISION + 1
+  uint64_t rest = (hash << PRECISION) | (1ull << (PRECISION - 1));
+  uint8_t rank = __builtin_clzll(rest) + 1;
+  registers[idx] = std::max(registers[idx], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+  for (int i = 0; i < N_REGISTERS; ++i) {
+    registers[i] = std::max(registers[i], other.registers[i]);
+  }
+}
+
+double HyperLogLog::estimate() const {
+  const double m = N_REGISTERS;
+  double sum = 0;
+  int zeros = 0;
+  for (uint8_t r : registers) {
+    sum += std::ldexp(1.0, -r);
+    zeros += r == 0;
+  }
+  double raw = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  /// small cardinalities: linear counting over the empty registers
+  if (raw <= 2.5 * m && zeros > 0) {
+    return m * std::log(m / zeros);
+  }
+  return raw;
+}
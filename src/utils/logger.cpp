@@ -139,7 +139,12 @@ void tabulate_interactive(std::shared_ptr<QueryPlanner> planner) {
     ++nrow;
   }
   std::cout << hline << std::endl;
-  printf("%d rows in set\n", nrow);
+  if (spilled_bytes > 0) {
+    printf("%d rows in set, %.1f MB spilled to temp files\n", nrow,
+           spilled_bytes / 1048576.0);
+  } else {
+    printf("%d rows in set\n", nrow);
+  }
 }
 
 void tabulate_batch(std::shared_ptr<QueryPlanner> planner) {
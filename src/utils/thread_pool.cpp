@@ -0,0 +1,68 @@
+#include <utils/config.h>
+#include <utils/thread_pool.h>
+
+std::shared_ptr<ThreadPool> ThreadPool::instance = nullptr;
+
+std::shared_ptr<ThreadPool> ThreadPool::get() {
+  if (instance == nullptr) {
+    instance = std::shared_ptr<ThreadPool>(
+        new ThreadPool(std::max(Config::get()->scan_threads, 1)));
+  }
+  return instance;
+}
+
+ThreadPool::ThreadPool(int n_workers) {
+  for (int i = 1; i < n_workers; ++i) {
+    threads.emplace_back([this, i] { work(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(latch);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::drain(int worker, std::unique_lock<std::mutex> &lock) {
+  while (next_task < n_tasks) {
+    int t = next_task++;
+    ++running;
+    lock.unlock();
+    (*task)(worker, t);
+    lock.lock();
+    --running;
+  }
+  if (running == 0) {
+    done.notify_all();
+  }
+}
+
+void ThreadPool::work(int worker) {
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(latch);
+  while (true) {
+    wake.wait(lock, [&] { return stopping || generation != seen; });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+    drain(worker, lock);
+  }
+}
+
+void ThreadPool::run(int n, const std::function<void(int, int)> &fn) {
+  std::unique_lock<std::mutex> lock(latch);
+  task = &fn;
+  n_tasks = n;
+  next_task = 0;
+  ++generation;
+  wake.notify_all();
+  drain(0, lock);
+  done.wait(lock, [&] { return next_task == n_tasks && running == 0; });
+  task = nullptr;
+}
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <any>
+#include <cmath>
+#include <map>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "test_db.h"
+#include <engine/iterator.h>
+
+/// enough rows for a parallel scan of PARALLEL_SCAN_MIN_PAGES pages
+const int N = 100000;
+
+class aggregate : public ::testing::Test {
+protected:
+  static inline std::shared_ptr<TableManager> table;
+  /// the inserted columns h, a and s, for the reference results
+  static inline std::vector<int> hs;
+  static inline std::vector<std::optional<int>> as;
+  static inline std::vector<std::string> ss;
+
+  static void SetUpTestSuite() {
+    Config::get_mut()->scan_threads = 4;
+    use_scratch_db("test_aggregate_data");
+    table = create_scratch_table("fact", {{"g", "INT"},
+                                          {"h", "INT"},
+                                          {"a", "INT"},
+                                          {"f", "FLOAT"},
+                                          {"s", "VARCHAR(8)"}});
+    std::mt19937 rng(2333);
+    std::vector<std::vector<std::any>> rows;
+    for (int i = 0; i < N; i++) {
+      int g = rng() % 3000;
+      /// a is NULL now and then, f sums exactly in any order
+      std::optional<int> a;
+      if (rng() % 16) {
+        a = rng() % 1000;
+      }
+      std::string s = "s" + std::to_string(rng() % 500);
+      hs.push_back(g % 7);
+      as.push_back(a);
+      ss.push_back(s);
+      rows.push_back({std::any(g), std::any(g % 7),
+                      a ? std::any(*a) : std::any(),
+                      std::any((double)(rng() % 1000) / 4), std::any(s)});
+      if (rows.size() == 4096 || i == N - 1) {
+        ASSERT_EQ(table->insert_records(rows), (int)rows.size());
+        rows.clear();
+      }
+    }
+  }
+
+  void TearDown() override {
+    Config::get_mut()->hash_memory = 256 << 20;
+    Config::get_mut()->sample_seed = 0;
+    has_err = false;
+  }
+
+  static std::shared_ptr<Field> field(const std::string &name) {
+    return table->get_field(name);
+  }
+
+  /// the rows of iter, sorted
+  static std::vector<std::string> drain(Iterator &iter) {
+    int len = sizeof(bitmap_t);
+    for (auto f : iter.get_fields_dst()) {
+      len += f->get_size();
+    }
+    std::vector<std::string> out;
+    while (iter.get_next_valid()) {
+      out.emplace_back((const char *)iter.get(), len);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+  }
+
+  /// the rows of a scan through its blocks, in scan order
+  static std::vector<std::string> take(BlockIterator &iter) {
+    int len = sizeof(bitmap_t);
+    for (auto f : iter.get_fields_dst()) {
+      len += f->get_size();
+    }
+    std::vector<std::string> out;
+    while (true) {
+      iter.block_next();
+      if (iter.block_end()) {
+        iter.fill_next_block();
+      }
+      if (iter.all_end()) {
+        break;
+      }
+      out.emplace_back((const char *)iter.get(), len);
+    }
+    return out;
+  }
+
+  /// the output rows, sorted
+  static std::vector<std::string>
+  run(bool parallel, const std::vector<std::shared_ptr<Field>> &group_by,
+      const std::vector<std::shared_ptr<Field>> &fields,
+      const std::vector<Aggregator> &aggrs, bool vectorized = false) {
+    auto scan = table->make_iterator({}, table->get_fields(), vectorized, 100,
+                                     parallel);
+    EXPECT_EQ(std::dynamic_pointer_cast<ParallelScanIterator>(scan) != nullptr,
+              parallel);
+    AggregateIterator iter(scan, group_by, fields, aggrs);
+    return drain(iter);
+  }
+
+  /// a row of INT fields, nullopt for the NULL ones
+  static std::vector<std::optional<int>> ints(const std::string &row) {
+    bitmap_t bitmap = *(const bitmap_t *)row.data();
+    std::vector<std::optional<int>> out;
+    for (size_t i = 0; sizeof(bitmap_t) + i * 4 < row.size(); i++) {
+      if ((bitmap >> i) & 1) {
+        out.push_back(*(const int *)(row.data() + sizeof(bitmap_t) + i * 4));
+      } else {
+        out.push_back(std::nullopt);
+      }
+    }
+    return out;
+  }
+};
+
+static const std::vector<Aggregator> every = {
+    Aggregator::COUNT, Aggregator::COUNT, Aggregator::SUM, Aggregator::MIN,
+    Aggregator::MAX,   Aggregator::AVG,   Aggregator::SUM, Aggregator::MIN,
+    Aggregator::MAX,   Aggregator::AVG,   Aggregator::MIN, Aggregator::MAX};
+
+static std::vector<std::shared_ptr<Field>>
+every_field(std::function<std::shared_ptr<Field>(const std::string &)> f) {
+  return {nullptr, f("a"), f("a"), f("a"), f("a"), f("a"),
+          f("f"),  f("f"), f("f"), f("f"), f("s"), f("s")};
+}
+
+TEST_F(aggregate, ParallelMatchesSerial) {
+  auto fields = every_field(field);
+  auto aggrs = every;
+  /// h depends on g, NONE keeps it
+  fields.insert(fields.begin(), {field("g"), field("h")});
+  aggrs.insert(aggrs.begin(), {Aggregator::NONE, Aggregator::NONE});
+  auto serial = run(false, {field("g")}, fields, aggrs);
+  ASSERT_EQ(serial.size(), 3000u);
+  ASSERT_EQ(run(true, {field("g")}, fields, aggrs), serial);
+  ASSERT_FALSE(has_err);
+}
+
+TEST_F(aggregate, ParallelSingleGroup) {
+  auto fields = every_field(field);
+  auto serial = run(false, {}, fields, every);
+  ASSERT_EQ(serial.size(), 1u);
+  ASSERT_EQ(run(true, {}, fields, every), serial);
+  ASSERT_FALSE(has_err);
+}
+
+/// past the memory budget the workers give up and the serial build spills
+TEST_F(aggregate, ParallelFallsBackToSpilling) {
+  auto fields = every_field(field);
+  fields.insert(fields.begin(), field("g"));
+  auto aggrs = every;
+  aggrs.insert(aggrs.begin(), Aggregator::NONE);
+  auto serial = run(false, {field("g")}, fields, aggrs);
+  Config::get_mut()->hash_memory = 16 << 10;
+  spilled_bytes = 0;
+  ASSERT_EQ(run(true, {field("g")}, fields, aggrs), serial);
+  ASSERT_GT(spilled_bytes, 0u);
+  ASSERT_FALSE(has_err);
+}
+
+TEST_F(aggregate, ParallelNoneMismatchReportedOnce) {
+  testing::internal::CaptureStdout();
+  run(true, {field("g")}, {field("g"), field("s")},
+      {Aggregator::NONE, Aggregator::NONE});
+  auto out = testing::internal::GetCapturedStdout();
+  ASSERT_TRUE(has_err);
+  std::string error = "ERROR: cannot aggregate data with NONE.\n";
+  ASSERT_EQ(out, error);
+}
+
+/// GROUP BY h, a with COUNT(DISTINCT s), on both builds, in memory and
+/// spilling
+TEST_F(aggregate, GroupByColumnsCountDistinct) {
+  std::map<std::pair<int, std::optional<int>>,
+           std::pair<int, std::set<std::string>>>
+      expected;
+  for (size_t i = 0; i < hs.size(); i++) {
+    auto &[count, distinct] = expected[{hs[i], as[i]}];
+    ++count;
+    distinct.insert(ss[i]);
+  }
+  for (int memory : {256 << 20, 16 << 10}) {
+    Config::get_mut()->hash_memory = memory;
+    for (bool vectorized : {false, true}) {
+      spilled_bytes = 0;
+      auto out = run(false, {field("h"), field("a")},
+                     {field("h"), field("a"), nullptr, field("s")},
+                     {Aggregator::NONE, Aggregator::NONE, Aggregator::COUNT,
+                      Aggregator::COUNT_DISTINCT},
+                     vectorized);
+      ASSERT_EQ(out.size(), expected.size());
+      for (auto &row : out) {
+        auto v = ints(row);
+        ASSERT_TRUE(v[0]);
+        auto it = expected.find({*v[0], v[1]});
+        ASSERT_NE(it, expected.end());
+        ASSERT_EQ(v[2], it->second.first);
+        ASSERT_EQ(v[3], (int)it->second.second.size());
+      }
+      ASSERT_EQ(spilled_bytes > 0, memory < (1 << 20));
+    }
+  }
+  ASSERT_FALSE(has_err);
+}
+
+/// SELECT DISTINCT h, a: each pair once, NULL a being one value
+TEST_F(aggregate, SelectDistinct) {
+  std::set<std::pair<int, std::optional<int>>> expected;
+  for (size_t i = 0; i < hs.size(); i++) {
+    expected.insert({hs[i], as[i]});
+  }
+  for (int memory : {256 << 20, 16 << 10}) {
+    Config::get_mut()->hash_memory = memory;
+    spilled_bytes = 0;
+    std::vector<std::shared_ptr<Field>> columns = {field("h"), field("a")};
+    DistinctIterator iter(std::make_shared<PermuteIterator>(
+        table->make_iterator({}, table->get_fields()), columns));
+    auto out = drain(iter);
+    std::set<std::pair<int, std::optional<int>>> seen;
+    for (auto &row : out) {
+      auto v = ints(row);
+      ASSERT_TRUE(v[0]);
+      ASSERT_TRUE(seen.insert({*v[0], v[1]}).second);
+    }
+    ASSERT_EQ(seen, expected);
+    ASSERT_EQ(spilled_bytes > 0, memory < (1 << 20));
+  }
+}
+
+/// APPROX_COUNT_DISTINCT within a few standard errors of the exact count
+TEST_F(aggregate, ApproxCountDistinct) {
+  std::vector<std::set<std::string>> s_by_h(7);
+  for (size_t i = 0; i < hs.size(); i++) {
+    s_by_h[hs[i]].insert(ss[i]);
+  }
+  for (bool vectorized : {false, true}) {
+    auto out = run(false, {field("h")}, {field("h"), field("s"), field("s")},
+                   {Aggregator::NONE, Aggregator::APPROX_COUNT_DISTINCT,
+                    Aggregator::COUNT_DISTINCT},
+                   vectorized);
+    ASSERT_EQ(out.size(), 7u);
+    for (auto &row : out) {
+      auto v = ints(row);
+      int exact = s_by_h[*v[0]].size();
+      ASSERT_EQ(v[2], exact);
+      ASSERT_NEAR(*v[1], exact, exact * 0.05);
+    }
+    out = run(false, {}, {field("g")}, {Aggregator::APPROX_COUNT_DISTINCT},
+              vectorized);
+    ASSERT_EQ(out.size(), 1u);
+    ASSERT_NEAR(*ints(out[0])[0], 3000, 3000 * 0.05);
+  }
+  ASSERT_FALSE(has_err);
+}
+
+/// TABLESAMPLE reads the same pages on every rescan and for the same seed
+TEST_F(aggregate, SampleStableAcrossReset) {
+  std::vector<std::shared_ptr<Field>> columns = {field("g"), field("h")};
+  Config::get_mut()->sample_seed = 2333;
+  auto scan = table->make_iterator({}, columns, false, 30);
+  auto rows = take(*scan);
+  ASSERT_GT(rows.size(), N * 0.2);
+  ASSERT_LT(rows.size(), N * 0.4);
+  scan->reset_all();
+  ASSERT_EQ(take(*scan), rows);
+  auto vectorized = table->make_iterator({}, columns, true, 30);
+  ASSERT_EQ(take(*vectorized), rows);
+  Config::get_mut()->sample_seed = 2334;
+  ASSERT_NE(take(*table->make_iterator({}, columns, false, 30)), rows);
+}
+
+/// COUNT and SUM of a sample are scaled up, COUNT(DISTINCT) is not
+TEST_F(aggregate, SampleScalesCountAndSum) {
+  Config::get_mut()->sample_seed = 2333;
+  int rows = 0, count = 0, sum = 0;
+  std::set<int> distinct;
+  for (auto &row : take(*table->make_iterator({}, {field("a")}, false, 30))) {
+    ++rows;
+    if (auto a = ints(row)[0]) {
+      ++count;
+      sum += *a;
+      distinct.insert(*a);
+    }
+  }
+  double scale = 100.0 / 30;
+  for (bool vectorized : {false, true}) {
+    AggregateIterator iter(
+        table->make_iterator({}, table->get_fields(), vectorized, 30), {},
+        {nullptr, field("a"), field("a"), field("a")},
+        {Aggregator::COUNT, Aggregator::COUNT, Aggregator::SUM,
+         Aggregator::COUNT_DISTINCT});
+    iter.set_scale(scale);
+    auto out = drain(iter);
+    ASSERT_EQ(out.size(), 1u);
+    auto v = ints(out[0]);
+    ASSERT_EQ(v[0], (int)std::llround(rows * scale));
+    ASSERT_EQ(v[1], (int)std::llround(count * scale));
+    ASSERT_EQ(v[2], (int)std::llround(sum * scale));
+    ASSERT_EQ(v[3], (int)distinct.size());
+  }
+  /// the estimate is near the whole table, of a few hundred pages
+  ASSERT_NEAR(rows * scale, N, N * 0.25);
+}
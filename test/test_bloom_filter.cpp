@@ -0,0 +1,57 @@
+#include <cstdlib>
+#include <set>
+
+#include "gtest/gtest.h"
+
+#include <utils/bloom_filter.h>
+
+TEST(bloom_filter, NoFalseNegatives) {
+  const int n = 1 << 16;
+  srand(2333);
+  for (int len = 1; len <= 3; len++) {
+    BloomFilter bloom(n);
+    std::vector<int> keys(n * len);
+    for (auto &k : keys) {
+      k = rand();
+    }
+    for (int i = 0; i < n; i++) {
+      bloom.insert(keys.data() + i * len, len);
+    }
+    ASSERT_FALSE(bloom.saturated());
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(bloom.may_contain(keys.data() + i * len, len));
+    }
+  }
+}
+
+TEST(bloom_filter, FalsePositiveRate) {
+  const int n = 1 << 16;
+  srand(2333);
+  BloomFilter bloom(n);
+  std::set<int> present;
+  for (int i = 0; i < n; i++) {
+    int k = rand();
+    present.insert(k);
+    bloom.insert(&k, 1);
+  }
+  int absent = 0, fp = 0;
+  for (int i = 0; i < n * 4; i++) {
+    int k = rand();
+    if (present.contains(k))
+      continue;
+    ++absent;
+    fp += bloom.may_contain(&k, 1);
+  }
+  std::cout << "false positive rate = " << (double)fp / absent << std::endl;
+  ASSERT_LT(fp, absent / 100);
+  /// sequential keys must spread over blocks as well
+  bloom.reset(n);
+  for (int i = 0; i < n; i++) {
+    bloom.insert(&i, 1);
+  }
+  fp = 0;
+  for (int i = n; i < n * 5; i++) {
+    fp += bloom.may_contain(&i, 1);
+  }
+  ASSERT_LT(fp, n * 4 / 100);
+}
@@ -1,6 +1,9 @@
 #include <bitset>
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
+#include <random>
+#include <set>
 
 #include "gtest/gtest.h"
 
@@ -142,3 +145,279 @@ TEST(btree, Erase) {
     }
   }
 }
+
+/// index keys are (column..., pagenum, slotnum), so widths 3 and 4 dominate
+TEST(btree, NarrowKeyThroughput) {
+  const int n = 1 << 18;
+  srand(2333);
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  for (int key_num = 3; key_num <= 5; key_num++) {
+    int fd = FileMapping::get()->create_temp_file();
+    auto fn = FileMapping::get()->get_filename(fd);
+    auto btree = std::make_shared<BPlusTree>(fn, key_num, 4);
+    std::set<std::vector<int>> ref;
+    for (int i = 0; i < n; i++) {
+      key[i].resize(key_num);
+      for (int j = 0; j < key_num - 2; j++) {
+        key[i][j] = rand() % 4096 - 2048;
+      }
+      key[i][key_num - 2] = i >> 6;
+      key[i][key_num - 1] = i & 63;
+      ref.insert(key[i]);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+      btree->insert(key[i], rec[i]);
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(btree->eq_match(key[i]).has_value());
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> t_insert = mid - start, t_lookup = end - mid;
+    std::cout << "key_num = " << key_num << ": insert "
+              << int(n / t_insert.count()) << "/s, lookup "
+              << int(n / t_lookup.count()) << "/s" << std::endl;
+    /// le_match must agree with an ordered reference
+    for (int q = 0; q < (1 << 14); q++) {
+      std::vector<int> probe(key_num);
+      for (int j = 0; j < key_num; j++) {
+        probe[j] = rand() % 4200 - 2100;
+      }
+      auto it = ref.upper_bound(probe);
+      auto ret = btree->le_match(probe);
+      if (it == ref.begin()) {
+        ASSERT_EQ(ret.keyptr[0], INT_MIN);
+      } else {
+        --it;
+        for (int j = 0; j < key_num; j++) {
+          ASSERT_EQ(ret.keyptr[j], (*it)[j]);
+        }
+      }
+    }
+  }
+}
+
+/// unique prefixes let internal nodes drop (pagenum, slotnum)
+TEST(btree, TruncatedSeparators) {
+  const int n = 1 << 15;
+  uint64_t seed = time(0);
+  std::cout << "seed = " << seed << std::endl;
+  srand(seed);
+  int key_num = 3 + rand() % 2;
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  int fd = FileMapping::get()->create_temp_file();
+  auto fn = FileMapping::get()->get_filename(fd);
+  auto btree = std::make_shared<BPlusTree>(fn, key_num, 4, true);
+  ASSERT_TRUE(btree->separators_truncated());
+  std::vector<int> perm(n);
+  for (int i = 0; i < n; i++) {
+    perm[i] = i * 2;
+  }
+  std::shuffle(perm.begin(), perm.end(), std::mt19937(seed));
+  for (int i = 0; i < n; i++) {
+    key[i].resize(key_num);
+    key[i][0] = perm[i];
+    for (int j = 1; j < key_num; j++) {
+      key[i][j] = rand() % 64 - 32;
+    }
+  }
+  std::set<std::vector<int>> ref;
+  auto check_le = [&](int first) {
+    std::vector<int> probe(key_num, INT_MIN);
+    probe[0] = first;
+    auto it = ref.upper_bound(probe);
+    auto ret = btree->le_match(probe);
+    if (it == ref.begin()) {
+      ASSERT_EQ(ret.keyptr[0], INT_MIN);
+    } else {
+      --it;
+      for (int j = 0; j < key_num; j++) {
+        ASSERT_EQ(ret.keyptr[j], (*it)[j]);
+      }
+    }
+  };
+  inserted.reset();
+  for (int q = 0; q < n * 8; q++) {
+    int i = rand() % n;
+    if (inserted[i]) {
+      ASSERT_TRUE(btree->erase(key[i]));
+      ref.erase(key[i]);
+    } else {
+      ASSERT_FALSE(btree->eq_match(key[i]).has_value());
+      btree->insert(key[i], rec[i]);
+      ref.insert(key[i]);
+    }
+    inserted[i] = !inserted[i];
+    check_le(key[rand() % n][0] + rand() % 2);
+  }
+  /// duplicated prefixes need full separators again
+  btree->widen_separators();
+  ASSERT_FALSE(btree->separators_truncated());
+  for (int i = 0; i < n; i++) {
+    auto dup = key[i];
+    dup[key_num - 1] += 64;
+    btree->insert(dup, rec[i]);
+    ref.insert(dup);
+  }
+  for (const auto &k : ref) {
+    ASSERT_TRUE(btree->eq_match(k).has_value());
+  }
+  for (int q = 0; q < (1 << 14); q++) {
+    check_le(key[rand() % n][0] + rand() % 2);
+  }
+}
+
+/// append-only keys should leave left pages full
+TEST(btree, SequentialInsert) {
+  const int n = 1 << 17;
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  for (int key_num = 3; key_num <= 4; key_num++) {
+    int fd = FileMapping::get()->create_temp_file();
+    auto fn = FileMapping::get()->get_filename(fd);
+    auto btree = std::make_shared<BPlusTree>(fn, key_num, 4);
+    for (int i = 0; i < n; i++) {
+      key[i].assign(key_num, 0);
+      key[i][0] = i;
+      key[i][key_num - 2] = i >> 6;
+      key[i][key_num - 1] = i & 63;
+      btree->insert(key[i], rec[i]);
+    }
+    int leaf_max = btree->get_cap(NodeType::LEAF);
+    int leaves = (n + 1) / (leaf_max - 1) + 1;
+    std::cout << "key_num = " << key_num << ": " << btree->get_page_num()
+              << " pages, " << leaves << " leaves at full occupancy"
+              << std::endl;
+    ASSERT_LE(btree->get_page_num(), leaves + leaves / 8 + 2);
+    for (int i = 0; i < n; i++) {
+      ASSERT_TRUE(btree->eq_match(key[i]).has_value());
+    }
+    /// the sparse right edge must still drain through borrow and merge
+    for (int i = n - 1; i >= 0; i -= 2) {
+      ASSERT_TRUE(btree->erase(key[i]));
+    }
+    for (int i = 0; i < n; i++) {
+      ASSERT_EQ(btree->eq_match(key[i]).has_value(), i % 2 == 0);
+    }
+  }
+}
+
+TEST(btree, SortedBatches) {
+  const int n = 1 << 16, batch = 1 << 10;
+  uint64_t seed = time(0);
+  std::cout << "seed = " << seed << std::endl;
+  srand(seed);
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  for (int truncate = 0; truncate <= 1; truncate++) {
+    int key_num = 3 + rand() % 2;
+    int fd = FileMapping::get()->create_temp_file();
+    auto fn = FileMapping::get()->get_filename(fd);
+    auto btree = std::make_shared<BPlusTree>(fn, key_num, 8, truncate);
+    std::set<std::vector<int>> ref;
+    for (int i = 0; i < n; i++) {
+      key[i].resize(key_num);
+      /// unique prefixes, as required by truncated separators
+      key[i][0] = i * 3;
+      for (int j = 1; j < key_num; j++) {
+        key[i][j] = rand() % 1024;
+      }
+      *(int *)rec[i] = i;
+    }
+    std::shuffle(key, key + n, std::mt19937(seed));
+    for (int b = 0; b < n; b += batch) {
+      std::vector<std::vector<int>> keys(key + b, key + b + batch);
+      std::sort(keys.begin(), keys.end());
+      std::vector<const uint8_t *> records;
+      for (auto &k : keys) {
+        records.push_back(rec[k[0] / 3]);
+        ref.insert(k);
+      }
+      btree->insert_sorted(keys, records);
+    }
+    for (int i = 0; i < n; i++) {
+      auto ret = btree->eq_match(key[i]);
+      ASSERT_TRUE(ret.has_value());
+      ASSERT_EQ(*(int *)ret.value().dataptr, key[i][0] / 3);
+    }
+    std::vector<std::vector<int>> probes(1 << 14, std::vector<int>(key_num));
+    for (auto &probe : probes) {
+      probe[0] = rand() % (n * 3 + 8) - 4;
+      for (int j = 1; j < key_num; j++) {
+        probe[j] = rand() % 1100;
+      }
+    }
+    std::sort(probes.begin(), probes.end());
+    btree->le_match_sorted(probes, [&](size_t i, const BPlusQueryResult &res) {
+      auto expect = btree->le_match(probes[i]);
+      ASSERT_EQ(res.pagenum, expect.pagenum);
+      ASSERT_EQ(res.slotnum, expect.slotnum);
+      auto it = ref.upper_bound(probes[i]);
+      if (it == ref.begin()) {
+        ASSERT_EQ(res.keyptr[0], INT_MIN);
+      } else {
+        --it;
+        ASSERT_EQ(res.keyptr[0], (*it)[0]);
+      }
+    });
+  }
+}
+
+TEST(btree, ReverseLeafChain) {
+  const int n = 1 << 16;
+  uint64_t seed = time(0);
+  std::cout << "seed = " << seed << std::endl;
+  srand(seed);
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  int key_num = 2 + rand() % 3;
+  int fd = FileMapping::get()->create_temp_file();
+  auto fn = FileMapping::get()->get_filename(fd);
+  auto btree = std::make_shared<BPlusTree>(fn, key_num, 8);
+  std::set<std::vector<int>> ref;
+  for (int i = 0; i < n; i++) {
+    key[i].resize(key_num);
+    for (int j = 0; j < key_num; j++) {
+      key[i][j] = rand() % 4096;
+    }
+    if (ref.insert(key[i]).second) {
+      btree->insert(key[i], rec[i]);
+    }
+  }
+  /// borrows and merges must keep left_sibling in step with right_sibling
+  for (int i = 0; i < n; i += 3) {
+    if (ref.erase(key[i]) > 0) {
+      ASSERT_TRUE(btree->erase(key[i]));
+    }
+  }
+  /// walk the leaves right to left from the last entry
+  fd = btree->get_fd();
+  auto pos = btree->le_match(std::vector<int>(key_num, INT_MAX - 1));
+  int pagenum = pos.pagenum, slotnum = pos.slotnum, right = -1;
+  auto it = ref.rbegin();
+  while (pagenum != -1) {
+    auto slice = PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+    BPlusNodeMeta *meta;
+    int *keys;
+    uint8_t *data;
+    btree->prepare_from_slice(slice, meta, keys, data, NodeType::LEAF);
+    if (right != -1) {
+      ASSERT_EQ(meta->right_sibling, right);
+    }
+    for (; slotnum >= 0; --slotnum) {
+      int *entry = keys + slotnum * key_num;
+      if (entry[0] == INT_MIN) {
+        continue;
+      }
+      ASSERT_NE(it, ref.rend());
+      ASSERT_TRUE(std::equal(it->begin(), it->end(), entry));
+      ++it;
+    }
+    right = pagenum;
+    pagenum = meta->left_sibling;
+    if (pagenum != -1) {
+      auto lslice =
+          PagedBuffer::get()->read_file_rd(std::make_pair(fd, pagenum));
+      slotnum = ((BPlusNodeMeta *)lslice)->size - 1;
+    }
+  }
+  ASSERT_EQ(it, ref.rend());
+}
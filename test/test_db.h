@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <engine/field.h>
+#include <engine/scape_sql.h>
+#include <engine/system.h>
+#include <frontend/frontend.h>
+#include <utils/config.h>
+#include <utils/misc.h>
+
+/// the tests that go through tables keep them in a database under dir,
+/// emptied first. call once per test binary, before any table is made
+inline void use_scratch_db(const std::string &dir) {
+  namespace fs = std::filesystem;
+  auto root = fs::current_path() / dir;
+  fs::remove_all(root);
+  auto cfg = Config::get_mut();
+  cfg->db_data_root = root;
+  ensure_directory(cfg->db_data_root);
+  cfg->db_global_meta = root / "scape_global.meta";
+  cfg->dbs_dir = cfg->db_data_root;
+  cfg->temp_file_dir = root / ".temp";
+  cfg->temp_file_template = root / ".temp" / "fileXXXXXX";
+  ensure_directory(cfg->temp_file_dir);
+  ScapeSQL::create_db("test");
+  ScapeSQL::use_db("test");
+}
+
+/// a table of nullable (name, type) columns without defaults
+inline std::shared_ptr<TableManager> create_scratch_table(
+    const std::string &name,
+    const std::vector<std::pair<std::string, std::string>> &columns) {
+  std::vector<std::shared_ptr<Field>> fields;
+  for (auto &[column, type] : columns) {
+    auto field = std::make_shared<Field>(column, get_unified_id());
+    field->datatype = DataTypeBase::build(type);
+    field->datatype->notnull = false;
+    field->datatype->has_default_val = false;
+    fields.push_back(field);
+  }
+  ScapeSQL::create_table(name, std::move(fields));
+  return ScapeFrontend::get()->get_current_db_manager()->get_table_manager(
+      name);
+}
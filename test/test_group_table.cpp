@@ -0,0 +1,69 @@
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <utils/group_table.h>
+
+TEST(group_table, MatchesMap) {
+  srand(2333);
+  const int key_len = 16;
+  GroupTable table(key_len, sizeof(int));
+  std::map<std::string, int> groups;
+  std::map<std::string, int> counts;
+  for (int i = 0; i < 200000; i++) {
+    std::string key(key_len, '\0');
+    snprintf(key.data(), key_len, "k%d", rand() % 50000);
+    int g = table.find_or_insert((const uint8_t *)key.data());
+    auto [it, fresh] = groups.try_emplace(key, g);
+    /// new keys get the next number, known keys keep theirs
+    ASSERT_EQ(g, fresh ? (int)groups.size() - 1 : it->second);
+    ++*(int *)table.state(g);
+    ++counts[key];
+  }
+  ASSERT_EQ(table.size(), (int)groups.size());
+  for (auto [key, g] : groups) {
+    auto ptr = (const uint8_t *)key.data();
+    ASSERT_EQ(table.find(ptr, GroupTable::hash(ptr, key_len)), g);
+    ASSERT_EQ(memcmp(table.key(g), key.data(), key_len), 0);
+    ASSERT_EQ(*(const int *)table.state(g), counts[key]);
+  }
+}
+
+TEST(group_table, EmptyKeyAndClear) {
+  /// without key bytes every lookup is the one group
+  GroupTable single(0, 8);
+  ASSERT_EQ(single.find_or_insert(nullptr), 0);
+  ASSERT_EQ(single.find_or_insert(nullptr), 0);
+  ASSERT_EQ(single.size(), 1);
+
+  GroupTable table(sizeof(int64_t), sizeof(int));
+  for (int64_t i = 0; i < 1000; i++) {
+    ASSERT_EQ(table.find_or_insert((const uint8_t *)&i), i);
+  }
+  size_t full = table.memory();
+  table.clear();
+  ASSERT_EQ(table.size(), 0);
+  ASSERT_LT(table.memory(), full);
+  int64_t key = 999;
+  auto h = GroupTable::hash((const uint8_t *)&key, sizeof(key));
+  ASSERT_EQ(table.find((const uint8_t *)&key, h), -1);
+  ASSERT_EQ(table.find_or_insert((const uint8_t *)&key), 0);
+  ASSERT_EQ(*(const int *)table.state(0), 0);
+}
+
+TEST(group_table, StatesAligned) {
+  /// a state of 12 bytes still leaves every state on a word
+  GroupTable table(8, 12);
+  ASSERT_EQ(table.get_entry_len() % 8, 0);
+  for (uint64_t i = 0; i < 1000; i++) {
+    int g = table.find_or_insert((const uint8_t *)&i);
+    ASSERT_EQ((uintptr_t)table.state(g) % alignof(uint64_t), 0u);
+    *(uint64_t *)table.state(g) = i;
+  }
+  for (uint64_t i = 0; i < 1000; i++) {
+    ASSERT_EQ((uintptr_t)table.state(i) % alignof(uint64_t), 0u);
+    ASSERT_EQ(*(const uint64_t *)table.state(i), i);
+  }
+}
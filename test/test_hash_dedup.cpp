@@ -0,0 +1,65 @@
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include <engine/iterator.h>
+#include <utils/config.h>
+
+const int key_len = 16;
+
+/// insert n keys drawn from range values, then drain. returns how many
+/// times each key came out, from insert() or drain()
+static std::map<std::string, int> dedup_keys(HashDedup &dedup, int n,
+                                             int range,
+                                             std::set<std::string> &keys) {
+  std::map<std::string, int> seen;
+  for (int i = 0; i < n; i++) {
+    std::string key(key_len, '\0');
+    snprintf(key.data(), key_len, "k%d", rand() % range);
+    keys.insert(key);
+    if (dedup.insert((const uint8_t *)key.data())) {
+      ++seen[key];
+    }
+  }
+  dedup.drain([&](const uint8_t *key) {
+    ++seen[std::string((const char *)key, key_len)];
+  });
+  return seen;
+}
+
+TEST(hash_dedup, InMemory) {
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  Config::get_mut()->hash_memory = 256 << 20;
+  srand(2333);
+  spilled_bytes = 0;
+  HashDedup dedup(key_len);
+  std::set<std::string> keys;
+  auto seen = dedup_keys(dedup, 100000, 20000, keys);
+  ASSERT_EQ(spilled_bytes, 0u);
+  ASSERT_EQ(seen.size(), keys.size());
+  for (auto [key, times] : seen) {
+    ASSERT_EQ(times, 1);
+  }
+}
+
+TEST(hash_dedup, SpillsRecursively) {
+  srand(2333);
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  Config::get_mut()->hash_memory = 16 << 10;
+  spilled_bytes = 0;
+  const int n = 400000;
+  HashDedup dedup(key_len);
+  std::set<std::string> keys;
+  auto seen = dedup_keys(dedup, n, 100000, keys);
+  /// each key spills at most once per level, so more means the partitions
+  /// of the first level spilled again
+  ASSERT_GT(spilled_bytes, (uint64_t)n * key_len);
+  ASSERT_EQ(seen.size(), keys.size());
+  for (auto [key, times] : seen) {
+    ASSERT_TRUE(keys.count(key));
+    ASSERT_EQ(times, 1);
+  }
+}
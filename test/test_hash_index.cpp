@@ -0,0 +1,94 @@
+#include <bitset>
+#include <cstdlib>
+#include <filesystem>
+
+#include "gtest/gtest.h"
+
+#include <storage/hash_index.h>
+#include <storage/storage.h>
+#include <utils/logger.h>
+
+const int N = 1 << 16;
+std::vector<int> key[N];
+std::bitset<N> inserted;
+
+TEST(hash_index, InsertLookup) {
+  const int n = 1 << 16;
+  srand(2333);
+  int key_num = 3 + rand() % 4;
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  int fd = FileMapping::get()->create_temp_file();
+  auto fn = FileMapping::get()->get_filename(fd);
+  auto hash = std::make_shared<HashIndex>(fn, key_num);
+  for (int i = 0; i < n; i++) {
+    key[i].resize(key_num);
+    for (int j = 0; j < key_num - 2; j++) {
+      key[i][j] = rand();
+    }
+    key[i][key_num - 2] = i;
+    key[i][key_num - 1] = i & 63;
+    hash->insert(key[i]);
+  }
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(hash->contains(key[i]));
+    auto rids = hash->lookup(key[i]);
+    ASSERT_NE(std::find(rids.begin(), rids.end(),
+                        std::make_pair(i, i & 63)),
+              rids.end());
+  }
+  std::vector<int> absent(key_num, -1);
+  ASSERT_FALSE(hash->contains(absent));
+}
+
+/// few distinct keys force long overflow chains
+TEST(hash_index, Duplicates) {
+  const int n = 1 << 14, distinct = 7;
+  srand(2333);
+  int key_num = 3;
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  int fd = FileMapping::get()->create_temp_file();
+  auto fn = FileMapping::get()->get_filename(fd);
+  auto hash = std::make_shared<HashIndex>(fn, key_num);
+  for (int i = 0; i < n; i++) {
+    key[i] = {i % distinct, i, 0};
+    hash->insert(key[i]);
+  }
+  for (int v = 0; v < distinct; v++) {
+    auto rids = hash->lookup({v, 0, 0});
+    ASSERT_EQ((int)rids.size(), (n - v + distinct - 1) / distinct);
+  }
+  for (int i = 0; i < n; i++) {
+    ASSERT_TRUE(hash->erase(key[i]));
+  }
+  for (int v = 0; v < distinct; v++) {
+    ASSERT_FALSE(hash->contains({v, 0, 0}));
+  }
+}
+
+TEST(hash_index, Erase) {
+  const int n = 1 << 14;
+  srand(2333);
+  int key_num = 4;
+  Config::get_mut()->temp_file_template = "./fileXXXXXX";
+  int fd = FileMapping::get()->create_temp_file();
+  auto fn = FileMapping::get()->get_filename(fd);
+  auto hash = std::make_shared<HashIndex>(fn, key_num);
+  for (int i = 0; i < n; i++) {
+    key[i] = {rand() % 4096, rand() % 4096, i, 0};
+  }
+  inserted.reset();
+  for (int q = 0; q < n * 10; q++) {
+    int i = rand() % n;
+    auto rids = hash->lookup(key[i]);
+    bool found = std::find(rids.begin(), rids.end(), std::make_pair(i, 0)) !=
+                 rids.end();
+    ASSERT_EQ(found, (bool)inserted[i]);
+    if (inserted[i]) {
+      ASSERT_TRUE(hash->erase(key[i]));
+      inserted[i] = false;
+    } else {
+      hash->insert(key[i]);
+      inserted[i] = true;
+    }
+  }
+}
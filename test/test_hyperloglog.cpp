@@ -0,0 +1,42 @@
+#include <cmath>
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+#include <utils/hyperloglog.h>
+
+TEST(hyperloglog, Accuracy) {
+  srand(2333);
+  for (int n : {0, 1, 10, 1000, 20000, 1000000}) {
+    HyperLogLog hll;
+    int base = rand();
+    for (int i = 0; i < n; ++i) {
+      int key = base + i;
+      hll.insert(HyperLogLog::hash_bytes(&key, sizeof(key)));
+      /// repeats do not count
+      if (i % 3 == 0) {
+        hll.insert(HyperLogLog::hash_bytes(&key, sizeof(key)));
+      }
+    }
+    double est = hll.estimate();
+    std::cout << n << " -> " << est << std::endl;
+    /// four standard errors, plus slack for tiny counts
+    ASSERT_LE(std::abs(est - n), n * 0.065 + 2);
+  }
+}
+
+TEST(hyperloglog, Merge) {
+  HyperLogLog a, b, all;
+  for (int i = 0; i < 50000; ++i) {
+    uint64_t h = HyperLogLog::hash_bytes(&i, sizeof(i));
+    (i % 2 ? a : b).insert(h);
+    /// a quarter of the keys land in both
+    if (i % 4 == 0) {
+      a.insert(h);
+    }
+    all.insert(h);
+  }
+  a.merge(b);
+  ASSERT_EQ(a.get_registers(), all.get_registers());
+  ASSERT_NEAR(a.estimate(), 50000, 50000 * 0.065);
+}
@@ -0,0 +1,100 @@
+#include <any>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "test_db.h"
+#include <engine/record.h>
+#include <storage/storage.h>
+
+static std::vector<std::any> row(int id, int parent) {
+  return {std::any(id), std::any(parent)};
+}
+
+static void add_pk(const std::string &table) {
+  auto pk = std::make_shared<PrimaryKey>();
+  pk->key_name = "pk_" + table;
+  pk->field_names = {"id"};
+  ScapeSQL::add_pk(table, pk);
+}
+
+static void add_fk(const std::string &table, const std::string &ref) {
+  auto fk = std::make_shared<ForeignKey>();
+  fk->key_name = "fk_" + table;
+  fk->field_names = {"parent"};
+  fk->ref_table_name = ref;
+  fk->ref_field_names = {"id"};
+  ScapeSQL::add_fk(table, fk);
+}
+
+class insert : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() { use_scratch_db("test_insert_data"); }
+};
+
+/// a batch stops where one INSERT per row would have: the rows before the
+/// first failing one are written
+TEST_F(insert, BatchStopsAtFirstFailure) {
+  auto parent = create_scratch_table("parent", {{"id", "INT"}, {"x", "INT"}});
+  auto child =
+      create_scratch_table("child", {{"id", "INT"}, {"parent", "INT"}});
+  add_pk("parent");
+  add_pk("child");
+  add_fk("child", "parent");
+  ASSERT_EQ(parent->insert_records({row(1, 0), row(2, 0)}), 2);
+  ASSERT_FALSE(has_err);
+
+  ASSERT_EQ(child->insert_records({row(1, 1), row(2, 2), row(3, 9), row(4, 1)}),
+            2);
+  ASSERT_TRUE(has_err);
+  has_err = false;
+  /// keys repeated within the batch are duplicates from the second on
+  ASSERT_EQ(child->insert_records({row(5, 1), row(6, 2), row(5, 2)}), 2);
+  ASSERT_TRUE(has_err);
+  has_err = false;
+  ASSERT_EQ(child->insert_records({row(1, 1)}), 0);
+  ASSERT_TRUE(has_err);
+  has_err = false;
+  ASSERT_EQ(child->get_record_num(), 4);
+  ASSERT_EQ(parent->get_primary_key()->num_fk_refs, 1);
+}
+
+/// the batch check would accept a reference to an earlier row of the batch,
+/// but a foreign key into the table itself is refused to begin with
+TEST_F(insert, SelfReferenceRefused) {
+  auto node = create_scratch_table("node", {{"id", "INT"}, {"parent", "INT"}});
+  add_pk("node");
+  add_fk("node", "node");
+  ASSERT_TRUE(node->get_foreign_keys().empty());
+  ASSERT_EQ(node->insert_records({row(1, 7), row(2, 1)}), 2);
+  ASSERT_FALSE(has_err);
+}
+
+/// metadata from earlier builds may carry any row count, it is recounted
+TEST_F(insert, RecountRows) {
+  auto table =
+      create_scratch_table("counted", {{"id", "INT"}, {"parent", "INT"}});
+  std::vector<std::vector<std::any>> rows;
+  for (int i = 0; i < 3000; i++) {
+    rows.push_back(row(i, i));
+  }
+  ASSERT_EQ(table->insert_records(rows), 3000);
+  table->erase_record(0, 0, false);
+  table->erase_record(1, 5, false);
+  ASSERT_EQ(table->get_record_num(), 2998);
+  /// persist the record manager with a garbage count in place of n_records
+  auto meta = Config::get()->db_data_root + "/counted.old";
+  ensure_file(meta);
+  SequentialAccessor accessor(FileMapping::get()->open_file(meta));
+  table->get_record_manager()->serialize(accessor);
+  accessor.reset(0);
+  accessor.read_str();
+  accessor.read<uint32_t>();
+  accessor.read<uint32_t>();
+  accessor.write<uint32_t>(123456789);
+  accessor.reset(0);
+  RecordManager old(accessor);
+  ASSERT_EQ(old.get_record_num(), 123456789);
+  old.recount();
+  ASSERT_EQ(old.get_record_num(), 2998);
+}
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "gtest/gtest.h"
+
+#include <utils/loser_tree.h>
+
+TEST(loser_tree, Merge) {
+  srand(2333);
+  for (int k : {1, 2, 3, 5, 8, 13, 64}) {
+    std::vector<std::vector<int>> runs(k);
+    std::vector<int> all;
+    for (auto &run : runs) {
+      for (int i = rand() % 50 + 1; i > 0; --i) {
+        run.push_back(rand() % 100);
+      }
+      std::sort(run.begin(), run.end());
+      all.insert(all.end(), run.begin(), run.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    std::vector<size_t> pos(k, 0);
+    auto less = [&](int a, int b) { return runs[a][pos[a]] < runs[b][pos[b]]; };
+    LoserTree<decltype(less)> tree(k, less);
+    std::vector<int> merged;
+    for (int i; (i = tree.top()) != -1;) {
+      merged.push_back(runs[i][pos[i]]);
+      tree.replay(++pos[i] == runs[i].size());
+    }
+    ASSERT_EQ(merged, all);
+  }
+}
+
+TEST(loser_tree, Exhausted) {
+  /// sources running out in turn, the rest keep their order
+  std::vector<int> heads = {3, 1, 2};
+  auto less = [&](int a, int b) { return heads[a] < heads[b]; };
+  LoserTree<decltype(less)> tree(3, less);
+  ASSERT_EQ(tree.top(), 1);
+  tree.replay(true);
+  ASSERT_EQ(tree.top(), 2);
+  heads[2] = 5;
+  tree.replay(false);
+  ASSERT_EQ(tree.top(), 0);
+  tree.replay(true);
+  ASSERT_EQ(tree.top(), 2);
+  tree.replay(true);
+  ASSERT_EQ(tree.top(), -1);
+}
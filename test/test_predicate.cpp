@@ -0,0 +1,175 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include <engine/field.h>
+#include <engine/predicate.h>
+#include <engine/query.h>
+
+/// records of (a INT, b INT, f FLOAT, s VARCHAR(7)) laid out as stored
+static std::vector<std::shared_ptr<Field>> make_fields() {
+  std::vector<std::shared_ptr<Field>> fields;
+  unified_id_t table_id = get_unified_id();
+  int offset = sizeof(bitmap_t);
+  for (auto type : {"INT", "INT", "FLOAT", "VARCHAR(7)"}) {
+    auto field = std::make_shared<Field>(get_unified_id());
+    field->datatype = DataTypeBase::build(type);
+    field->table_id = table_id;
+    field->pers_index = fields.size();
+    field->pers_offset = offset;
+    offset += field->get_size();
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+static std::vector<uint8_t> make_records(int n, int record_len) {
+  std::vector<uint8_t> records(n * record_len, 0);
+  for (int i = 0; i < n; ++i) {
+    uint8_t *p = records.data() + i * record_len;
+    bitmap_t bitmap = 0;
+    for (int j = 0; j < 4; ++j) {
+      bitmap |= (rand() % 8 != 0) << j;
+    }
+    *(bitmap_t *)p = bitmap;
+    *(int *)(p + 2) = rand() % 100 - 50;
+    *(int *)(p + 6) = rand() % 100 - 50;
+    *(double *)(p + 10) = (rand() % 400) / 4.0 - 50;
+    snprintf((char *)p + 18, 8, "s%d", rand() % 20);
+  }
+  return records;
+}
+
+static bool check_all(const std::vector<std::shared_ptr<WhereConstraint>> &cons,
+                      const uint8_t *record) {
+  for (const auto &con : cons) {
+    if (!con->check(record, record)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(predicate, MatchesConstraints) {
+  srand(2333);
+  auto fields = make_fields();
+  int record_len = 26, n = 2000;
+  auto records = make_records(n, record_len);
+  Operator ops[] = {Operator::EQ, Operator::LT, Operator::LE,
+                    Operator::GT, Operator::GE, Operator::NE};
+  auto random_constraint = [&]() -> std::shared_ptr<WhereConstraint> {
+    auto field = fields[rand() % 4];
+    Operator op = ops[rand() % 6];
+    switch (rand() % 5) {
+    case 0: {
+      if (field->datatype->type == DataType::VARCHAR) {
+        return std::make_shared<ColumnOpValueConstraint>(
+            field, op, std::string("s") + std::to_string(rand() % 20));
+      }
+      if (field->datatype->type == DataType::FLOAT) {
+        return std::make_shared<ColumnOpValueConstraint>(
+            field, op, (rand() % 400) / 4.0 - 50);
+      }
+      /// now and then at the ends of the range
+      int value = rand() % 8 ? rand() % 100 - 50
+                             : (rand() % 2 ? INT_MIN : INT_MAX);
+      return std::make_shared<ColumnOpValueConstraint>(field, op, value);
+    }
+    case 1:
+      return std::make_shared<ColumnNullConstraint>(field, rand() % 2);
+    case 2: {
+      std::vector<std::any> vals;
+      for (int i = rand() % 4; i >= 0; --i) {
+        vals.push_back(rand() % 100 - 50);
+      }
+      return std::make_shared<ColumnInListConstraint>(fields[rand() % 2],
+                                                      std::move(vals));
+    }
+    case 3: {
+      /// both INT columns, or a column with itself
+      auto lhs = fields[rand() % 2], rhs = field;
+      if (field->datatype->type != DataType::INT) {
+        lhs = field;
+      }
+      auto coc = std::make_shared<ColumnOpColumnConstraint>(lhs, op, rhs);
+      coc->build(lhs->pers_index, lhs->pers_offset, rhs->pers_index,
+                 rhs->pers_offset);
+      return coc;
+    }
+    default:
+      return std::make_shared<ColumnLikeStringConstraint>(fields[3],
+                                                          std::string("s1%"));
+    }
+  };
+  for (int round = 0; round < 2000; ++round) {
+    std::vector<std::shared_ptr<WhereConstraint>> cons;
+    for (int i = rand() % 5; i >= 0; --i) {
+      cons.push_back(random_constraint());
+    }
+    Conjunction conj(cons, fields);
+    for (int i = 0; i < n; ++i) {
+      const uint8_t *record = records.data() + i * record_len;
+      ASSERT_EQ(conj.check(record), check_all(cons, record));
+    }
+  }
+}
+
+TEST(predicate, RangeEdges) {
+  auto fields = make_fields();
+  uint8_t record[26] = {};
+  *(bitmap_t *)record = 0xf;
+  auto cv = [&](Operator op, int v) -> std::shared_ptr<WhereConstraint> {
+    return std::make_shared<ColumnOpValueConstraint>(fields[0], op, v);
+  };
+  for (int x : {INT_MIN, INT_MIN + 1, -1, 0, 1, INT_MAX - 1, INT_MAX}) {
+    *(int *)(record + 2) = x;
+    ASSERT_EQ(Conjunction({cv(Operator::LT, INT_MIN)}, fields).check(record),
+              false);
+    ASSERT_EQ(Conjunction({cv(Operator::GT, INT_MAX)}, fields).check(record),
+              false);
+    ASSERT_EQ(Conjunction({cv(Operator::GE, INT_MIN)}, fields).check(record),
+              true);
+    ASSERT_EQ(Conjunction({cv(Operator::LE, x), cv(Operator::GE, x)}, fields)
+                  .check(record),
+              true);
+    ASSERT_EQ(Conjunction({cv(Operator::GT, -1), cv(Operator::LT, 1)}, fields)
+                  .check(record),
+              x == 0);
+  }
+  ASSERT_TRUE(Conjunction({}, fields).trivial());
+}
+
+/// filtered scan throughput, through virtual check() and std::function
+/// against the compiled kernels
+TEST(predicate, Throughput) {
+  srand(41);
+  auto fields = make_fields();
+  int record_len = 26, n = 1 << 20;
+  auto records = make_records(n, record_len);
+  std::vector<std::shared_ptr<WhereConstraint>> cons = {
+      std::make_shared<ColumnOpValueConstraint>(fields[1], Operator::GE, -25),
+      std::make_shared<ColumnOpValueConstraint>(fields[1], Operator::LT, 25),
+      std::make_shared<ColumnOpValueConstraint>(fields[2], Operator::LE, 40.0),
+      std::make_shared<ColumnOpValueConstraint>(fields[0], Operator::NE, 7),
+      std::make_shared<ColumnNullConstraint>(fields[3], true)};
+  Conjunction conj(cons, fields);
+  auto scan = [&](auto check) {
+    auto start = std::chrono::steady_clock::now();
+    int hits = 0;
+    for (int rep = 0; rep < 4; ++rep) {
+      for (int i = 0; i < n; ++i) {
+        hits += check(records.data() + i * record_len);
+      }
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    std::cout << hits / 4 << " hits, " << 4 * n / ms / 1000
+              << " M rows/s" << std::endl;
+    return hits;
+  };
+  int expected = scan([&](const uint8_t *r) { return check_all(cons, r); });
+  ASSERT_EQ(scan([&](const uint8_t *r) { return conj.check(r); }), expected);
+}
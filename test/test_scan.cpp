@@ -0,0 +1,100 @@
+#include <any>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "test_db.h"
+#include <engine/iterator.h>
+#include <engine/query.h>
+
+/// over two rounds of morsels for a pool of 4
+const int N = 100000;
+
+class scan : public ::testing::Test {
+protected:
+  static inline std::shared_ptr<TableManager> table;
+
+  static void SetUpTestSuite() {
+    Config::get_mut()->scan_threads = 4;
+    use_scratch_db("test_scan_data");
+    table = create_scratch_table(
+        "wide", {{"a", "INT"}, {"b", "INT"}, {"pad", "VARCHAR(96)"}});
+    std::mt19937 rng(2333);
+    std::vector<std::vector<std::any>> rows;
+    for (int i = 0; i < N; i++) {
+      std::any b = rng() % 8 ? std::any((int)(rng() % 100)) : std::any();
+      rows.push_back({std::any((int)(rng() % 1000)), b,
+                      std::any(std::string(rng() % 96, 'p'))});
+      if (rows.size() == 4096 || i == N - 1) {
+        ASSERT_EQ(table->insert_records(rows), (int)rows.size());
+        rows.clear();
+      }
+    }
+  }
+
+  static std::vector<std::shared_ptr<WhereConstraint>> a_below(int v) {
+    return {std::shared_ptr<WhereConstraint>(new ColumnOpValueConstraint(
+        table->get_field("a"), Operator::LT, std::any(v)))};
+  }
+
+  /// the next n rows of iter through its blocks, all of them when n is -1.
+  /// the bytes of NULL fields are left unspecified by the scans, so zeroed
+  static std::vector<std::string> take(BlockIterator &iter, int n = -1) {
+    int len = sizeof(bitmap_t);
+    std::vector<std::pair<int, int>> spans;
+    for (auto f : iter.get_fields_dst()) {
+      spans.emplace_back(len, f->get_size());
+      len += f->get_size();
+    }
+    std::vector<std::string> out;
+    while (n == -1 || (int)out.size() < n) {
+      iter.block_next();
+      if (iter.block_end()) {
+        iter.fill_next_block();
+      }
+      if (iter.all_end()) {
+        break;
+      }
+      std::string row((const char *)iter.get(), len);
+      bitmap_t bitmap = *(const bitmap_t *)row.data();
+      for (size_t i = 0; i < spans.size(); i++) {
+        if (!(bitmap >> i & 1)) {
+          row.replace(spans[i].first, spans[i].second, spans[i].second, '\0');
+        }
+      }
+      out.push_back(std::move(row));
+    }
+    return out;
+  }
+};
+
+TEST_F(scan, ParallelKeepsSerialOrder) {
+  /// the projection drops pad and reorders the others
+  std::vector<std::shared_ptr<Field>> fields = {table->get_field("b"),
+                                                table->get_field("a")};
+  for (int v : {1000, 333, 1}) {
+    auto serial = table->make_iterator(a_below(v), fields);
+    auto parallel = table->make_iterator(a_below(v), fields, false, 100, true);
+    auto morsels =
+        std::dynamic_pointer_cast<ParallelScanIterator>(parallel)->n_morsels();
+    ASSERT_GT(morsels, 2 * 4 * 4);
+    auto expected = take(*serial);
+    ASSERT_EQ(take(*parallel), expected);
+  }
+}
+
+/// a nested-loop join resets its inner side after partial or whole scans
+TEST_F(scan, ParallelRescansAfterReset) {
+  auto serial = table->make_iterator(a_below(500), table->get_fields());
+  auto parallel =
+      table->make_iterator(a_below(500), table->get_fields(), false, 100, true);
+  auto expected = take(*serial);
+  for (int n : {0, 1, 5000, (int)expected.size() / 2, -1}) {
+    take(*parallel, n);
+    parallel->reset_all();
+    ASSERT_EQ(take(*parallel), expected);
+    parallel->reset_all();
+  }
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <any>
+#include <optional>
+#include <random>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "test_db.h"
+#include <engine/iterator.h>
+#include <engine/query.h>
+
+const int N = 5000;
+
+/// a NULL or the value of an INT, FLOAT or VARCHAR column
+typedef std::optional<std::variant<int, double, std::string>> value_t;
+
+class sort : public ::testing::Test {
+protected:
+  static inline std::shared_ptr<TableManager> table;
+  /// the columns a, f and c of each row, row i has id i
+  static inline std::vector<std::vector<value_t>> values;
+
+  static void SetUpTestSuite() {
+    use_scratch_db("test_sort_data");
+    table = create_scratch_table("t", {{"id", "INT"},
+                                       {"a", "INT"},
+                                       {"f", "FLOAT"},
+                                       {"c", "VARCHAR(1)"}});
+    std::mt19937 rng(2333);
+    std::vector<std::vector<std::any>> rows;
+    for (int i = 0; i < N; i++) {
+      /// few distinct values, so that ties and NULLs are common
+      value_t a, f, c;
+      if (rng() % 8) {
+        a = (int)(rng() % 50) - 25;
+      }
+      if (rng() % 8) {
+        f = (double)((int)(rng() % 40) - 20) / 4;
+      }
+      if (rng() % 8) {
+        c = std::string(1, 'a' + rng() % 5);
+      }
+      values.push_back({a, f, c});
+      std::vector<std::any> row = {std::any(i)};
+      for (auto &v : values.back()) {
+        row.push_back(!v ? std::any()
+                         : std::visit([](auto x) { return std::any(x); }, *v));
+      }
+      rows.push_back(row);
+    }
+    ASSERT_EQ(table->insert_records(rows), N);
+  }
+
+  /// the ids of the rows sorted by order_by, pairs of a column of values
+  /// and whether it is DESC
+  static std::vector<int>
+  sorted(const std::vector<std::pair<int, bool>> &order_by) {
+    std::vector<std::pair<std::shared_ptr<Field>, bool>> fields;
+    const char *names[] = {"a", "f", "c"};
+    for (auto [column, desc] : order_by) {
+      fields.emplace_back(table->get_field(names[column]), desc);
+    }
+    SortIterator iter(std::make_shared<PermuteIterator>(
+                          table->make_iterator({}, table->get_fields()),
+                          table->get_fields()),
+                      fields);
+    std::vector<int> ids;
+    while (iter.get_next_valid()) {
+      ids.push_back(*(const int *)(iter.get() + sizeof(bitmap_t)));
+    }
+    return ids;
+  }
+
+  /// NULLs first, DESC reverses a column with its NULLs, and ties keep the
+  /// scan order unless the last column is DESC
+  static std::vector<int>
+  expected(const std::vector<std::pair<int, bool>> &order_by) {
+    std::vector<int> ids(N);
+    for (int i = 0; i < N; i++) {
+      ids[i] = i;
+    }
+    std::sort(ids.begin(), ids.end(), [&](int x, int y) {
+      for (auto [column, desc] : order_by) {
+        auto &vx = values[x][column], &vy = values[y][column];
+        if (vx != vy) {
+          return (vx < vy) != desc;
+        }
+      }
+      return (x < y) != order_by.back().second;
+    });
+    return ids;
+  }
+};
+
+TEST_F(sort, NullsFirstAscendingLastDescending) {
+  for (int column : {0, 1, 2}) {
+    for (bool desc : {false, true}) {
+      auto ids = sorted({{column, desc}});
+      ASSERT_EQ(ids, expected({{column, desc}}));
+      ASSERT_EQ(!values[ids.front()][column], !desc);
+      ASSERT_EQ(!values[ids.back()][column], desc);
+    }
+  }
+}
+
+/// c alone is a key of 7 bytes, shorter than the radix prefix
+TEST_F(sort, KeyShorterThanPrefix) {
+  ASSERT_EQ(sorted({{2, false}}), expected({{2, false}}));
+  ASSERT_EQ(sorted({{2, true}}), expected({{2, true}}));
+}
+
+TEST_F(sort, MultiColumn) {
+  for (auto order_by : std::vector<std::vector<std::pair<int, bool>>>{
+           {{0, false}, {1, true}},
+           {{2, true}, {0, false}},
+           {{1, true}, {2, false}, {0, true}},
+           {{2, false}, {1, false}, {0, false}}}) {
+    ASSERT_EQ(sorted(order_by), expected(order_by));
+  }
+}
+
+/// ORDER BY served from an index gives the rows, ties included, in the
+/// order SortIterator does
+TEST_F(sort, OrderedIndexScanMatchesSort) {
+  auto index = [](std::vector<std::string> columns) {
+    auto key = std::make_shared<ExplicitIndexKey>();
+    key->key_name = "idx";
+    for (auto &column : columns) {
+      key->key_name += "_" + column;
+    }
+    key->field_names = columns;
+    ScapeSQL::add_index("t", key);
+  };
+  /// a >= -25 holds for every value, and keeps NULLs out of the index scan
+  std::vector<std::shared_ptr<WhereConstraint>> cons = {
+      std::shared_ptr<WhereConstraint>(new ColumnOpValueConstraint(
+          table->get_field("a"), Operator::GE, std::any(-25)))};
+  auto ordered = [&](bool desc) {
+    return table->make_ordered_iterator(cons, table->get_fields(),
+                                        table->get_field("a"), desc, true);
+  };
+  /// ties on a would follow id
+  index({"a", "id"});
+  ASSERT_EQ(ordered(false), nullptr);
+  index({"a"});
+  for (bool desc : {false, true}) {
+    auto scan = ordered(desc);
+    ASSERT_NE(scan, nullptr);
+    PermuteIterator iter(scan, table->get_fields());
+    std::vector<int> ids;
+    while (iter.get_next_valid()) {
+      ids.push_back(*(const int *)(iter.get() + sizeof(bitmap_t)));
+    }
+    auto expected = sorted({{0, desc}});
+    std::erase_if(expected, [](int id) { return !values[id][0]; });
+    ASSERT_EQ(ids, expected);
+  }
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <any>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "test_db.h"
+#include <engine/stats.h>
+
+class stats : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    Config::get_mut()->stats_refresh_fraction = 0.2;
+    use_scratch_db("test_stats_data");
+  }
+
+  static void insert(std::shared_ptr<TableManager> table,
+                     std::vector<std::vector<std::any>> &&rows) {
+    ASSERT_EQ(table->insert_records(rows), (int)rows.size());
+  }
+};
+
+TEST(column_stats, FractionFromBuckets) {
+  /// four buckets over [0, 100), 25% of the values each
+  ColumnStats col;
+  col.type = DataType::FLOAT;
+  col.ndv = 100;
+  col.min_val = 0;
+  col.max_val = 100;
+  col.bounds = {0, 10, 20, 50, 100};
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LT, 0), 0);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LT, 10), 0.25);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LT, 15), 0.375);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LT, 35), 0.625);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::GE, 35), 0.375);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LT, 200), 1);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::EQ, 35), 0.01);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::EQ, 200), 0);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::NE, 200), 1);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LE, 35), 0.635);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::GT, 35), 0.365);
+  /// no values at all
+  col.bounds.clear();
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LT, 35), 0);
+}
+
+TEST(column_stats, IntegerFractions) {
+  /// 0 to 99 once each in ten buckets
+  ColumnStats col;
+  col.type = DataType::INT;
+  col.ndv = 100;
+  col.min_val = 0;
+  col.max_val = 99;
+  for (int i = 0; i <= 10; i++) {
+    col.bounds.push_back(i == 10 ? 99 : i * 10);
+  }
+  for (int v : {0, 5, 37, 98}) {
+    double lt = col.fraction(Operator::LT, v);
+    double le = col.fraction(Operator::LE, v);
+    ASSERT_DOUBLE_EQ(le, col.fraction(Operator::LT, v + 1));
+    ASSERT_NEAR(le - lt, 0.01, 0.002);
+    ASSERT_NEAR(col.fraction(Operator::EQ, v), 0.01, 0.002);
+    ASSERT_DOUBLE_EQ(col.fraction(Operator::GT, v), 1 - le);
+  }
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::LE, 99), 1);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::EQ, -1), 0);
+  ASSERT_DOUBLE_EQ(col.fraction(Operator::EQ, 100), 0);
+}
+
+TEST_F(stats, HistogramOfTable) {
+  auto table = create_scratch_table("hist", {{"u", "INT"}, {"k", "INT"}});
+  /// u is 0 to 999 ten times over, k is 7 in half of the rows and NULL in a
+  /// tenth of them
+  std::mt19937 rng(2333);
+  std::vector<std::vector<std::any>> rows;
+  for (int i = 0; i < 10000; i++) {
+    std::any k = rng() % 10 == 0 ? std::any()
+                 : rng() % 2     ? std::any(7)
+                                 : std::any((int)(rng() % 1000) + 100);
+    rows.push_back({std::any(i % 1000), k});
+  }
+  insert(table, std::move(rows));
+  table->analyze();
+  auto stats = table->get_stats();
+  ASSERT_EQ(stats->n_rows, 10000);
+  auto &u = stats->columns[0];
+  ASSERT_NEAR(u.ndv, 1000, 1000 * 0.05);
+  ASSERT_DOUBLE_EQ(u.null_frac, 0);
+  ASSERT_DOUBLE_EQ(u.min_val, 0);
+  ASSERT_DOUBLE_EQ(u.max_val, 999);
+  ASSERT_EQ((int)u.bounds.size(), TableStats::HISTOGRAM_BUCKETS + 1);
+  ASSERT_DOUBLE_EQ(u.bounds.front(), 0);
+  ASSERT_DOUBLE_EQ(u.bounds.back(), 999);
+  ASSERT_TRUE(std::is_sorted(u.bounds.begin(), u.bounds.end()));
+  for (int v : {100, 250, 500, 900}) {
+    ASSERT_NEAR(u.fraction(Operator::LT, v), v / 1000.0, 0.02);
+  }
+  ASSERT_NEAR(u.fraction(Operator::EQ, 500), 0.001, 0.001);
+
+  auto &k = stats->columns[1];
+  ASSERT_NEAR(k.null_frac, 0.1, 0.02);
+  /// the frequent value spans buckets of its own
+  ASSERT_NEAR(k.fraction(Operator::EQ, 7), 0.5, 0.05);
+  ASSERT_NEAR(k.fraction(Operator::EQ, 500), 1.0 / 1000, 0.002);
+  ASSERT_NEAR(k.fraction(Operator::LE, 7) - k.fraction(Operator::LT, 7), 0.5,
+              0.05);
+}
+
+/// planning reads the statistics as they are, the modifying statements
+/// gather them again
+TEST_F(stats, RefreshAfterModifications) {
+  auto table = create_scratch_table("refresh", {{"v", "INT"}});
+  auto rows = [](int from, int to) {
+    std::vector<std::vector<std::any>> out;
+    for (int i = from; i < to; i++) {
+      out.push_back({std::any(i)});
+    }
+    return out;
+  };
+  insert(table, rows(0, 2000));
+  table->analyze();
+  auto analyzed = table->get_stats();
+  ASSERT_EQ(analyzed->n_rows, 2000);
+  /// under a fifth of the rows changed
+  insert(table, rows(2000, 2300));
+  table->refresh_stats();
+  ASSERT_EQ(table->get_stats(), analyzed);
+  insert(table, rows(2300, 3000));
+  ASSERT_EQ(table->get_stats(), analyzed);
+  table->refresh_stats();
+  ASSERT_NE(table->get_stats(), analyzed);
+  ASSERT_EQ(table->get_stats()->n_rows, 3000);
+  ASSERT_EQ(table->get_stats()->n_modified, 0);
+  ASSERT_DOUBLE_EQ(table->get_stats()->columns[0].max_val, 2999);
+}
@@ -1,4 +1,5 @@
 #include <any>
+#include <cstring>
 #include <filesystem>
 #include <random>
 #include <vector>
@@ -55,4 +56,33 @@ TEST(storage, SequentialAccessor) {
     }
   }
   FileMapping::get()->close_temp_file(fd);
-}
\ No newline at end of file
+}
+
+TEST(storage, PinnedPageSurvivesEviction) {
+  Config::get_mut()->temp_file_template =
+      std::filesystem::current_path() / "tf_XXXXXX";
+  int fd = FileMapping::get()->create_temp_file();
+  auto buffer = PagedBuffer::get();
+  uint8_t *page = buffer->read_file_rdwr(std::make_pair(fd, 0));
+  memset(page, 0x5a, Config::PAGE_SIZE);
+  uint8_t *pinned = buffer->pin(std::make_pair(fd, 0));
+  ASSERT_EQ(pinned, page);
+  /// pages past the end of the file read as nothing, but take slots
+  for (int i = 1; i <= Config::POOLED_PAGES + 16; i++) {
+    buffer->read_file_rd(std::make_pair(fd, i));
+  }
+  ASSERT_EQ(buffer->read_file_rd(std::make_pair(fd, 0)), pinned);
+  for (int i = 0; i < Config::PAGE_SIZE; i++) {
+    ASSERT_EQ(pinned[i], 0x5a);
+  }
+  /// once unpinned it is written back when evicted, and read again
+  buffer->unpin(pinned);
+  for (int i = 1; i <= Config::POOLED_PAGES + 16; i++) {
+    buffer->read_file_rd(std::make_pair(fd, i));
+  }
+  uint8_t *reread = buffer->read_file_rd(std::make_pair(fd, 0));
+  for (int i = 0; i < Config::PAGE_SIZE; i++) {
+    ASSERT_EQ(reread[i], 0x5a);
+  }
+  FileMapping::get()->close_temp_file(fd);
+}
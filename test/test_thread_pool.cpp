@@ -0,0 +1,39 @@
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <utils/config.h>
+#include <utils/thread_pool.h>
+
+TEST(thread_pool, RunsEveryTaskOnce) {
+  Config::get_mut()->scan_threads = 4;
+  auto pool = ThreadPool::get();
+  ASSERT_EQ(pool->size(), 4);
+  for (int n : {0, 1, 3, 1000}) {
+    std::vector<std::atomic<int>> runs(n);
+    std::atomic<bool> bad_worker{false};
+    pool->run(n, [&](int worker, int task) {
+      if (worker < 0 || worker >= pool->size()) {
+        bad_worker = true;
+      }
+      ++runs[task];
+    });
+    ASSERT_FALSE(bad_worker);
+    for (int i = 0; i < n; ++i) {
+      ASSERT_EQ(runs[i], 1);
+    }
+  }
+}
+
+TEST(thread_pool, PerWorkerSums) {
+  auto pool = ThreadPool::get();
+  /// a slot per worker needs no synchronization
+  std::vector<int64_t> sums(pool->size());
+  pool->run(100000, [&](int worker, int task) { sums[worker] += task; });
+  int64_t total = 0;
+  for (auto s : sums) {
+    total += s;
+  }
+  ASSERT_EQ(total, (int64_t)100000 * 99999 / 2);
+}